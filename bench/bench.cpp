@@ -0,0 +1,138 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+#include "bench.hpp"
+
+namespace groho {
+
+std::vector<SimdLevel> simd_levels()
+{
+    std::vector<SimdLevel> levels;
+    for (int l = SimdLevel::SCALAR; l <= supported_simd_level(); l++) {
+        levels.push_back(SimdLevel(l));
+    }
+    return levels;
+}
+
+bool Bench::wanted(const std::string& name) const
+{
+    return (name.find(options.filter) != std::string::npos)
+        || (options.filter.rfind(name, 0) == 0);
+}
+
+void Bench::run(
+    const std::string&    name,
+    const std::string&    unit,
+    size_t                ops,
+    std::function<void()> fn,
+    const BenchParams&    params)
+{
+    if (!wanted(name)) {
+        return;
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto time   = [&fn](size_t calls) {
+        auto t0 = clock::now();
+        for (size_t i = 0; i < calls; i++) {
+            fn();
+        }
+        return std::chrono::duration<double>(clock::now() - t0).count();
+    };
+
+    // The first call warms up the caches, loads the ephemeris records and so
+    // on, and tells us how many calls fill min_time
+    double once  = std::max(time(1), 1e-9);
+    size_t calls = std::max(1.0, std::ceil(options.min_time / once));
+
+    BenchResult result{ name, unit, ops, calls, {}, params };
+    for (size_t r = 0; r < options.repeats; r++) {
+        result.ns_per_op.push_back(time(calls) * 1e9 / (calls * ops));
+    }
+    std::sort(result.ns_per_op.begin(), result.ns_per_op.end());
+
+    std::cerr << std::left << std::setw(40) << name << std::right
+              << std::setw(12) << std::setprecision(4) << result.median()
+              << " ns/" << unit << std::endl;
+    results.push_back(result);
+}
+
+const fs::path& Bench::scratch_dir()
+{
+    if (scratch.empty()) {
+        scratch = fs::temp_directory_path()
+            / ("groho-bench-" + std::to_string(getpid()));
+        fs::create_directories(scratch);
+    }
+    return scratch;
+}
+
+Bench::~Bench()
+{
+    if (!scratch.empty()) {
+        std::error_code ec;
+        fs::remove_all(scratch, ec);
+    }
+}
+
+std::string json_string(const std::string& s)
+{
+    std::ostringstream out;
+    out << '"';
+    for (char c : s) {
+        if ((c == '"') || (c == '\\')) {
+            out << '\\' << c;
+        } else if ((unsigned char)c < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                << int(c) << std::dec << std::setfill(' ');
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+void Bench::write_json(std::ostream& out) const
+{
+    out << std::setprecision(6);
+    out << "{\n";
+    out << "  \"label\": " << json_string(options.label) << ",\n";
+    out << "  \"simd\": " << json_string(simd_level_name(simd_level()))
+        << ",\n";
+    out << "  \"min_time_s\": " << options.min_time << ",\n";
+    out << "  \"repeats\": " << options.repeats << ",\n";
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\n";
+        out << "      \"name\": " << json_string(r.name) << ",\n";
+        out << "      \"unit\": " << json_string(r.unit) << ",\n";
+        out << "      \"ops\": " << r.ops << ",\n";
+        out << "      \"calls\": " << r.calls << ",\n";
+        out << "      \"params\": {";
+        for (size_t j = 0; j < r.params.size(); j++) {
+            out << (j ? ", " : " ") << json_string(r.params[j].first) << ": "
+                << r.params[j].second << (j + 1 == r.params.size() ? " " : "");
+        }
+        out << "},\n";
+        out << "      \"ns_per_op\": " << r.median() << ",\n";
+        out << "      \"ns_per_op_min\": " << r.ns_per_op.front() << ",\n";
+        out << "      \"ns_per_op_max\": " << r.ns_per_op.back() << ",\n";
+        out << "      \"ops_per_s\": " << 1e9 / r.median() << "\n";
+        out << "    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+}
@@ -0,0 +1,100 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+A small benchmark harness.
+
+Each benchmark is a function that does some number of operations (ephemeris
+evaluations, samples written, steps simulated ...). We call it enough times to
+fill min_time, and do that repeats times, then report the time per operation:
+the median, to compare commits by, and the spread. Results are written out as
+JSON so they can be kept and compared across commits.
+*/
+
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "simd.hpp"
+
+namespace groho {
+
+namespace fs = std::filesystem;
+
+// Keep the compiler from optimizing away a result we don't otherwise use
+template <typename T> inline void keep(const T& v)
+{
+    asm volatile("" : : "g"(&v) : "memory");
+}
+
+// What a benchmark was run with: body counts, step sizes ...
+typedef std::vector<std::pair<std::string, double>> BenchParams;
+
+struct BenchResult {
+    std::string         name;
+    std::string         unit;      // what one operation is
+    size_t              ops;       // operations per call of the function
+    size_t              calls;     // per repeat
+    std::vector<double> ns_per_op; // one per repeat, sorted
+    BenchParams         params;
+
+    double median() const { return ns_per_op[ns_per_op.size() / 2]; }
+};
+
+class Bench {
+public:
+    struct Options {
+        double      min_time = 0.2; // s, per repeat
+        size_t      repeats  = 5;
+        std::string filter; // only run benchmarks whose names contain this
+        std::string label;  // to tell runs apart, e.g. the commit
+    };
+
+    explicit Bench(const Options& options)
+        : options(options)
+    {
+    }
+
+    // Does the filter let this one, or some of those named after it, through?
+    bool wanted(const std::string& name) const;
+
+    // fn does ops operations of the given unit
+    void run(
+        const std::string&    name,
+        const std::string&    unit,
+        size_t                ops,
+        std::function<void()> fn,
+        const BenchParams&    params = {});
+
+    // Where benchmarks can put their files. Removed when we are done
+    const fs::path& scratch_dir();
+
+    void write_json(std::ostream& out) const;
+
+    ~Bench();
+
+private:
+    Options                  options;
+    std::vector<BenchResult> results;
+    fs::path                 scratch;
+};
+
+// SCALAR up to the best level the CPU has
+std::vector<SimdLevel> simd_levels();
+
+// The benchmarks
+void bench_chebyshev(Bench& bench);
+void bench_orrery(Bench& bench, const fs::path& kernel, size_t bodies);
+void bench_gravity(Bench& bench, const fs::path& kernel);
+void bench_downsampler(Bench& bench);
+void bench_simple_buffer(Bench& bench);
+void bench_threaded_buffer(Bench& bench);
+void bench_async_writer(Bench& bench);
+void bench_simulation(Bench& bench, const fs::path& kernel);
+
+}
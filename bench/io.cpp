@@ -0,0 +1,72 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Benchmarks of the ways we write samples out
+*/
+
+#include <memory>
+
+#include "asyncwriter.hpp"
+#include "bench.hpp"
+#include "threadedbuffer.hpp"
+#include "v3d.hpp"
+
+namespace groho {
+
+// 8 MB of samples, each time to a new file
+const size_t io_samples = 1 << 18;
+
+void bench_threaded_buffer(Bench& bench)
+{
+    if (!bench.wanted("threaded_buffer")) {
+        return;
+    }
+
+    const auto path = bench.scratch_dir() / "threadedbuffer.bin";
+    const V3d  v    = { 1, 2, 3, 4 };
+    bench.run(
+        "threaded_buffer",
+        "sample",
+        io_samples,
+        [&]() {
+            auto buffer = std::make_unique<ThreadedBuffer<V3d>>(path);
+            for (size_t i = 0; i < io_samples; i++) {
+                buffer->write(v);
+            }
+        },
+        { { "bytes_per_op", sizeof(V3d) } });
+}
+
+void bench_async_writer(Bench& bench)
+{
+    if (!bench.wanted("async_writer")) {
+        return;
+    }
+
+    // Blocks of samples, as the histories hand them over
+    const size_t    block = 4096;
+    const auto      path  = bench.scratch_dir() / "asyncwriter.bin";
+    const v3d_vec_t samples(block, V3d{ 1, 2, 3, 4 });
+
+    AsyncWriter writer;
+    bench.run(
+        "async_writer",
+        "sample",
+        io_samples,
+        [&]() {
+            uint64_t offset = 0;
+            for (size_t i = 0; i < io_samples; i += block) {
+                std::vector<char> data;
+                data.reserve(block * sizeof(V3d));
+                append(data, samples.data(), block);
+                size_t size = data.size();
+                writer.write(path, offset, std::move(data), i == 0);
+                offset += size;
+            }
+            writer.flush();
+        },
+        { { "bytes_per_op", sizeof(V3d) }, { "block", block } });
+}
+
+}
@@ -0,0 +1,89 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Benchmarks, on synthetic kernels so they need no JPL files. Progress goes to
+stderr and the results, as JSON, to stdout (or --out)
+
+    build/groho_bench --label $(git rev-parse --short HEAD) > bench.json
+*/
+
+#include <fstream>
+#include <iostream>
+
+#include "CLI11.hpp"
+
+#include "bench.hpp"
+#include "syntheticspk.hpp"
+
+#define LOGURU_WITH_STREAMS 1
+#include "loguru.hpp"
+
+using namespace groho;
+
+int main(int argc, char* argv[])
+{
+    CLI::App app{ "Groho benchmarks" };
+
+    Bench::Options options;
+    std::string    out_file;
+    size_t         asteroids = 1000;
+    app.add_option(
+        "--min-time", options.min_time, "Seconds each repeat runs for");
+    app.add_option("--repeats", options.repeats, "Times each benchmark runs");
+    app.add_option(
+        "--filter",
+        options.filter,
+        "Only run the benchmarks whose names contain this");
+    app.add_option(
+        "--label", options.label, "Tag for the results, e.g. the commit");
+    app.add_option(
+        "--asteroids",
+        asteroids,
+        "Bodies in the large kernel the orrery is also timed on");
+    app.add_option("--out", out_file, "Write the results here, not stdout");
+    CLI11_PARSE(app, argc, argv);
+
+    // The orrery and simulator are chatty
+    loguru::g_stderr_verbosity = loguru::Verbosity_WARNING;
+
+    Bench bench(options);
+
+    // The usual cast of the solar system, and the same with asteroids
+    SyntheticKernel kernel;
+    kernel.begin     = GregorianDate{ 2020, 1, 1, 0 };
+    kernel.end       = GregorianDate{ 2021, 1, 2, 0 };
+    const auto small = bench.scratch_dir() / "solar.bsp";
+    const auto large = bench.scratch_dir() / "asteroids.bsp";
+    kernel.bodies    = 20;
+    if (!write_synthetic_spk(small, kernel)) {
+        return 1;
+    }
+    kernel.bodies = 20 + asteroids;
+    if (bench.wanted("orrery_pos_at/" + std::to_string(kernel.bodies))
+        && !write_synthetic_spk(large, kernel)) {
+        return 1;
+    }
+
+    bench_chebyshev(bench);
+    bench_orrery(bench, small, 20);
+    bench_orrery(bench, large, 20 + asteroids);
+    bench_gravity(bench, small);
+    bench_downsampler(bench);
+    bench_simple_buffer(bench);
+    bench_threaded_buffer(bench);
+    bench_async_writer(bench);
+    bench_simulation(bench, small);
+
+    if (out_file.empty()) {
+        bench.write_json(std::cout);
+    } else {
+        std::ofstream out(out_file);
+        bench.write_json(out);
+        if (!out) {
+            std::cerr << "Could not write " << out_file << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
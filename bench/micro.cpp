@@ -0,0 +1,208 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Benchmarks of the inner loops: ephemeris evaluation, gravity and downsampling
+*/
+
+#include <cmath>
+#include <random>
+
+#include "batchdownsampler.hpp"
+#include "bench.hpp"
+#include "chebyshev.hpp"
+#include "fractaldownsampler.hpp"
+#include "gravity.hpp"
+#include "orrery.hpp"
+
+namespace groho {
+
+const J2000_s bench_begin = GregorianDate{ 2020, 1, 1, 0 };
+const J2000_s bench_end   = GregorianDate{ 2021, 1, 1, 0 };
+
+void bench_chebyshev(Bench& bench)
+{
+    // A record of made-up coefficients, falling off as an ephemeris' do, and
+    // times spread over the record
+    const size_t        n = 12, m = 1024;
+    std::vector<double> A(3 * n), x(m);
+    for (size_t k = 0; k < 3 * n; k++) {
+        A[k] = 1e8 / std::pow(-4.0, k % n);
+    }
+    for (size_t j = 0; j < m; j++) {
+        x[j] = -1 + 2.0 * (j + 0.5) / m;
+    }
+
+    bench.run(
+        "cheby_eval_one",
+        "series",
+        m,
+        [&]() {
+            double s = 0;
+            for (double xj : x) {
+                s += cheby_eval_one(A.data(), n, xj);
+            }
+            keep(s);
+        },
+        { { "n_coeff", n } });
+
+    for (auto level : simd_levels()) {
+        set_simd_level(level);
+        bench.run(
+            std::string("cheby_eval_xyz/") + simd_level_name(level),
+            "record",
+            m,
+            [&]() {
+                double xyz[3], s = 0;
+                for (double xj : x) {
+                    cheby_eval_xyz(A.data(), n, xj, xyz);
+                    s += xyz[0];
+                }
+                keep(s);
+            },
+            { { "n_coeff", n } });
+    }
+    set_simd_level(supported_simd_level());
+}
+
+void bench_orrery(Bench& bench, const fs::path& kernel, size_t bodies)
+{
+    std::string name = "orrery_pos_at/" + std::to_string(bodies);
+    if (!bench.wanted(name)) {
+        return;
+    }
+
+    Orrery orrery(bench_begin, bench_end, { { {}, kernel, nullptr, {} } });
+
+    // Walking forward a step at a time, as a simulation does
+    const double dt    = 60;
+    const size_t calls = 1000;
+    double       t     = bench_begin;
+    v3d_vec_t    pos(orrery.size());
+    bench.run(
+        name,
+        "call",
+        calls,
+        [&]() {
+            for (size_t i = 0; i < calls; i++) {
+                orrery.pos_at(t, pos);
+                t += dt;
+                if (t >= bench_end) {
+                    t = bench_begin;
+                }
+            }
+            keep(pos[0]);
+        },
+        { { "bodies", double(orrery.size()) }, { "dt", dt } });
+}
+
+void bench_gravity(Bench& bench, const fs::path& kernel)
+{
+    if (!bench.wanted("gravity")) {
+        return;
+    }
+
+    Orrery    orrery(bench_begin, bench_end, { { {}, kernel, nullptr, {} } });
+    v3d_vec_t pos(orrery.size());
+    orrery.pos_at(bench_begin, pos);
+    auto bodies = orrery.get_bodies();
+
+    GravityField field;
+    for (size_t i : orrery.get_grav_body_idx()) {
+        field.x.push_back(pos[i].x);
+        field.y.push_back(pos[i].y);
+        field.z.push_back(pos[i].z);
+        field.GM.push_back(bodies[i].GM);
+    }
+
+    // Craft scattered over the inner solar system
+    const size_t                           n = 1024;
+    v3d_vec_t                              craft(n), acc(n);
+    std::mt19937                           gen(42);
+    std::uniform_real_distribution<double> coord(-3e8, 3e8);
+    for (auto& p : craft) {
+        p = { coord(gen), coord(gen), coord(gen), bench_begin };
+    }
+
+    for (auto level : simd_levels()) {
+        set_simd_level(level);
+        bench.run(
+            std::string("gravity/") + simd_level_name(level),
+            "craft-body",
+            n * field.size(),
+            [&]() {
+                gravitational_acceleration(field, craft.data(), acc.data(), n);
+                keep(acc[0]);
+            },
+            { { "craft", n }, { "bodies", double(field.size()) } });
+    }
+    set_simd_level(supported_simd_level());
+}
+
+// Bodies on circular orbits of periods from 90 minutes on, sampled a minute
+// apart, so the downsamplers keep a sample now and then
+v3d_vec_t orbit_samples(size_t bodies, size_t steps)
+{
+    v3d_vec_t pos(bodies * steps);
+    for (size_t s = 0; s < steps; s++) {
+        double t = s * 60.0;
+        for (size_t b = 0; b < bodies; b++) {
+            double r = 6778 * (1 + b), w = 2 * M_PI / (5400 * (1 + b));
+            pos[s * bodies + b]
+                = { r * std::cos(w * t), r * std::sin(w * t), 0, t };
+        }
+    }
+    return pos;
+}
+
+void bench_downsampler(Bench& bench)
+{
+    const size_t steps = 1 << 14;
+    const auto   path  = orbit_samples(1, steps);
+    bench.run("fractal_downsampler", "sample", steps, [&]() {
+        FractalDownsampler sampler;
+        size_t             kept = 0;
+        for (const auto& v : path) {
+            kept += sampler(v);
+        }
+        keep(kept);
+    });
+
+    // All the bodies at once, as the serializer runs them
+    const size_t bodies = 1000, batch_steps = 64;
+    const auto   pos = orbit_samples(bodies, batch_steps);
+
+    std::vector<v3d_vec_t> step_pos(batch_steps);
+    for (size_t s = 0; s < batch_steps; s++) {
+        step_pos[s].assign(
+            pos.begin() + s * bodies, pos.begin() + (s + 1) * bodies);
+    }
+    std::vector<size_t> index(bodies), accepted;
+    for (size_t b = 0; b < bodies; b++) {
+        index[b] = b;
+    }
+
+    for (auto level : simd_levels()) {
+        set_simd_level(level);
+        bench.run(
+            std::string("batch_downsampler/") + simd_level_name(level),
+            "sample",
+            bodies * batch_steps,
+            [&]() {
+                BatchDownsampler batch;
+                for (size_t b = 0; b < bodies; b++) {
+                    batch.add(FractalDownsampler());
+                }
+                size_t kept = 0;
+                for (const auto& p : step_pos) {
+                    batch(p, index, accepted);
+                    kept += accepted.size();
+                }
+                keep(kept);
+            },
+            { { "bodies", bodies } });
+    }
+    set_simd_level(supported_simd_level());
+}
+
+}
@@ -0,0 +1,38 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+SimpleBuffer, on its own as it can't share a file with ThreadedBuffer
+*/
+
+#include <memory>
+
+#include "bench.hpp"
+#include "simplebuffer.hpp"
+#include "v3d.hpp"
+
+namespace groho {
+
+void bench_simple_buffer(Bench& bench)
+{
+    if (!bench.wanted("simple_buffer")) {
+        return;
+    }
+
+    const size_t n    = 1 << 18;
+    const auto   path = bench.scratch_dir() / "simplebuffer.bin";
+    const V3d    v    = { 1, 2, 3, 4 };
+    bench.run(
+        "simple_buffer",
+        "sample",
+        n,
+        [&]() {
+            auto buffer = std::make_unique<SimpleBuffer<V3d>>(path);
+            for (size_t i = 0; i < n; i++) {
+                buffer->write(v);
+            }
+        },
+        { { "bytes_per_op", sizeof(V3d) } });
+}
+
+}
@@ -0,0 +1,59 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+A whole simulation, from reading the scenario to the last sample on disk
+*/
+
+#include <fstream>
+
+#include "bench.hpp"
+#include "simulator.hpp"
+
+namespace groho {
+
+void bench_simulation(Bench& bench, const fs::path& kernel)
+{
+    if (!bench.wanted("simulation")) {
+        return;
+    }
+
+    // Two weeks of a small fleet about the Earth, Moon and Mars, some of them
+    // burning
+    const size_t craft = 8, days = 14, dt = 60;
+    const auto   scn   = bench.scratch_dir() / "bench.groho.txt";
+    const auto   out   = bench.scratch_dir() / "simulation";
+    {
+        const char*   centers[] = { "399", "301", "499" };
+        std::ofstream file(scn);
+        file << "start 2020.01.01:0.5\n"
+             << "end 2020.01." << 1 + days << ":0.5\n"
+             << "dt " << dt << "\n"
+             << "spk " << kernel.string() << "\n";
+        for (size_t i = 0; i < craft; i++) {
+            const char* center = centers[i % 3];
+            file << "\nplan Craft" << i << "\n"
+                 << "orbiting " << center << " " << 500 + 7 * i << "x"
+                 << 400 + 5 * i << "\n";
+            if (i % 2 == 0) {
+                file << "2020.01.0" << 2 + i / 2 << ":0.5 600 burn center:"
+                     << center << " acc:0.1\n";
+            }
+        }
+    }
+
+    bench.run(
+        "simulation",
+        "step",
+        days * 86400 / dt,
+        [&]() {
+            // From scratch each time, with nothing to pick up from
+            std::error_code ec;
+            fs::remove_all(out, ec);
+            Simulator simulator(scn, out, true);
+            simulator.wait_until_done();
+        },
+        { { "craft", craft }, { "days", days }, { "dt", dt } });
+}
+
+}
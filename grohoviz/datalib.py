@@ -1,6 +1,7 @@
 """Code for loading trajectory data and rotating, interpolating and translating it"""
 import pathlib
 import glob
+import socket
 from typing import List, Dict
 
 import numpy as np
@@ -118,14 +119,228 @@ class Trajectories:
         return self._splrep[_id]
 
 
-def load_data(folder: pathlib.Path):
-    dtype = np.dtype([("x", "f8"), ("y", "f8"), ("z", "f8"), ("t", "f8")])
+# Trajectory file layout, see src/sampling/trajectoryfile.hpp
+TRAJECTORY_VERSION = 1
+_file_header = np.dtype(
+    [
+        ("magic", "S8"),
+        ("version", "=u4"),
+        ("code", "=i4"),
+        ("chunk_samples", "=u8"),
+        ("reserved", "=u8"),
+    ]
+)
+_chunk_header = np.dtype(
+    [("tag", "S8"), ("n", "=u8"), ("t_begin", "=f8"), ("t_end", "=f8")]
+)
+_index_header = np.dtype([("tag", "S8"), ("n_chunks", "=u8")])
+_index_entry = np.dtype(
+    [("offset", "=u8"), ("n", "=u8"), ("t_begin", "=f8"), ("t_end", "=f8")]
+)
+_file_footer = np.dtype([("index_offset", "=u8"), ("magic", "S8")])
+
+
+def read_index(data: np.ndarray):
+    """Chunks of a trajectory file (as bytes) from its index or, if the file is
+    still being written, by walking the chunk headers"""
+    header = np.frombuffer(data, dtype=_file_header, count=1)[0]
+    if header["magic"] != b"GROHOTR" or header["version"] != TRAJECTORY_VERSION:
+        raise RuntimeError("Not a trajectory file we know how to read")
+
+    size = data.size
+    if size >= _file_header.itemsize + _file_footer.itemsize:
+        footer = np.frombuffer(
+            data, dtype=_file_footer, count=1, offset=size - _file_footer.itemsize
+        )[0]
+        offset = int(footer["index_offset"])
+        if footer["magic"] == b"GROHOIX" and offset < size:
+            index_header = np.frombuffer(
+                data, dtype=_index_header, count=1, offset=offset
+            )[0]
+            n = int(index_header["n_chunks"])
+            if (
+                index_header["tag"] == b"INDEX"
+                and offset
+                + _index_header.itemsize
+                + n * _index_entry.itemsize
+                + _file_footer.itemsize
+                == size
+            ):
+                return np.frombuffer(
+                    data,
+                    dtype=_index_entry,
+                    count=n,
+                    offset=offset + _index_header.itemsize,
+                )
+
+    entries = []
+    offset = _file_header.itemsize
+    while offset + _chunk_header.itemsize <= size:
+        chunk = np.frombuffer(data, dtype=_chunk_header, count=1, offset=offset)[0]
+        n = int(chunk["n"])
+        end = offset + _chunk_header.itemsize + 4 * 8 * n
+        if chunk["tag"] != b"CHUNK" or end > size:
+            break
+        entries.append((offset, n, chunk["t_begin"], chunk["t_end"]))
+        offset = end
+    return np.array(entries, dtype=_index_entry)
+
+
+def read_trajectory(fname, t_range=None):
+    """t, x, y, z of the chunks of a trajectory file that overlap t_range. The
+    columns are views into the memory mapped file where possible"""
+    data = np.memmap(fname, dtype=np.uint8, mode="r")
+    index = read_index(data)
+    if t_range is not None:
+        index = index[(index["t_end"] >= t_range[0]) & (index["t_begin"] <= t_range[1])]
+
+    columns = [[], [], [], []]
+    for entry in index:
+        n = int(entry["n"])
+        start = int(entry["offset"]) + _chunk_header.itemsize
+        for c in range(4):
+            columns[c].append(
+                np.frombuffer(data, dtype=np.float64, count=n, offset=start + c * 8 * n)
+            )
+    if len(index) == 1:
+        return tuple(c[0] for c in columns)
+    return tuple(
+        np.concatenate(c) if c else np.empty(0, dtype=np.float64) for c in columns
+    )
+
+
+# Chebyshev trajectory file layout, see src/sampling/chebyshevfile.hpp
+CHEBYSHEV_VERSION = 1
+_chebyshev_header = np.dtype(
+    [
+        ("magic", "S8"),
+        ("version", "=u4"),
+        ("code", "=i4"),
+        ("n_coeff", "=u8"),
+        ("tolerance", "=f8"),
+    ]
+)
+
+
+def read_chebyshev(fname):
+    """Records of a Chebyshev trajectory file, one per row, as
+    t_mid, t_half, X[n_coeff], Y[n_coeff], Z[n_coeff]"""
+    data = np.memmap(fname, dtype=np.uint8, mode="r")
+    header = np.frombuffer(data, dtype=_chebyshev_header, count=1)[0]
+    if header["magic"] != b"GROHOCB" or header["version"] != CHEBYSHEV_VERSION:
+        raise RuntimeError("Not a Chebyshev trajectory file we know how to read")
+    width = 2 + 3 * int(header["n_coeff"])
+    n = (data.size - _chebyshev_header.itemsize) // (8 * width)
+    return np.frombuffer(
+        data, dtype=np.float64, count=n * width, offset=_chebyshev_header.itemsize
+    ).reshape(n, width)
+
+
+def eval_chebyshev(records, t):
+    """x, y, z at times t, which have to lie in the span of the records"""
+    t = np.asarray(t, dtype=np.float64)
+    n_coeff = (records.shape[1] - 2) // 3
+    idx = np.searchsorted(records[:, 0] - records[:, 1], t, side="right") - 1
+    rec = records[np.clip(idx, 0, len(records) - 1)]
+    half = rec[:, 1]
+    x = np.divide(t - rec[:, 0], half, out=np.zeros_like(t), where=half > 0)
+
+    T = np.empty((t.size, n_coeff))
+    T[:, 0] = 1.0
+    if n_coeff > 1:
+        T[:, 1] = x
+    for k in range(2, n_coeff):
+        T[:, k] = 2 * x * T[:, k - 1] - T[:, k - 2]
+    return tuple(
+        np.einsum("ij,ij->i", rec[:, 2 + a * n_coeff : 2 + (a + 1) * n_coeff], T)
+        for a in range(3)
+    )
+
+
+def sample_chebyshev(fname, t_range=None, per_record=32):
+    """t, x, y, z at evenly spaced times in each record that overlaps t_range"""
+    records = read_chebyshev(fname)
+    begin, end = records[:, 0] - records[:, 1], records[:, 0] + records[:, 1]
+    if t_range is not None:
+        records = records[(end >= t_range[0]) & (begin <= t_range[1])]
+        begin, end = records[:, 0] - records[:, 1], records[:, 0] + records[:, 1]
+    if not len(records):
+        return tuple(np.empty(0, dtype=np.float64) for _ in range(4))
+
+    # Each record's last point is the next one's first
+    f = np.linspace(0, 1, per_record, endpoint=False)
+    t = (begin[:, None] + (end - begin)[:, None] * f[None, :]).ravel()
+    t = np.append(t, end[-1])
+    return (t,) + eval_chebyshev(records, t)
+
+
+def is_chebyshev(fname):
+    with open(fname, "rb") as f:
+        return f.read(8) == b"GROHOCB\0"
+
+
+# Live sample stream, see src/sampling/samplestream.hpp
+STREAM_RUN, STREAM_SAMPLES = 1, 2
+_stream_header = np.dtype(
+    [
+        ("magic", "S4"),
+        ("type", "=u4"),
+        ("seq", "=u8"),
+        ("n", "=u8"),
+        ("begin", "=f8"),
+        ("end", "=f8"),
+    ]
+)
+_stream_sample = np.dtype(
+    [("code", "=i8"), ("t", "=f8"), ("x", "=f8"), ("y", "=f8"), ("z", "=f8")]
+)
+
+
+def _recv_exactly(sock, n):
+    buf = bytearray(n)
+    view = memoryview(buf)
+    while n:
+        got = sock.recv_into(view[-n:], n)
+        if not got:
+            raise EOFError
+        n -= got
+    return bytes(buf)
+
+
+def stream_samples(socket_path):
+    """Yield (header, samples) for each message published by `groho sim
+    --stream socket_path` until the simulator goes away. A gap in
+    header["seq"] means messages were missed"""
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(str(socket_path))
+        try:
+            while True:
+                header = np.frombuffer(
+                    _recv_exactly(sock, _stream_header.itemsize), _stream_header
+                )[0]
+                if header["magic"] != b"GRS":
+                    raise RuntimeError("Not a groho sample stream")
+                n = int(header["n"])
+                samples = np.frombuffer(
+                    _recv_exactly(sock, n * _stream_sample.itemsize), _stream_sample
+                )
+                yield header, samples
+        except EOFError:
+            return
+
+
+def load_data(folder: pathlib.Path, t_range=None):
     trajectories = Trajectories()
     for f in glob.glob(str(folder / "pos*.bin")):
         naif = int(pathlib.Path(f).name[3:-4])
-        x = np.fromfile(f, dtype=dtype)
-        trajectories._t_range = (x["t"][0], x["t"][-1])
-        if x.size:
-            s = rot.apply(x.view(np.float64).reshape(x.shape + (-1,))[:, :3])
-            trajectories.set(naif, PathT(x=s[:, 0], y=s[:, 1], z=s[:, 2], t=x["t"]))
+        if pathlib.Path(f).stat().st_size == 0:
+            continue
+        if is_chebyshev(f):
+            t, x, y, z = sample_chebyshev(f, t_range)
+        else:
+            t, x, y, z = read_trajectory(f, t_range)
+        if t.size:
+            trajectories._t_range = (t[0], t[-1])
+            s = rot.apply(np.stack((x, y, z), axis=1))
+            trajectories.set(naif, PathT(x=s[:, 0], y=s[:, 1], z=s[:, 2], t=t))
     return trajectories
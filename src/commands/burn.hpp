@@ -31,9 +31,8 @@ struct Burn : public Command {
 )";
     }
 
-    Burn(const CommandToken& token, const State& state, size_t self_idx)
+    Burn(const CommandToken& token, const State& state)
         : Command(token)
-        , self_idx(self_idx)
     {
         auto params = Parameters(token.params);
 
@@ -44,13 +43,17 @@ struct Burn : public Command {
         pitch   = std::stod(params.get("pitch", "0"));
     }
 
-    V3d execute(const State& state)
+    // The target's velocity is taken at the end of the current step
+    V3d execute(
+        const State&     state,
+        const V3d&       pos,
+        const V3d&       vel,
+        const v3d_vec_t& bodies) const
     {
-        R = state.spacecraft.pos[self_idx] - state.orrery.pos(target_idx);
-        X = (state.spacecraft.vel[self_idx] - state.orrery.vel(target_idx))
-                .normed();
-        Y = cross(R, X).normed();
-        Z = cross(X, Y).normed();
+        V3d R = pos - bodies[target_idx];
+        V3d X = (vel - state.orrery.vel(target_idx)).normed();
+        V3d Y = cross(R, X).normed();
+        V3d Z = cross(X, Y).normed();
         // Now we have a coordinate frame
 
         return (X * cos(pitch) * cos(yaw) + Y * cos(pitch) * sin(yaw)
@@ -60,12 +63,9 @@ struct Burn : public Command {
 
 private:
     double acc_val;
-    size_t self_idx;
     size_t target_idx;
     double yaw;
     double pitch;
-
-    V3d R, X, Y, Z;
 };
 
 }
\ No newline at end of file
@@ -6,6 +6,8 @@ A base struct, function signatures and some utility functions for spacecraft
 commands.
 */
 
+#include <limits>
+
 #include "commands.hpp"
 #include "burn.hpp"
 
@@ -19,10 +21,11 @@ void list_all_commands()
 
 Plan::Plan(
     const SpacecraftToken& plan_token, const State& state, size_t self_idx)
+    : self_idx(self_idx)
 {
     for (const auto& cmd_token : plan_token.command_tokens) {
         if (cmd_token.command == "burn") {
-            commands.emplace_back(new Burn(cmd_token, state, self_idx));
+            commands.emplace_back(new Burn(cmd_token, state));
         }
     }
 }
@@ -39,7 +42,51 @@ void Plan::execute(const State& state, V3d& acc)
     }
 
     if (commands[command_idx]->ready(state.t)) {
-        acc += commands[command_idx]->execute(state);
+        acc += commands[command_idx]->execute(
+            state,
+            state.spacecraft.pos[self_idx],
+            state.spacecraft.vel[self_idx],
+            state.orrery.pos());
+    }
+}
+
+V3d Plan::thrust(
+    const State&     state,
+    J2000_s          t,
+    const V3d&       pos,
+    const V3d&       vel,
+    const v3d_vec_t& bodies) const
+{
+    // Commands don't overlap, so at most one is running
+    for (size_t i = command_idx; i < commands.size(); i++) {
+        if (!commands[i]->ready(t)) {
+            break;
+        }
+        if (!commands[i]->expired(t)) {
+            return commands[i]->execute(state, pos, vel, bodies);
+        }
+    }
+    return {};
+}
+
+J2000_s Plan::next_event(J2000_s t) const
+{
+    for (size_t i = command_idx; i < commands.size(); i++) {
+        if (commands[i]->start > t) {
+            return commands[i]->start;
+        }
+        if (commands[i]->end > t) {
+            return commands[i]->end;
+        }
+    }
+    return std::numeric_limits<double>::infinity();
+}
+
+void Plan::advance(J2000_s t)
+{
+    while ((command_idx < commands.size())
+           && commands[command_idx]->expired(t)) {
+        command_idx++;
     }
 }
 
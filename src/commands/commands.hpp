@@ -28,9 +28,17 @@ struct Command {
 
     static std::string usage();
 
-    bool        ready(J2000_s t) { return start < t; }
-    bool        expired(J2000_s t) { return end < t; }
-    virtual V3d execute(const State&) = 0;
+    bool ready(J2000_s t) const { return start < t; }
+    bool expired(J2000_s t) const { return end < t; }
+
+    // Thrust on a craft at pos, moving at vel, with the orrery bodies at
+    // bodies. These need not be the positions in state, e.g. when the adaptive
+    // integrator is part way through a step
+    virtual V3d execute(
+        const State&     state,
+        const V3d&       pos,
+        const V3d&       vel,
+        const v3d_vec_t& bodies) const = 0;
 
     J2000_s start;
     J2000_s end;
@@ -44,9 +52,27 @@ public:
         const SpacecraftToken& plan_token, const State& state, size_t self_idx);
     void execute(const State&, V3d& acc);
 
+    // For the adaptive integrator, which tries out steps before taking them:
+    // the thrust at time t (leaving the plan as it is), the next time after t
+    // that a command starts or ends (infinity if none) and moving on past the
+    // commands that are over by time t
+    V3d thrust(
+        const State&     state,
+        J2000_s          t,
+        const V3d&       pos,
+        const V3d&       vel,
+        const v3d_vec_t& bodies) const;
+    J2000_s next_event(J2000_s t) const;
+    void    advance(J2000_s t);
+
+    // Index of the command we are on, so a plan can be picked up part way
+    size_t progress() const { return command_idx; }
+    void   resume(size_t idx) { command_idx = idx; }
+
 private:
     std::vector<std::unique_ptr<Command>> commands;
 
+    size_t self_idx;
     size_t command_idx = 0;
 };
 
@@ -10,6 +10,9 @@ Copyright (c) 2017-2018 by Kaushik Ghose. Some rights reserved, see LICENSE
 #include "bodyconstant.hpp"
 #include "commands.hpp"
 #include "entrypoints.hpp"
+#include "inputfile.hpp"
+#include "orrerypack.hpp"
+#include "scenario.hpp"
 #include "simulator.hpp"
 #include "spk.hpp"
 #include "units.hpp"
@@ -23,9 +26,14 @@ namespace groho {
 volatile sig_atomic_t keep_running = true;
 
 void simulate(
-    std::string scn_file, std::string sim_folder, bool non_interactive)
+    std::string scn_file,
+    std::string sim_folder,
+    bool        non_interactive,
+    size_t      threads,
+    std::string stream_path)
 {
-    auto simulator = Simulator(scn_file, sim_folder, non_interactive);
+    auto simulator = Simulator(
+        scn_file, sim_folder, non_interactive, threads, stream_path);
     if (non_interactive) {
         simulator.wait_until_done();
         return;
@@ -60,4 +68,19 @@ void inspect(std::string kernel_file)
     }
 }
 
+void pack_orrery(std::string scn_file, std::string pack_file)
+{
+    auto lines = load_input_file(scn_file);
+    if (!lines) {
+        return;
+    }
+
+    auto scenario = Scenario(*lines);
+    write_orrery_pack(
+        pack_file,
+        scenario.sim.begin,
+        scenario.sim.end,
+        scenario.kernel_tokens);
+}
+
 }
\ No newline at end of file
@@ -8,8 +8,14 @@ Copyright (c) 2017-2020 by Kaushik Ghose. Some rights reserved, see LICENSE
 
 namespace groho {
 
-void simulate(std::string scn_file, std::string sim_folder, bool);
+void simulate(
+    std::string scn_file,
+    std::string sim_folder,
+    bool,
+    size_t      threads,
+    std::string stream_path);
 void list_commands();
 void inspect(std::string kernel_file);
+void pack_orrery(std::string scn_file, std::string pack_file);
 
 }
@@ -0,0 +1,221 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <algorithm>
+#include <cstring> // gcc needs this for strerror
+#include <fstream>
+#include <iomanip>
+
+#include "profile.hpp"
+
+#define LOGURU_WITH_STREAMS 1
+#include "loguru.hpp"
+
+namespace groho {
+
+const char* profile_phase_name(ProfilePhase phase)
+{
+    switch (phase) {
+    case KERNEL_LOAD:
+        return "kernel_load";
+    case ORRERY:
+        return "orrery";
+    case GRAVITY:
+        return "gravity";
+    case PLANS:
+        return "plans";
+    case INTEGRATION:
+        return "integration";
+    case SERIALIZATION:
+        return "serialization";
+    default:
+        return "unknown";
+    }
+}
+
+Profile& profile()
+{
+    static Profile p;
+    return p;
+}
+
+#ifndef GROHO_NO_PROFILE
+
+size_t Profile::bin_of(uint64_t ns)
+{
+    if (ns < 4) {
+        return ns;
+    }
+    // The octave, then the two bits below the leading one
+    int e = 63 - __builtin_clzll(ns);
+    return 4 * (e - 1) + ((ns >> (e - 2)) & 3);
+}
+
+uint64_t Profile::bin_lower(size_t bin)
+{
+    if (bin < 4) {
+        return bin;
+    }
+    return uint64_t(4 + bin % 4) << (bin / 4 - 1);
+}
+
+void Profile::reset()
+{
+    for (size_t i = 0; i < N_PROFILE_PHASES; i++) {
+        total_ns[i] = 0;
+        calls[i]    = 0;
+    }
+    weight_ = 1;
+    started = clock::now();
+    in_step = false;
+    step_bins.fill(0);
+    steps    = 0;
+    step_ns  = 0;
+    step_max = 0;
+}
+
+void Profile::begin_step(size_t step)
+{
+    // The end of one step is the start of the next
+    auto now = clock::now();
+    if (in_step) {
+        add_step(now - step_started);
+    }
+    step_started = now;
+    in_step      = true;
+    weight_      = (step % sample_every == 0) ? sample_every : 0;
+}
+
+void Profile::end_steps()
+{
+    if (in_step) {
+        add_step(clock::now() - step_started);
+    }
+    in_step = false;
+    weight_ = 1;
+}
+
+void Profile::add(ProfilePhase phase, clock::duration d, size_t n)
+{
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    total_ns[phase].fetch_add(ns, std::memory_order_relaxed);
+    calls[phase].fetch_add(n, std::memory_order_relaxed);
+}
+
+void Profile::add_step(clock::duration d)
+{
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    step_bins[bin_of(ns)]++;
+    steps++;
+    step_ns += ns;
+    step_max = std::max<int64_t>(step_max, ns);
+}
+
+bool Profile::write(const fs::path& path) const
+{
+    std::ofstream file(path, std::ios::out);
+    if (file.fail()) {
+        LOG_S(ERROR) << std::strerror(errno);
+        LOG_S(ERROR) << "Could not write profile " << path;
+        return false;
+    }
+
+    double run = std::chrono::duration<double>(clock::now() - started).count();
+    file << std::setprecision(6);
+    file << "{\n";
+    file << "  \"run_s\": " << run << ",\n";
+    file << "  \"steps\": " << steps << ",\n";
+    file << "  \"sample_every\": " << sample_every << ",\n";
+
+    // The phases of the loop are estimated from the steps we timed, and the
+    // craft phases are summed over the threads
+    file << "  \"phases\": {";
+    for (size_t i = 0; i < N_PROFILE_PHASES; i++) {
+        double total = total_ns[i] * 1e-9;
+        file << (i ? ",\n" : "\n") << "    \""
+             << profile_phase_name(ProfilePhase(i)) << "\": { "
+             << "\"total_s\": " << total << ", "
+             << "\"calls\": " << calls[i] << ", "
+             << "\"fraction_of_run\": " << (run > 0 ? total / run : 0) << " }";
+    }
+    file << "\n  },\n";
+
+    // Quantiles are the upper edges of the bins they fall in
+    auto quantile = [this](double q) {
+        uint64_t seen = 0;
+        for (size_t b = 0; b + 1 < n_bins; b++) {
+            seen += step_bins[b];
+            if (seen > 0 && seen >= q * steps) {
+                return bin_lower(b + 1);
+            }
+        }
+        return uint64_t(0);
+    };
+
+    file << "  \"step_latency\": {\n";
+    file << "    \"mean_ns\": " << (steps ? double(step_ns) / steps : 0)
+         << ",\n";
+    file << "    \"p50_ns\": " << quantile(0.5) << ",\n";
+    file << "    \"p90_ns\": " << quantile(0.9) << ",\n";
+    file << "    \"p99_ns\": " << quantile(0.99) << ",\n";
+    file << "    \"max_ns\": " << step_max << ",\n";
+    file << "    \"bins\": [";
+    bool first = true;
+    for (size_t b = 0; b + 1 < n_bins; b++) {
+        if (step_bins[b] == 0) {
+            continue;
+        }
+        file << (first ? "\n" : ",\n") << "      { \"lo_ns\": " << bin_lower(b)
+             << ", \"hi_ns\": " << bin_lower(b + 1)
+             << ", \"count\": " << step_bins[b] << " }";
+        first = false;
+    }
+    file << "\n    ]\n";
+    file << "  }\n";
+    file << "}\n";
+
+    if (!file) {
+        LOG_S(ERROR) << "Error writing " << path;
+        return false;
+    }
+    return true;
+}
+
+ProfileScope::ProfileScope(ProfilePhase phase)
+    : phase(phase)
+    , weight(profile().weight())
+{
+    if (weight > 0) {
+        start = Profile::clock::now();
+    }
+}
+
+ProfileScope::~ProfileScope()
+{
+    if (weight > 0) {
+        profile().add(phase, (Profile::clock::now() - start) * weight, weight);
+    }
+}
+
+ProfileLap::ProfileLap()
+    : weight(profile().weight())
+{
+    if (weight > 0) {
+        last = Profile::clock::now();
+    }
+}
+
+ProfileLap::~ProfileLap()
+{
+    for (size_t i = 0; i < N_PROFILE_PHASES; i++) {
+        if (laps[i] > 0) {
+            profile().add(ProfilePhase(i), total[i] * weight, laps[i] * weight);
+        }
+    }
+}
+
+#endif
+
+}
@@ -0,0 +1,161 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Where the time of a simulation goes.
+
+The simulator times each phase of its loop (loading the kernels, evaluating the
+orrery, gravity, executing the plans, integrating and writing the samples out)
+and the latency of each step, and writes them to profile.json next to the
+manifest. The phases that run on the craft threads are added up over the
+threads, so they can come to more than the run took.
+
+A step can take just a few us, not much more than a few dozen reads of the
+clock, so the phases of the loop are timed on one step in sample_every and
+counted that many times over. sample_every is a prime, so it doesn't fall in
+step with the orrery's blocks or the checkpoints. Step latencies cost one
+clock read a step and are kept for every step.
+
+A ProfileScope charges the time it is alive to a phase. A ProfileLap charges
+the time since its last lap, so a run of phases costs one clock read each.
+Laps are added up locally and handed in when the ProfileLap goes away, so the
+craft threads rarely touch the shared totals.
+
+Building with -DPROFILE=OFF (which defines GROHO_NO_PROFILE) leaves the timers
+empty and inline, so they cost nothing, and no profile is written.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+
+namespace groho {
+
+namespace fs = std::filesystem;
+
+enum ProfilePhase {
+    KERNEL_LOAD = 0,
+    ORRERY,
+    GRAVITY,
+    PLANS,
+    INTEGRATION,
+    SERIALIZATION,
+    N_PROFILE_PHASES
+};
+
+const char* profile_phase_name(ProfilePhase phase);
+
+#ifndef GROHO_NO_PROFILE
+
+class Profile {
+public:
+    typedef std::chrono::steady_clock clock;
+
+    static constexpr size_t sample_every = 17;
+
+    // Step latencies go into bins four to an octave, so a bin is no more than
+    // a quarter wider than its lower edge
+    static constexpr size_t n_bins = 256;
+    static size_t           bin_of(uint64_t ns);
+    static uint64_t         bin_lower(size_t bin);
+
+    // At the start of a run
+    void reset();
+
+    // The simulator thread, at the start of each step of the loop and once
+    // the loop is done
+    void begin_step(size_t step);
+    void end_steps();
+
+    // How many times over the time taken now counts: 0 if we are not timing
+    // this step. Any thread
+    size_t weight() const { return weight_.load(std::memory_order_relaxed); }
+
+    // Any thread
+    void add(ProfilePhase phase, clock::duration d, size_t calls);
+
+    // As JSON. The run is taken to have started at the last reset
+    bool write(const fs::path& path) const;
+
+private:
+    void add_step(clock::duration d);
+
+    std::array<std::atomic<int64_t>, N_PROFILE_PHASES>  total_ns = {};
+    std::array<std::atomic<uint64_t>, N_PROFILE_PHASES> calls    = {};
+    std::atomic<size_t>                                 weight_  = 1;
+
+    clock::time_point            started;
+    clock::time_point            step_started;
+    bool                         in_step   = false;
+    std::array<uint64_t, n_bins> step_bins = {};
+    uint64_t                     steps     = 0;
+    int64_t                      step_ns   = 0;
+    int64_t                      step_max  = 0;
+};
+
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfilePhase phase);
+    ~ProfileScope();
+
+private:
+    ProfilePhase               phase;
+    size_t                     weight;
+    Profile::clock::time_point start;
+};
+
+class ProfileLap {
+public:
+    ProfileLap();
+
+    // Charge the time since the last lap to this phase
+    void operator()(ProfilePhase phase)
+    {
+        if (weight == 0) {
+            return;
+        }
+        auto now = Profile::clock::now();
+        total[phase] += now - last;
+        laps[phase]++;
+        last = now;
+    }
+
+    ~ProfileLap();
+
+private:
+    size_t                                                 weight;
+    Profile::clock::time_point                             last;
+    std::array<Profile::clock::duration, N_PROFILE_PHASES> total = {};
+    std::array<size_t, N_PROFILE_PHASES>                   laps  = {};
+};
+
+#else
+
+class Profile {
+public:
+    void reset() {}
+    void begin_step(size_t) {}
+    void end_steps() {}
+    bool write(const fs::path&) const { return true; }
+};
+
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfilePhase) {}
+};
+
+class ProfileLap {
+public:
+    void operator()(ProfilePhase) {}
+};
+
+#endif
+
+// One simulation runs at a time, so there is one profile
+Profile& profile();
+
+}
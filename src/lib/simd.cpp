@@ -0,0 +1,60 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Run time selection of SIMD kernels.
+*/
+
+#include <atomic>
+
+#include "simd.hpp"
+
+namespace groho {
+
+static SimdLevel detect_simd_level()
+{
+#ifdef GROHO_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SimdLevel::SSE2;
+    }
+#endif
+    return SimdLevel::SCALAR;
+}
+
+SimdLevel supported_simd_level()
+{
+    static const SimdLevel supported = detect_simd_level();
+    return supported;
+}
+
+static std::atomic<SimdLevel>& current_simd_level()
+{
+    static std::atomic<SimdLevel> level(supported_simd_level());
+    return level;
+}
+
+SimdLevel simd_level() { return current_simd_level(); }
+
+void set_simd_level(SimdLevel level)
+{
+    current_simd_level()
+        = level <= supported_simd_level() ? level : supported_simd_level();
+}
+
+const char* simd_level_name(SimdLevel level)
+{
+    switch (level) {
+    case SimdLevel::AVX2:
+        return "AVX2";
+    case SimdLevel::SSE2:
+        return "SSE2";
+    default:
+        return "scalar";
+    }
+}
+
+}
@@ -0,0 +1,39 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Run time selection of SIMD kernels. The hot loops are compiled for several
+instruction sets and we pick the widest one the CPU supports when we start up.
+Building with -DSIMD=OFF (which defines GROHO_NO_SIMD) leaves just the scalar
+versions.
+*/
+
+#pragma once
+
+#if !defined(GROHO_NO_SIMD) && (defined(__x86_64__) || defined(__i386__))
+#define GROHO_X86_SIMD 1
+#endif
+
+#ifdef GROHO_X86_SIMD
+#define GROHO_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define GROHO_TARGET_AVX2
+#endif
+
+namespace groho {
+
+enum SimdLevel { SCALAR = 0, SSE2, AVX2 };
+
+// The best level this CPU (and build) supports
+SimdLevel supported_simd_level();
+
+// The level the kernels currently use. Defaults to supported_simd_level()
+SimdLevel simd_level();
+
+// Mainly for tests and benchmarks: force a lower level. Asking for a level
+// the CPU does not support gives the best supported level instead.
+void set_simd_level(SimdLevel level);
+
+const char* simd_level_name(SimdLevel level);
+
+}
@@ -17,11 +17,32 @@ namespace fs = std::filesystem;
 namespace groho {
 
 struct SimParams {
+    enum Integrator {
+        FIXED = 0,
+        ADAPTIVE,
+        BLOCK,
+        FOREST_RUTH,
+        YOSHIDA6,
+        RADAU,
+        ENCKE
+    };
+    enum Output { POINTS = 0, CHEBYSHEV };
+
     J2000_s begin;
     J2000_s end;
     double  dt = 60;
     double  rt = 1.00001;
     double  lt = 1e4;
+
+    Integrator integrator = FIXED;
+    double     tolerance  = 1e-3; // km per step, adaptive, block and radau
+
+    Output output           = POINTS;
+    double output_tolerance = 1e-3; // km, Chebyshev fits to the trajectories
+
+    // s. If set the orrery is written out at this cadence, every sample and
+    // straight from the ephemeris, instead of at each step
+    double orrery_dt = 0;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,120 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include "threadpool.hpp"
+
+namespace groho {
+
+// How long an idle thread keeps looking for work before it goes to sleep
+const size_t spin_count = 20000;
+
+ThreadPool::ThreadPool(size_t n_threads)
+{
+    if (n_threads == 0) {
+        n_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    for (size_t i = 0; i < n_threads; i++) {
+        queues.emplace_back(new Queue);
+    }
+    for (size_t i = 1; i < n_threads; i++) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    work_available.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(size_t n, size_t chunks)
+{
+    remaining = chunks;
+    for (size_t i = 0; i < chunks; i++) {
+        auto& queue = *queues[i % queues.size()];
+
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.chunks.push_back({ n * i / chunks, n * (i + 1) / chunks });
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+    }
+    work_available.notify_all();
+
+    work(0);
+
+    for (size_t i = 0; (i < spin_count) && (remaining > 0); i++) {
+        std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [this]() { return remaining == 0; });
+}
+
+bool ThreadPool::next_chunk(size_t self, Chunk& chunk)
+{
+    {
+        auto&                       own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.chunks.empty()) {
+            chunk = own.chunks.front();
+            own.chunks.pop_front();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues.size(); i++) {
+        auto&                       other = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.chunks.empty()) {
+            chunk = other.chunks.back();
+            other.chunks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::work(size_t self)
+{
+    Chunk chunk;
+    while (next_chunk(self, chunk)) {
+        job(chunk.begin, chunk.end);
+        if (--remaining == 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            work_done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::worker_loop(size_t self)
+{
+    size_t seen = 0;
+    while (!stop) {
+        work(self);
+
+        for (size_t i = 0; (i < spin_count) && (generation == seen) && !stop;
+             i++) {
+            std::this_thread::yield();
+        }
+        if (generation == seen) {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_available.wait(
+                lock, [this, seen]() { return stop || (generation != seen); });
+        }
+        seen = generation;
+    }
+}
+
+}
@@ -0,0 +1,84 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+A small work stealing thread pool for data parallel loops.
+
+parallel_for cuts a range into chunks and deals them out to per thread queues.
+Each thread works through its own queue from the front and, when that runs
+dry, steals from the back of the others, so uneven chunks even out. The
+calling thread joins in and parallel_for returns once every chunk is done.
+
+The loop is run once per simulation step, so idle workers spin for a little
+while before going to sleep, to be ready for the next one.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace groho {
+
+class ThreadPool {
+public:
+    // n_threads counts the calling thread. 0 means one thread per core
+    explicit ThreadPool(size_t n_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return queues.size(); }
+
+    // Call f(begin, end) on chunks of at least `grain` items that together
+    // cover [0, n). Chunks run concurrently, so f must only touch what belongs
+    // to the items it is given
+    template <typename F> void parallel_for(size_t n, size_t grain, F&& f)
+    {
+        size_t chunks = std::min(4 * size(), n / std::max(grain, size_t(1)));
+        if (chunks <= 1) {
+            f(size_t(0), n);
+            return;
+        }
+        job = std::forward<F>(f);
+        run(n, chunks);
+        job = nullptr;
+    }
+
+private:
+    struct Chunk {
+        size_t begin, end;
+    };
+
+    struct Queue {
+        std::mutex        mutex;
+        std::deque<Chunk> chunks;
+    };
+
+    void run(size_t n, size_t chunks);
+    bool next_chunk(size_t self, Chunk& chunk);
+    void work(size_t self);
+    void worker_loop(size_t self);
+
+    std::function<void(size_t, size_t)> job;
+
+    std::vector<std::unique_ptr<Queue>> queues; // queues[0] is the caller's
+    std::vector<std::thread>            workers;
+
+    std::atomic<size_t> remaining  = 0; // chunks not yet finished
+    std::atomic<size_t> generation = 0; // bumped for each parallel_for
+    std::atomic<bool>   stop       = false;
+
+    std::mutex              mutex;
+    std::condition_variable work_available, work_done;
+};
+
+}
@@ -10,6 +10,7 @@ without having to have knowledge of the objects they represent
 #pragma once
 
 #include <filesystem>
+#include <optional>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -48,6 +49,8 @@ struct SpacecraftToken {
     CommandTokens command_tokens;
 
     Line* line_p;
+
+    std::optional<double> tolerance{}; // overrides SimParams::tolerance
 };
 
 typedef std::vector<SpacecraftToken> SpacecraftTokens;
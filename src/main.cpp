@@ -27,8 +27,9 @@ int main(int argc, char* argv[])
     CLI::App app{ "Groho: A simulator for inter-planetary travel" };
     app.require_subcommand(1);
 
-    std::string scn_file, sim_folder, kernel_file;
+    std::string scn_file, sim_folder, kernel_file, pack_file, stream_path;
     bool        non_interactive;
+    size_t      threads = 0;
 
     auto loop = app.add_subcommand(
         "sim",
@@ -40,8 +41,18 @@ int main(int argc, char* argv[])
         "--non-interactive",
         non_interactive,
         "Run simulation and exit, instead of looping.");
-    loop->callback(
-        [&]() { groho::simulate(scn_file, sim_folder, non_interactive); });
+    loop->add_option(
+        "--threads",
+        threads,
+        "Threads to integrate spacecraft on. 0 (default) uses every core.");
+    loop->add_option(
+        "--stream",
+        stream_path,
+        "Also publish samples, as they are taken, on a Unix socket here");
+    loop->callback([&]() {
+        groho::simulate(
+            scn_file, sim_folder, non_interactive, threads, stream_path);
+    });
 
     auto commands = app.add_subcommand(
         "commands", "Describe spacecraft commands available");
@@ -51,6 +62,16 @@ int main(int argc, char* argv[])
     inspect->add_option("spk", kernel_file, "Kernel file")->required();
     inspect->callback([&]() { groho::inspect(kernel_file); });
 
+    auto orrery = app.add_subcommand("orrery", "Orrery tools");
+    orrery->require_subcommand(1);
+    auto pack = orrery->add_subcommand(
+        "pack",
+        "Write just the ephemeris a scenario needs to a pack file,\n"
+        "to use in place of its kernels");
+    pack->add_option("simfile", scn_file, "Scenario file")->required();
+    pack->add_option("packfile", pack_file, "Pack file")->required();
+    pack->callback([&]() { groho::pack_orrery(scn_file, pack_file); });
+
     CLI11_PARSE(app, argc, argv);
 
     return 0;
@@ -0,0 +1,343 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Evaluation of the Chebyshev series that make up an SPK element record.
+*/
+
+#include <vector>
+
+#include "chebyshev.hpp"
+#include "simd.hpp"
+
+#ifdef GROHO_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace groho {
+
+// T_0(x) ... T_n-1(x)
+static void cheby_polynomials(double x, size_t n, double* T)
+{
+    double x2 = 2 * x;
+    T[0]      = 1.0;
+    T[1]      = x;
+    for (size_t k = 2; k < n; k++) {
+        T[k] = x2 * T[k - 1] - T[k - 2];
+    }
+}
+
+// T_k(x), T'_k(x) and, if ddT is not null, T''_k(x)
+static void
+cheby_derivatives(double x, size_t n, double* T, double* dT, double* ddT)
+{
+    cheby_polynomials(x, n, T);
+
+    double x2 = 2 * x;
+    dT[0]     = 0.0;
+    dT[1]     = 1.0;
+    for (size_t k = 2; k < n; k++) {
+        dT[k] = 2 * T[k - 1] + x2 * dT[k - 1] - dT[k - 2];
+    }
+
+    if (ddT) {
+        ddT[0] = 0.0;
+        ddT[1] = 0.0;
+        for (size_t k = 2; k < n; k++) {
+            ddT[k] = 4 * dT[k - 1] + x2 * ddT[k - 1] - ddT[k - 2];
+        }
+    }
+}
+
+// The dot products of the X, Y and Z coefficients with T. The SIMD versions
+// put the axes in the lanes, so each axis is summed in the same order as the
+// scalar loop and the results are identical
+
+static void cheby_dot_xyz_scalar(
+    const double* A, size_t n, const double* T, double* xyz)
+{
+    const double* Ax = A;
+    const double* Ay = A + n;
+    const double* Az = A + 2 * n;
+
+    // Same order of operations as cheby_eval_one, so the results are identical
+    double bx = Ax[0] * T[0] + Ax[1] * T[1];
+    double by = Ay[0] * T[0] + Ay[1] * T[1];
+    double bz = Az[0] * T[0] + Az[1] * T[1];
+    for (size_t k = 2; k < n; k++) {
+        bx += T[k] * Ax[k];
+        by += T[k] * Ay[k];
+        bz += T[k] * Az[k];
+    }
+    xyz[0] = bx;
+    xyz[1] = by;
+    xyz[2] = bz;
+}
+
+#ifdef GROHO_X86_SIMD
+
+// x and y in the lanes, z on its own
+static void cheby_dot_xyz_sse2(
+    const double* A, size_t n, const double* T, double* xyz)
+{
+    const double* Ax = A;
+    const double* Ay = A + n;
+    const double* Az = A + 2 * n;
+
+    __m128d bxy = _mm_add_pd(
+        _mm_mul_pd(_mm_set_pd(Ay[0], Ax[0]), _mm_set1_pd(T[0])),
+        _mm_mul_pd(_mm_set_pd(Ay[1], Ax[1]), _mm_set1_pd(T[1])));
+    double bz = Az[0] * T[0] + Az[1] * T[1];
+    for (size_t k = 2; k < n; k++) {
+        bxy = _mm_add_pd(
+            bxy, _mm_mul_pd(_mm_set1_pd(T[k]), _mm_set_pd(Ay[k], Ax[k])));
+        bz += T[k] * Az[k];
+    }
+
+    alignas(16) double sxy[2];
+    _mm_store_pd(sxy, bxy);
+    xyz[0] = sxy[0];
+    xyz[1] = sxy[1];
+    xyz[2] = bz;
+}
+
+// x, y and z in three of the four lanes
+GROHO_TARGET_AVX2
+static void cheby_dot_xyz_avx2(
+    const double* A, size_t n, const double* T, double* xyz)
+{
+    const double* Ax = A;
+    const double* Ay = A + n;
+    const double* Az = A + 2 * n;
+
+    __m256d b = _mm256_add_pd(
+        _mm256_mul_pd(
+            _mm256_set_pd(0, Az[0], Ay[0], Ax[0]), _mm256_set1_pd(T[0])),
+        _mm256_mul_pd(
+            _mm256_set_pd(0, Az[1], Ay[1], Ax[1]), _mm256_set1_pd(T[1])));
+    for (size_t k = 2; k < n; k++) {
+        __m256d c = _mm256_set_pd(0, Az[k], Ay[k], Ax[k]);
+        b         = _mm256_add_pd(b, _mm256_mul_pd(_mm256_set1_pd(T[k]), c));
+    }
+
+    alignas(32) double s[4];
+    _mm256_store_pd(s, b);
+    xyz[0] = s[0];
+    xyz[1] = s[1];
+    xyz[2] = s[2];
+}
+
+// Four times at once. The recurrences for T_k (and its derivatives) run in the
+// lanes and each coefficient is broadcast to all of them. Multiplies and adds
+// in the scalar order, not fused, so each lane gives the scalar result
+template <bool derivatives, bool second>
+GROHO_TARGET_AVX2 void cheby_eval_lanes_avx2(
+    const double* A,
+    size_t        n,
+    const double* x,
+    size_t        j,
+    double*       xyz,
+    double*       dxyz,
+    double*       ddxyz)
+{
+    const double* Ac[3] = { A, A + n, A + 2 * n };
+
+    __m256d T_1 = _mm256_loadu_pd(x + j);
+    __m256d T_2 = _mm256_set1_pd(1.0);
+    __m256d x2  = _mm256_add_pd(T_1, T_1);
+    __m256d two = _mm256_set1_pd(2.0), four = _mm256_set1_pd(4.0);
+
+    __m256d dT_1 = _mm256_set1_pd(1.0), dT_2 = _mm256_setzero_pd();
+    __m256d ddT_1 = _mm256_setzero_pd(), ddT_2 = _mm256_setzero_pd();
+
+    __m256d b[3], db[3], ddb[3];
+    for (size_t a = 0; a < 3; a++) {
+        b[a] = _mm256_add_pd(
+            _mm256_set1_pd(Ac[a][0]),
+            _mm256_mul_pd(_mm256_set1_pd(Ac[a][1]), T_1));
+        db[a]  = _mm256_set1_pd(Ac[a][1]);
+        ddb[a] = _mm256_setzero_pd();
+    }
+
+    for (size_t k = 2; k < n; k++) {
+        __m256d Tk = _mm256_sub_pd(_mm256_mul_pd(x2, T_1), T_2);
+        __m256d dTk, ddTk;
+        if constexpr (derivatives) {
+            dTk = _mm256_sub_pd(
+                _mm256_add_pd(
+                    _mm256_mul_pd(two, T_1), _mm256_mul_pd(x2, dT_1)),
+                dT_2);
+        }
+        if constexpr (second) {
+            ddTk = _mm256_sub_pd(
+                _mm256_add_pd(
+                    _mm256_mul_pd(four, dT_1), _mm256_mul_pd(x2, ddT_1)),
+                ddT_2);
+        }
+        for (size_t a = 0; a < 3; a++) {
+            __m256d c = _mm256_set1_pd(Ac[a][k]);
+            b[a]      = _mm256_add_pd(b[a], _mm256_mul_pd(Tk, c));
+            if constexpr (derivatives) {
+                db[a] = _mm256_add_pd(db[a], _mm256_mul_pd(dTk, c));
+            }
+            if constexpr (second) {
+                ddb[a] = _mm256_add_pd(ddb[a], _mm256_mul_pd(ddTk, c));
+            }
+        }
+        T_2 = T_1;
+        T_1 = Tk;
+        if constexpr (derivatives) {
+            dT_2 = dT_1;
+            dT_1 = dTk;
+        }
+        if constexpr (second) {
+            ddT_2 = ddT_1;
+            ddT_1 = ddTk;
+        }
+    }
+
+    alignas(32) double out[3][4];
+    for (size_t a = 0; a < 3; a++) {
+        _mm256_store_pd(out[a], b[a]);
+    }
+    for (size_t l = 0; l < 4; l++) {
+        for (size_t a = 0; a < 3; a++) {
+            xyz[3 * (j + l) + a] = out[a][l];
+        }
+    }
+    if constexpr (derivatives) {
+        for (size_t a = 0; a < 3; a++) {
+            _mm256_store_pd(out[a], db[a]);
+        }
+        for (size_t l = 0; l < 4; l++) {
+            for (size_t a = 0; a < 3; a++) {
+                dxyz[3 * (j + l) + a] = out[a][l];
+            }
+        }
+    }
+    if constexpr (second) {
+        for (size_t a = 0; a < 3; a++) {
+            _mm256_store_pd(out[a], ddb[a]);
+        }
+        for (size_t l = 0; l < 4; l++) {
+            for (size_t a = 0; a < 3; a++) {
+                ddxyz[3 * (j + l) + a] = out[a][l];
+            }
+        }
+    }
+}
+
+#endif
+
+static void
+cheby_dot_xyz(const double* A, size_t n, const double* T, double* xyz)
+{
+    switch (simd_level()) {
+#ifdef GROHO_X86_SIMD
+    case SimdLevel::AVX2:
+        cheby_dot_xyz_avx2(A, n, T, xyz);
+        return;
+    case SimdLevel::SSE2:
+        cheby_dot_xyz_sse2(A, n, T, xyz);
+        return;
+#endif
+    default:
+        cheby_dot_xyz_scalar(A, n, T, xyz);
+    }
+}
+
+void cheby_eval_xyz_n(
+    const double* A, size_t n, const double* x, size_t m, double* xyz)
+{
+    size_t j = 0;
+#ifdef GROHO_X86_SIMD
+    if (simd_level() == SimdLevel::AVX2) {
+        for (; j + 4 <= m; j += 4) {
+            cheby_eval_lanes_avx2<false, false>(
+                A, n, x, j, xyz, nullptr, nullptr);
+        }
+    }
+#endif
+    for (; j < m; j++) {
+        cheby_eval_xyz(A, n, x[j], xyz + 3 * j);
+    }
+}
+
+void cheby_eval_xyz(const double* A, size_t n, double x, double* xyz)
+{
+    if (n > max_cheby_coeff) {
+        xyz[0] = cheby_eval_one(A, n, x);
+        xyz[1] = cheby_eval_one(A + n, n, x);
+        xyz[2] = cheby_eval_one(A + 2 * n, n, x);
+        return;
+    }
+
+    double T[max_cheby_coeff];
+    cheby_polynomials(x, n, T);
+    cheby_dot_xyz(A, n, T, xyz);
+}
+
+void cheby_eval_xyz_d(
+    const double* A,
+    size_t        n,
+    double        x,
+    double*       xyz,
+    double*       dxyz,
+    double*       ddxyz)
+{
+    if (n > max_cheby_coeff) {
+        std::vector<double> T(n), dT(n), ddT(n);
+        cheby_derivatives(
+            x, n, T.data(), dT.data(), ddxyz ? ddT.data() : nullptr);
+        cheby_dot_xyz_scalar(A, n, T.data(), xyz);
+        cheby_dot_xyz_scalar(A, n, dT.data(), dxyz);
+        if (ddxyz) {
+            cheby_dot_xyz_scalar(A, n, ddT.data(), ddxyz);
+        }
+        return;
+    }
+
+    double T[max_cheby_coeff], dT[max_cheby_coeff], ddT[max_cheby_coeff];
+    cheby_derivatives(x, n, T, dT, ddxyz ? ddT : nullptr);
+    cheby_dot_xyz(A, n, T, xyz);
+    cheby_dot_xyz(A, n, dT, dxyz);
+    if (ddxyz) {
+        cheby_dot_xyz(A, n, ddT, ddxyz);
+    }
+}
+
+void cheby_eval_xyz_d_n(
+    const double* A,
+    size_t        n,
+    const double* x,
+    size_t        m,
+    double*       xyz,
+    double*       dxyz,
+    double*       ddxyz)
+{
+    size_t j = 0;
+#ifdef GROHO_X86_SIMD
+    if (simd_level() == SimdLevel::AVX2) {
+        for (; j + 4 <= m; j += 4) {
+            if (ddxyz) {
+                cheby_eval_lanes_avx2<true, true>(
+                    A, n, x, j, xyz, dxyz, ddxyz);
+            } else {
+                cheby_eval_lanes_avx2<true, false>(
+                    A, n, x, j, xyz, dxyz, nullptr);
+            }
+        }
+    }
+#endif
+    for (; j < m; j++) {
+        cheby_eval_xyz_d(
+            A,
+            n,
+            x[j],
+            xyz + 3 * j,
+            dxyz + 3 * j,
+            ddxyz ? ddxyz + 3 * j : nullptr);
+    }
+}
+
+}
@@ -0,0 +1,76 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Evaluation of the Chebyshev series that make up an SPK element record.
+
+A record carries the X, Y and Z series back to back. Rather than running the
+Clenshaw recurrence three times we generate the Chebyshev polynomials T_k(x)
+once and take the dot product of each axis' coefficients with them. The dot
+products are independent of each other and vectorize well, so all three axes
+are done in one pass, using AVX2/SSE2 lanes when the CPU has them.
+
+Every kernel multiplies and adds in the order cheby_eval_one does, without
+fusing them, so the orrery comes out the same to the bit on any CPU.
+*/
+
+#pragma once
+
+#include <stdlib.h>
+
+namespace groho {
+
+// Records with more coefficients per axis than this use the plain recurrence
+const size_t max_cheby_coeff = 32;
+
+// Single series, by Clenshaw recurrence. This is the reference implementation
+inline double cheby_eval_one(const double* A, size_t n, double x)
+{
+    // https://en.wikipedia.org/wiki/Clenshaw_algorithm#Special_case_for_Chebyshev_series
+    double x2 = 2 * x;
+    double Tn, Tn_1 = x, Tn_2 = 1.0;
+    double b = A[0] * Tn_2 + A[1] * Tn_1;
+    for (size_t i = 2; i < n; i++) {
+        Tn = x2 * Tn_1 - Tn_2;
+        b += Tn * A[i];
+        Tn_2 = Tn_1;
+        Tn_1 = Tn;
+    }
+    return b;
+}
+
+// A points to X[n], Y[n], Z[n]. x is the normalized time, in [-1, 1]
+void cheby_eval_xyz(const double* A, size_t n, double x, double* xyz);
+
+// The same record evaluated at m times. The times go in the SIMD lanes so each
+// coefficient is loaded once per group of times. Results go to xyz[3 * j + axis]
+void cheby_eval_xyz_n(
+    const double* A, size_t n, const double* x, size_t m, double* xyz);
+
+// The series and its first and second derivatives with respect to x. The
+// derivatives of T_k follow from differentiating the recurrence
+//
+//   T'_k  = 2 T_k-1  + 2x T'_k-1  - T'_k-2
+//   T''_k = 4 T'_k-1 + 2x T''_k-1 - T''_k-2
+//
+// so we generate them alongside T_k and take the same dot products. ddxyz may
+// be null if the second derivative is not needed
+void cheby_eval_xyz_d(
+    const double* A,
+    size_t        n,
+    double        x,
+    double*       xyz,
+    double*       dxyz,
+    double*       ddxyz);
+
+// cheby_eval_xyz_d at m times, laid out as for cheby_eval_xyz_n
+void cheby_eval_xyz_d_n(
+    const double* A,
+    size_t        n,
+    const double* x,
+    size_t        m,
+    double*       xyz,
+    double*       dxyz,
+    double*       ddxyz);
+
+}
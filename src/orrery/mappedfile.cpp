@@ -0,0 +1,64 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Read only memory map of a whole file.
+*/
+
+#include <algorithm>
+#include <cstring> // gcc needs this for strerror
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mappedfile.hpp"
+
+#define LOGURU_WITH_STREAMS 1
+#include "loguru.hpp"
+
+namespace groho {
+
+std::shared_ptr<const MappedFile> MappedFile::open(const fs::path& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        LOG_S(WARNING) << path << ": " << std::strerror(errno);
+        return nullptr;
+    }
+
+    struct stat sb;
+    if ((fstat(fd, &sb) == -1) || (sb.st_size == 0)) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    void* addr = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        LOG_S(WARNING) << path << ": mmap: " << std::strerror(errno);
+        return nullptr;
+    }
+
+    // SPK access is a few scattered summary reads followed by a jump to the
+    // segment we need, so read-ahead of the whole file does not help us
+    madvise(addr, sb.st_size, MADV_RANDOM);
+
+    return std::shared_ptr<const MappedFile>(
+        new MappedFile(static_cast<const char*>(addr), sb.st_size));
+}
+
+void MappedFile::release(size_t offset, size_t len) const
+{
+    size_t page  = sysconf(_SC_PAGESIZE);
+    size_t begin = (offset + page - 1) / page * page;
+    size_t end   = std::min(offset + len, size_) / page * page;
+    if (begin < end) {
+        madvise(const_cast<char*>(data_) + begin, end - begin, MADV_DONTNEED);
+    }
+}
+
+MappedFile::~MappedFile() { munmap(const_cast<char*>(data_), size_); }
+
+}
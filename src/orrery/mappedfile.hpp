@@ -0,0 +1,70 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Read only memory map of a whole file. Used to look at SPK kernels in place,
+without copying the coefficient records onto the heap. Only the pages we
+actually touch are ever read from disk.
+*/
+
+#pragma once
+
+#include <cstring>
+#include <filesystem>
+#include <memory>
+
+namespace groho {
+
+namespace fs = std::filesystem;
+
+class MappedFile {
+public:
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns nullptr if the file can not be mapped. Callers should fall back
+    // to reading the file through a stream in that case.
+    static std::shared_ptr<const MappedFile> open(const fs::path& path);
+
+    const char* data() const { return data_; }
+    size_t      size() const { return size_; }
+
+    bool contains(size_t offset, size_t len) const
+    {
+        return (offset <= size_) && (len <= size_ - offset);
+    }
+
+    // Pointer into the map. The caller must make sure the range is valid.
+    template <typename T> const T* at(size_t offset) const
+    {
+        return reinterpret_cast<const T*>(data_ + offset);
+    }
+
+    // Copy out a (possibly packed/unaligned) structure
+    template <typename T> bool read(size_t offset, T& dst) const
+    {
+        if (!contains(offset, sizeof(T))) {
+            return false;
+        }
+        std::memcpy(&dst, data_ + offset, sizeof(T));
+        return true;
+    }
+
+    // We are done with this range for now. The pages wholly inside it are
+    // dropped and read back from the file if we ever come back to them
+    void release(size_t offset, size_t len) const;
+
+private:
+    MappedFile(const char* data, size_t size)
+        : data_(data)
+        , size_(size)
+    {
+    }
+
+    const char* data_;
+    size_t      size_;
+};
+
+}
@@ -5,11 +5,13 @@ Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
 Orrery built with SPK files
 */
 
+#include <chrono>
 #include <deque>
 #include <unordered_map>
 
 #include "bodyconstant.hpp"
 #include "orrery.hpp"
+#include "orrerypack.hpp"
 
 #define LOGURU_WITH_STREAMS 1
 #include "loguru.hpp"
@@ -25,12 +27,16 @@ Put the data into a tree as we go, with centers being the parents of targets.
 Do a breadth wise traversal and place all the bodies in order.
 */
 
-Orrery::Orrery(J2000_s begin, J2000_s end, const KernelTokens& kernel_tokens)
+Orrery::Orrery(
+    J2000_s             begin,
+    J2000_s             end,
+    const KernelTokens& kernel_tokens,
+    ThreadPool*         pool)
 {
-    objects = load_orrery_objects(begin, end, kernel_tokens, _status);
+    objects = load_orrery_objects(begin, end, kernel_tokens, _status, pool);
 }
 
-void Orrery::pos_at(J2000_s t, v3d_vec_t& pos)
+void Orrery::pos_at(J2000_s t, v3d_vec_t& pos) const
 {
     for (size_t i = 1; i < objects.size(); i++) {
         objects[i].ephemeris->eval(t, pos[i - 1]);
@@ -43,6 +49,76 @@ void Orrery::pos_at(J2000_s t, v3d_vec_t& pos)
     }
 }
 
+bool Orrery::failed() const
+{
+    for (size_t i = 1; i < objects.size(); i++) {
+        if (objects[i].ephemeris->failed()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Orrery::state_at(
+    J2000_s t, v3d_vec_t& pos, v3d_vec_t& vel, v3d_vec_t& acc) const
+{
+    for (size_t i = 1; i < objects.size(); i++) {
+        objects[i].ephemeris->eval(t, pos[i - 1], vel[i - 1], acc[i - 1]);
+        pos[i - 1].t = t;
+        vel[i - 1].t = t;
+        acc[i - 1].t = t;
+    }
+    for (size_t i = 1; i < objects.size(); i++) {
+        if (objects[i].parent_idx != 0) {
+            pos[i - 1] += pos[objects[i].parent_idx - 1];
+            vel[i - 1] += vel[objects[i].parent_idx - 1];
+            acc[i - 1] += acc[objects[i].parent_idx - 1];
+        }
+    }
+}
+
+void Orrery::state_over(
+    J2000_s t0, double dt, size_t n, v3d_vec_t& state) const
+{
+    const size_t n_bodies = size();
+    state.resize(3 * n * n_bodies);
+
+    // Body by body, so each body's records are reused across all the times
+    // that fall inside them while they are in cache
+    for (size_t i = 1; i < objects.size(); i++) {
+        objects[i].ephemeris->eval_over(
+            t0,
+            dt,
+            n,
+            &state[i - 1],
+            &state[n_bodies + i - 1],
+            &state[2 * n_bodies + i - 1],
+            3 * n_bodies);
+    }
+
+    for (size_t k = 0; k < n; k++) {
+        V3d*   row = &state[3 * k * n_bodies];
+        double t   = t0 + k * dt;
+        for (size_t i = 1; i < objects.size(); i++) {
+            size_t parent = objects[i].parent_idx;
+            for (size_t r = 0; r < 3; r++) {
+                V3d& v = row[r * n_bodies + i - 1];
+                v.t    = t;
+                if (parent != 0) {
+                    v += row[r * n_bodies + parent - 1];
+                }
+            }
+        }
+    }
+}
+
+void Orrery::release_before(J2000_s t)
+{
+    for (size_t i = 1; i < objects.size(); i++) {
+        objects[i].ephemeris->release_before(t);
+    }
+}
+
 std::vector<BodyConstant> Orrery::get_bodies() const
 {
     std::vector<BodyConstant> bodies;
@@ -84,15 +160,81 @@ std::vector<OrreryObject> load_orrery_objects(
     J2000_s             begin,
     J2000_s             end,
     const KernelTokens& kernel_tokens,
-    Orrery::StatusCode& status)
+    Orrery::StatusCode& status,
+    ThreadPool*         pool)
 {
     status = Orrery::StatusCode::OK;
-    std::unordered_map<NAIFbody, _Body> bodies;
-    bodies[NAIFbody(0)] = _Body();
 
-    for (const auto& kernel : kernel_tokens) {
-        auto _spk = SpkFile::load(kernel.path);
-        if (!_spk) {
+    // A pack is the whole orrery, already in order
+    if ((kernel_tokens.size() == 1) && is_orrery_pack(kernel_tokens[0].path)) {
+        if (kernel_tokens[0].codes.size() > 0) {
+            LOG_S(WARNING) << kernel_tokens[0].path
+                           << ": Ignoring pick for an orrery pack";
+            status = Orrery::StatusCode::WARNING;
+        }
+        auto objects = load_orrery_pack(kernel_tokens[0].path, begin, end);
+        if (!objects) {
+            status = Orrery::StatusCode::ERROR;
+            return { { nullptr, 0 } };
+        }
+        print_objects_to_debug(*objects);
+        return *objects;
+    }
+
+    // Run f(i) for i in [0, n), on the pool if we have one
+    auto for_each = [pool](size_t n, auto&& f) {
+        if (pool == nullptr) {
+            for (size_t i = 0; i < n; i++) {
+                f(i);
+            }
+            return;
+        }
+        pool->parallel_for(n, 1, [&f](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                f(i);
+            }
+        });
+    };
+
+    typedef std::chrono::steady_clock clock;
+    auto ms = [](clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    };
+    auto started = clock::now();
+
+    // Open all the kernels at once ...
+    const size_t                        n_kernels = kernel_tokens.size();
+    std::vector<std::optional<SpkFile>> spks(n_kernels);
+    std::vector<clock::duration>        load_time(n_kernels);
+    for_each(n_kernels, [&](size_t i) {
+        auto t0 = clock::now();
+        if (!is_orrery_pack(kernel_tokens[i].path)) {
+            spks[i] = SpkFile::load(kernel_tokens[i].path);
+        }
+        load_time[i] = clock::now() - t0;
+    });
+
+    // ... then decide, in kernel order, which file each body comes from ...
+    struct Load {
+        size_t                   kernel;
+        NAIFbody                 code;
+        NAIFbody                 center;
+        std::optional<Ephemeris> ephemeris;
+        clock::duration          time;
+    };
+    std::vector<Load>            loads;
+    std::unordered_set<NAIFbody> claimed;
+
+    for (size_t k = 0; k < n_kernels; k++) {
+        const auto& kernel = kernel_tokens[k];
+        if (is_orrery_pack(kernel.path)) {
+            LOG_S(ERROR) << kernel.path
+                         << ": An orrery pack has to be the only kernel";
+            status = Orrery::StatusCode::ERROR;
+            continue;
+        }
+
+        if (!spks[k]) {
             LOG_S(ERROR) << "Unable to load " << kernel.path;
             if (status != Orrery::StatusCode::ERROR) {
                 status = Orrery::StatusCode::WARNING;
@@ -102,9 +244,9 @@ std::vector<OrreryObject> load_orrery_objects(
 
         auto objects_to_find = kernel.codes;
 
-        auto& spk = *_spk;
+        auto& spk = *spks[k];
         for (auto [code, summary] : spk.summaries) {
-            if (bodies.find(code) != bodies.end()) {
+            if (claimed.find(code) != claimed.end()) {
                 continue;
             }
             if ((kernel.codes.size() > 0)
@@ -118,11 +260,8 @@ std::vector<OrreryObject> load_orrery_objects(
                 continue;
             }
 
-            // todo: return ephemeris as shared pointer
-            bodies[code] = _Body{ std::make_shared<Ephemeris>(
-                                      *(spk.load_ephemeris(code, begin, end))),
-                                  {},
-                                  NAIFbody(summary.center_id) };
+            claimed.insert(code);
+            loads.push_back({ k, code, NAIFbody(summary.center_id), {}, {} });
             objects_to_find.erase(code);
         }
 
@@ -138,6 +277,46 @@ std::vector<OrreryObject> load_orrery_objects(
         }
     }
 
+    // ... load all the bodies at once ...
+    for_each(loads.size(), [&](size_t i) {
+        auto  t0   = clock::now();
+        auto& load = loads[i];
+        load.ephemeris
+            = spks[load.kernel]->load_ephemeris(load.code, begin, end);
+        load.time = clock::now() - t0;
+    });
+
+    // ... and put them in the tree in the order we decided on, which keeps
+    // the orrery the same from run to run
+    std::unordered_map<NAIFbody, _Body> bodies;
+    bodies[NAIFbody(0)] = _Body();
+
+    std::vector<size_t> n_bodies(n_kernels);
+    for (auto& load : loads) {
+        load_time[load.kernel] += load.time;
+        if (!load.ephemeris) {
+            status = Orrery::StatusCode::ERROR;
+            continue;
+        }
+        bodies[load.code] = _Body{
+            std::make_shared<Ephemeris>(std::move(*load.ephemeris)),
+            {},
+            load.center
+        };
+        n_bodies[load.kernel]++;
+    }
+
+    // Where the start up time went
+    for (size_t k = 0; k < n_kernels; k++) {
+        if (spks[k]) {
+            LOG_S(INFO) << kernel_tokens[k].path.filename() << ": "
+                        << n_bodies[k] << " bodies, " << ms(load_time[k])
+                        << " ms";
+        }
+    }
+    LOG_S(INFO) << "Kernels loaded in " << ms(clock::now() - started)
+                << " ms";
+
     for (auto& [code, body] : bodies) {
         if (int(code) == 0) {
             continue;
@@ -18,6 +18,7 @@ Orrery built with SPK files
 
 #include "bodyconstant.hpp"
 #include "spk.hpp"
+#include "threadpool.hpp"
 #include "tokens.hpp"
 #include "units.hpp"
 
@@ -36,10 +37,35 @@ class Orrery {
 public:
     enum StatusCode { OK = 0, WARNING, ERROR };
     Orrery() { ; }
-    Orrery(J2000_s begin, J2000_s end, const KernelTokens& kernel_tokens);
+    // Kernels, and the bodies in them, are loaded in parallel on the pool if
+    // we are given one
+    Orrery(
+        J2000_s             begin,
+        J2000_s             end,
+        const KernelTokens& kernel_tokens,
+        ThreadPool*         pool = nullptr);
 
     StatusCode status() { return _status; }
-    void       pos_at(J2000_s t, v3d_vec_t& pos);
+    size_t     size() const { return objects.size() - 1; }
+    void       pos_at(J2000_s t, v3d_vec_t& pos) const;
+
+    // Positions, velocities and accelerations in one pass over the ephemeris
+    void state_at(
+        J2000_s t, v3d_vec_t& pos, v3d_vec_t& vel, v3d_vec_t& acc) const;
+
+    // The same at t0, t0 + dt, ... t0 + (n - 1) dt as a block of rows, three
+    // per time. Body i at the k-th time has position state[3k * size() + i],
+    // velocity state[(3k + 1) * size() + i] and acceleration
+    // state[(3k + 2) * size() + i]
+    void state_over(J2000_s t0, double dt, size_t n, v3d_vec_t& state) const;
+
+    // Ephemeris records are loaded as they are needed. Let go of the ones that
+    // end before t. No one else should be evaluating the orrery meanwhile
+    void release_before(J2000_s t);
+
+    // Some ephemeris records could not be read and positions that depend on
+    // them are NaN
+    bool failed() const;
 
     std::vector<BodyConstant> get_bodies() const;
     std::vector<size_t>       get_grav_body_idx() const;
@@ -53,6 +79,7 @@ std::vector<OrreryObject> load_orrery_objects(
     J2000_s             begin,
     J2000_s             end,
     const KernelTokens& kernel_tokens,
-    Orrery::StatusCode& status);
+    Orrery::StatusCode& status,
+    ThreadPool*         pool = nullptr);
 
 }
\ No newline at end of file
@@ -0,0 +1,245 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#include "mappedfile.hpp"
+#include "orrerypack.hpp"
+
+#define LOGURU_WITH_STREAMS 1
+#include "loguru.hpp"
+
+namespace groho {
+
+const size_t pack_alignment = 64; // bytes: a cache line
+
+static size_t align_up(size_t n, size_t a) { return (n + a - 1) / a * a; }
+
+bool is_orrery_pack(const fs::path& path)
+{
+    char          magic[sizeof(PackHeader::magic)] = {};
+    std::ifstream file(path, std::ios::binary);
+    file.read(magic, sizeof(magic));
+    return file
+        && (std::memcmp(magic, PackHeader::magic_value, sizeof(magic)) == 0);
+}
+
+bool write_orrery_pack(
+    const fs::path&     path,
+    J2000_s             begin,
+    J2000_s             end,
+    const KernelTokens& kernel_tokens)
+{
+    Orrery::StatusCode status;
+    auto objects = load_orrery_objects(begin, end, kernel_tokens, status);
+    if (status == Orrery::StatusCode::ERROR) {
+        LOG_S(ERROR) << "Not writing pack because of errors in the orrery.";
+        return false;
+    }
+
+    PackHeader header = {};
+    std::memcpy(header.magic, PackHeader::magic_value, sizeof(header.magic));
+    header.version   = PackHeader::current_version;
+    header.n_objects = objects.size() - 1;
+    header.begin_s   = begin;
+    header.end_s     = end;
+
+    const size_t per_line = pack_alignment / sizeof(double);
+
+    std::vector<PackObject> table(header.n_objects);
+    size_t offset = sizeof(PackHeader) + table.size() * sizeof(PackObject);
+    for (size_t i = 1; i < objects.size(); i++) {
+        const auto& eph = *objects[i].ephemeris;
+        auto&       obj = table[i - 1];
+
+        size_t n_values = (eph.has_vel ? 6 : 3) * eph.n_coeff;
+
+        obj.target_code = eph.target_code;
+        obj.center_code = eph.center_code;
+        obj.parent_idx  = objects[i].parent_idx;
+        obj.flags       = 0;
+        if (objects[i].gravitational_body) {
+            obj.flags |= PackObject::GRAVITATIONAL;
+        }
+        if (eph.has_vel) {
+            obj.flags |= PackObject::HAS_VEL;
+        }
+        obj.begin_s    = eph.begin_s;
+        obj.interval_s = eph.interval_s;
+        obj.n_coeff    = eph.n_coeff;
+        obj.stride     = align_up(n_values, per_line);
+        obj.n_records  = eph.size();
+        obj.offset     = align_up(offset, pack_alignment);
+
+        offset = obj.offset
+            + align_up(2 * obj.n_records * sizeof(double), pack_alignment)
+            + obj.n_records * obj.stride * sizeof(double);
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        LOG_S(ERROR) << "Could not open " << path << " for writing.";
+        return false;
+    }
+
+    auto pad_to = [&file](size_t pos) {
+        static const char zeros[pack_alignment] = {};
+        file.write(zeros, pos - size_t(file.tellp()));
+    };
+
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)table.data(), table.size() * sizeof(PackObject));
+
+    dbl_vec_t t_mid, t_half, record;
+    for (size_t i = 1; i < objects.size(); i++) {
+        const auto& eph = *objects[i].ephemeris;
+        const auto& obj = table[i - 1];
+
+        t_mid.resize(eph.size());
+        t_half.resize(eph.size());
+        for (size_t r = 0; r < eph.size(); r++) {
+            auto rec  = eph.record(r);
+            t_mid[r]  = rec.t_mid;
+            t_half[r] = rec.t_half;
+        }
+
+        pad_to(obj.offset);
+        file.write((const char*)t_mid.data(), eph.size() * sizeof(double));
+        file.write((const char*)t_half.data(), eph.size() * sizeof(double));
+        pad_to(align_up(size_t(file.tellp()), pack_alignment));
+
+        size_t n_values = (eph.has_vel ? 6 : 3) * eph.n_coeff;
+        record.assign(obj.stride, 0.0);
+        for (size_t r = 0; r < eph.size(); r++) {
+            std::copy_n(eph.record(r).coeff, n_values, record.data());
+            file.write((const char*)record.data(), obj.stride * sizeof(double));
+        }
+        eph.records->release_before(SIZE_MAX);
+    }
+
+    if (!file) {
+        LOG_S(ERROR) << "Error writing " << path;
+        return false;
+    }
+
+    LOG_S(INFO) << "Packed " << header.n_objects << " bodies into " << path
+                << " (" << offset / 1024 << " kB)";
+    return true;
+}
+
+std::optional<std::vector<OrreryObject>>
+load_orrery_pack(const fs::path& path, J2000_s begin, J2000_s end)
+{
+    auto mapped = MappedFile::open(path);
+    if (!mapped) {
+        LOG_S(ERROR) << path << ": Could not map pack.";
+        return {};
+    }
+
+    PackHeader header;
+    if (!mapped->read(0, header)
+        || (std::memcmp(
+                header.magic, PackHeader::magic_value, sizeof(header.magic))
+            != 0)) {
+        LOG_S(ERROR) << path << ": Not an orrery pack.";
+        return {};
+    }
+    if (header.version != PackHeader::current_version) {
+        LOG_S(ERROR) << path << ": Pack version " << header.version
+                     << ", expected " << PackHeader::current_version
+                     << ". Please repack.";
+        return {};
+    }
+    if ((begin < header.begin_s) || (end > header.end_s)) {
+        LOG_S(ERROR) << "Requested range: " << begin.as_ut() << " to "
+                     << end.as_ut();
+        LOG_S(ERROR) << "Packed range: " << J2000_s(header.begin_s).as_ut()
+                     << " to " << J2000_s(header.end_s).as_ut();
+        LOG_S(ERROR) << path << ": Requested time range out of bounds.";
+        return {};
+    }
+
+    LOG_S(INFO) << "Loading " << path << " (pack)";
+
+    std::vector<OrreryObject> objects;
+    objects.push_back({ nullptr, 0 });
+
+    for (size_t i = 0; i < header.n_objects; i++) {
+        PackObject obj;
+        if (!mapped->read(sizeof(PackHeader) + i * sizeof(PackObject), obj)) {
+            LOG_S(ERROR) << path << ": Pack table out of bounds.";
+            return {};
+        }
+
+        // Just the records for [begin, end], as when slicing a kernel
+        double first = std::floor((begin - obj.begin_s) / obj.interval_s);
+        double last  = std::min(
+            std::floor((end - obj.begin_s) / obj.interval_s),
+            double(obj.n_records) - 1);
+
+        bool   has_vel      = obj.flags & PackObject::HAS_VEL;
+        size_t coeff_offset = obj.offset
+            + align_up(2 * obj.n_records * sizeof(double), pack_alignment);
+        if ((obj.parent_idx > i) || (obj.n_records == 0)
+            || (obj.stride < (has_vel ? 6 : 3) * obj.n_coeff)
+            || !(obj.interval_s > 0) || !(first >= 0) || !(first <= last)
+            || !mapped->contains(
+                coeff_offset, obj.n_records * obj.stride * sizeof(double))) {
+            LOG_S(ERROR) << path << ": " << obj.target_code;
+            LOG_S(ERROR) << "Pack entry is corrupt.";
+            return {};
+        }
+
+        size_t begin_element = first;
+        size_t end_element   = last;
+        size_t n_records     = end_element - begin_element + 1;
+
+        // Records are read in chunks as they are needed, as from a kernel
+        const double* t_mid  = mapped->at<double>(obj.offset) + begin_element;
+        const double* t_half = t_mid + obj.n_records;
+        size_t        stride = obj.stride;
+        size_t        base
+            = coeff_offset + begin_element * stride * sizeof(double);
+
+        auto loader = [mapped, t_mid, t_half, stride, base](
+                          size_t first, size_t n) {
+            size_t offset = base + first * stride * sizeof(double);
+            size_t bytes  = n * stride * sizeof(double);
+
+            auto chunk = std::make_unique<EphemerisChunk>();
+            chunk->t_mid.assign(t_mid + first, t_mid + first + n);
+            chunk->t_half.assign(t_half + first, t_half + first + n);
+            chunk->coeff   = mapped->at<double>(offset);
+            chunk->records = std::shared_ptr<const void>(
+                chunk->coeff, [mapped, offset, bytes](const void*) {
+                    mapped->release(offset, bytes);
+                });
+            return chunk;
+        };
+
+        auto eph         = std::make_shared<Ephemeris>();
+        eph->target_code = obj.target_code;
+        eph->center_code = obj.center_code;
+        eph->begin_s     = obj.begin_s + begin_element * obj.interval_s;
+        eph->interval_s  = obj.interval_s;
+        eph->n_coeff     = obj.n_coeff;
+        eph->stride      = obj.stride;
+        eph->has_vel     = has_vel;
+        eph->records
+            = std::make_shared<EphemerisRecords>(n_records, stride, loader);
+
+        objects.push_back({ eph,
+                            obj.parent_idx,
+                            bool(obj.flags & PackObject::GRAVITATIONAL) });
+    }
+
+    return objects;
+}
+
+}
@@ -0,0 +1,82 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Orrery packs.
+
+A full DE kernel runs to GBs, while a scenario needs only a few bodies over a
+few years of it. A pack holds just those: the ephemeris records that cover the
+scenario's time range, for the bodies its kernel lines pick, already in the
+order the orrery keeps them. It is loaded with a single mmap, with no summary
+chain to walk and no records to slice.
+
+Layout, all native byte order:
+
+    PackHeader
+    PackObject  x n_objects   (orrery order, without the SSB)
+    per object, starting on a cache line:
+        t_mid[n_records]
+        t_half[n_records]
+        coefficients, padded to a cache line, n_records x stride
+
+so each record's coefficients start on a cache line, as in the heap arena.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include "orrery.hpp"
+
+namespace groho {
+
+namespace fs = std::filesystem;
+
+struct PackHeader {
+    static constexpr char     magic_value[8] = "GROHOPK";
+    static constexpr uint32_t current_version = 1;
+
+    char     magic[8];
+    uint32_t version;
+    uint32_t n_objects;
+    double   begin_s; // The time range the pack covers
+    double   end_s;
+    uint8_t  reserved[32];
+};
+
+struct PackObject {
+    enum Flags : uint32_t { GRAVITATIONAL = 1, HAS_VEL = 2 };
+
+    int32_t  target_code;
+    int32_t  center_code;
+    uint32_t parent_idx;
+    uint32_t flags;
+    double   begin_s;
+    double   interval_s;
+    uint64_t n_coeff;
+    uint64_t stride;    // doubles between records
+    uint64_t n_records;
+    uint64_t offset;    // bytes, from the start of the file to t_mid
+};
+
+static_assert(sizeof(PackHeader) == 64, "Pack header should be a cache line");
+static_assert(sizeof(PackObject) == 64, "Pack entry should be a cache line");
+
+// Does the file start like a pack?
+bool is_orrery_pack(const fs::path& path);
+
+// Write the orrery for [begin, end] built from these kernels to a pack
+bool write_orrery_pack(
+    const fs::path&     path,
+    J2000_s             begin,
+    J2000_s             end,
+    const KernelTokens& kernel_tokens);
+
+// The orrery objects for [begin, end], which has to lie inside the pack's range
+std::optional<std::vector<OrreryObject>>
+load_orrery_pack(const fs::path& path, J2000_s begin, J2000_s end);
+
+}
@@ -6,14 +6,12 @@ The following code handles loading of NASA/JPL SPK/DAF files that carry
 information for planetary ephemerides.
 */
 
-// TODO: The code as written pays no attention to cache locality. We should do a
-// benchmark with a heavyweight kernel (say DE430) where we just compute the
-// orrery and then rewrite the code to achieve better cache locality and see how
-// much we improve things.
-
+#include <algorithm>
 #include <cmath>
 #include <fstream>
+#include <new>
 
+#include "mappedfile.hpp"
 #include "spklib.hpp"
 
 #define LOGURU_WITH_STREAMS 1
@@ -21,19 +19,161 @@ information for planetary ephemerides.
 
 namespace groho {
 
-void Elements::read(std::ifstream& nasa_spk_file, int n_coeff, int data_type)
+const size_t arena_alignment = 64; // bytes: a cache line
+
+// Heap arena with the start of the block (and, given a suitable stride, of
+// every record) aligned to a cache line
+static std::shared_ptr<double> make_arena(size_t n)
+{
+    return std::shared_ptr<double>(
+        new (std::align_val_t(arena_alignment)) double[n], [](double* p) {
+            operator delete[](p, std::align_val_t(arena_alignment));
+        });
+}
+
+// MID and RADIUS of n records of record_size doubles each
+static void copy_mid_and_radius(
+    const double* data, size_t record_size, size_t n, EphemerisChunk& chunk)
+{
+    chunk.t_mid.resize(n);
+    chunk.t_half.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        chunk.t_mid[i]  = data[i * record_size];
+        chunk.t_half[i] = data[i * record_size + 1];
+    }
+}
+
+// The derivatives of the series are with respect to x, which runs over [-1, 1]
+// across the record, so we scale them by 1 / RADIUS to get them in time
+static void set_v3d(V3d& v, const double* xyz, double scale = 1.0)
+{
+    v.x = xyz[0] * scale;
+    v.y = xyz[1] * scale;
+    v.z = xyz[2] * scale;
+}
+
+EphemerisRecords::EphemerisRecords(
+    size_t n_records, size_t stride, Loader loader)
+    : n_records(n_records)
+    , stride(stride)
+    , loader(loader)
+{
+    size_t n_chunks = (n_records + chunk_records - 1) / chunk_records;
+    loaded.reset(new std::atomic<const EphemerisChunk*>[n_chunks]());
+    owned.resize(n_chunks);
+}
+
+const EphemerisChunk& EphemerisRecords::load(size_t c) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!owned[c]) {
+        size_t first = c * chunk_records;
+        size_t n     = std::min(chunk_records, n_records - first);
+        owned[c]     = loader(first, n);
+        if (!owned[c]) {
+            // Hand out NaNs rather than garbage until someone notices
+            auto chunk = std::make_unique<EphemerisChunk>();
+            auto arena = make_arena(n * stride);
+            std::fill_n(arena.get(), n * stride, std::nan(""));
+            chunk->t_mid.assign(n, std::nan(""));
+            chunk->t_half.assign(n, std::nan(""));
+            chunk->coeff   = arena.get();
+            chunk->records = arena;
+            owned[c]       = std::move(chunk);
+            load_failed.store(true, std::memory_order_release);
+        }
+        loaded[c].store(owned[c].get(), std::memory_order_release);
+    }
+    return *owned[c];
+}
+
+void EphemerisRecords::release_before(size_t c)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < std::min(c, owned.size()); i++) {
+        if (owned[i]) {
+            loaded[i].store(nullptr, std::memory_order_relaxed);
+            owned[i].reset();
+        }
+    }
+}
+
+size_t EphemerisRecords::resident() const
 {
-    nasa_spk_file.read((char*)&t_mid, sizeof(double));
-    nasa_spk_file.read((char*)&t_half, sizeof(double));
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::count_if(owned.begin(), owned.end(), [](const auto& chunk) {
+        return bool(chunk);
+    });
+}
 
-    A.resize(3 * n_coeff);
-    nasa_spk_file.read((char*)A.data(), 3 * n_coeff * sizeof(double));
-    off1 = n_coeff;
-    off2 = 2 * n_coeff;
-    off3 = 3 * n_coeff;
+void Ephemeris::eval(double t, V3d& pos, V3d& vel, V3d& acc) const
+{
+    size_t        i = std::floor((t - begin_s) / interval_s);
+    auto          r = record(i);
+    const double* A = r.coeff;
+    double        x = (t - r.t_mid) / r.t_half;
+    double        s = 1.0 / r.t_half;
 
-    if (data_type == 3) { // Need to skip the unused coefficients
-        nasa_spk_file.seekg(3 * n_coeff * 8, std::ios::cur);
+    double p[3], v[3], a[3];
+    if (has_vel) {
+        cheby_eval_xyz(A, n_coeff, x, p);
+        cheby_eval_xyz_d(A + 3 * n_coeff, n_coeff, x, v, a, nullptr);
+        set_v3d(pos, p);
+        set_v3d(vel, v);
+        set_v3d(acc, a, s);
+    } else {
+        cheby_eval_xyz_d(A, n_coeff, x, p, v, a);
+        set_v3d(pos, p);
+        set_v3d(vel, v, s);
+        set_v3d(acc, a, s * s);
+    }
+}
+
+void Ephemeris::eval_over(
+    double t0,
+    double dt,
+    size_t n,
+    V3d*   pos,
+    V3d*   vel,
+    V3d*   acc,
+    size_t out_stride) const
+{
+    const size_t run_max = 64;
+    double       x[run_max];
+    double       p[3 * run_max], v[3 * run_max], a[3 * run_max];
+
+    size_t k = 0;
+    while (k < n) {
+        size_t i = std::floor((t0 + k * dt - begin_s) / interval_s);
+        auto   r = record(i);
+
+        size_t m = 0;
+        for (; (m < run_max) && (k + m < n); m++) {
+            double t = t0 + (k + m) * dt;
+            if (size_t(std::floor((t - begin_s) / interval_s)) != i) {
+                break;
+            }
+            x[m] = (t - r.t_mid) / r.t_half;
+        }
+
+        const double* A = r.coeff;
+        double        s = 1.0 / r.t_half;
+        if (has_vel) {
+            cheby_eval_xyz_n(A, n_coeff, x, m, p);
+            cheby_eval_xyz_d_n(A + 3 * n_coeff, n_coeff, x, m, v, a, nullptr);
+        } else {
+            cheby_eval_xyz_d_n(A, n_coeff, x, m, p, v, a);
+        }
+        for (size_t j = 0; j < m; j++, k++) {
+            set_v3d(pos[k * out_stride], p + 3 * j);
+            if (has_vel) {
+                set_v3d(vel[k * out_stride], v + 3 * j);
+                set_v3d(acc[k * out_stride], a + 3 * j, s);
+            } else {
+                set_v3d(vel[k * out_stride], v + 3 * j, s);
+                set_v3d(acc[k * out_stride], a + 3 * j, s * s);
+            }
+        }
     }
 }
 
@@ -51,27 +191,49 @@ bool Summary::valid_time_range(J2000_s begin, J2000_s end) const
     }
 }
 
-std::optional<SpkFile> SpkFile::load(const fs::path& path)
+std::optional<SpkFile> SpkFile::load(const fs::path& path, Access access)
 {
     if (!fs::exists(path)) {
         LOG_S(ERROR) << "Missing file: " << fs::weakly_canonical(path);
         return {};
     }
 
-    std::ifstream nasa_spk_file(path, std::ios::binary);
+    SpkFile spk_file;
+    spk_file.path = path;
 
-    auto hdr = read_file_record(nasa_spk_file);
-    if (!hdr) {
-        LOG_S(ERROR) << path;
-        LOG_S(ERROR) << "Not loading because of errors.";
-        return {};
+    if (access == Access::MMAP) {
+        spk_file.mapped = MappedFile::open(path);
+        if (!spk_file.mapped) {
+            LOG_S(WARNING) << path << ": Could not map file, reading instead.";
+        }
     }
 
-    LOG_S(INFO) << "Loading " << path;
-    SpkFile spk_file;
-    spk_file.path      = path;
-    spk_file.comment   = read_comment_blocks(nasa_spk_file, hdr);
-    spk_file.summaries = read_summaries(nasa_spk_file, hdr);
+    if (spk_file.mapped) {
+        auto hdr = read_file_record(*spk_file.mapped);
+        if (!hdr) {
+            LOG_S(ERROR) << path;
+            LOG_S(ERROR) << "Not loading because of errors.";
+            return {};
+        }
+
+        LOG_S(INFO) << "Loading " << path << " (mapped)";
+        spk_file.comment   = read_comment_blocks(*spk_file.mapped, hdr);
+        spk_file.summaries = read_summaries(*spk_file.mapped, hdr);
+
+    } else {
+        std::ifstream nasa_spk_file(path, std::ios::binary);
+
+        auto hdr = read_file_record(nasa_spk_file);
+        if (!hdr) {
+            LOG_S(ERROR) << path;
+            LOG_S(ERROR) << "Not loading because of errors.";
+            return {};
+        }
+
+        LOG_S(INFO) << "Loading " << path;
+        spk_file.comment   = read_comment_blocks(nasa_spk_file, hdr);
+        spk_file.summaries = read_summaries(nasa_spk_file, hdr);
+    }
 
     return spk_file;
 }
@@ -80,8 +242,6 @@ std::optional<SpkFile> SpkFile::load(const fs::path& path)
 std::optional<Ephemeris>
 SpkFile::load_ephemeris(NAIFbody code, J2000_s begin, J2000_s end) const
 {
-    std::ifstream nasa_spk_file(path, std::ios::binary);
-
     auto i = summaries.find(code);
     if (i == summaries.end()) {
         LOG_S(ERROR) << path << ": " << std::to_string(int(code));
@@ -95,8 +255,20 @@ SpkFile::load_ephemeris(NAIFbody code, J2000_s begin, J2000_s end) const
         return {};
     }
 
-    ElementRecordMetadata erm
-        = read_element_record_metadata(nasa_spk_file, summary);
+    std::ifstream         nasa_spk_file;
+    ElementRecordMetadata erm;
+    if (mapped) {
+        auto _erm = read_element_record_metadata(*mapped, summary);
+        if (!_erm) {
+            LOG_S(ERROR) << path << ": " << std::to_string(int(code));
+            LOG_S(ERROR) << "Segment metadata out of bounds.";
+            return {};
+        }
+        erm = *_erm;
+    } else {
+        nasa_spk_file.open(path, std::ios::binary);
+        erm = read_element_record_metadata(nasa_spk_file, summary);
+    }
 
     size_t begin_element = std::floor((begin - erm.init) / erm.intlen);
     size_t end_element   = std::floor((end - erm.init) / erm.intlen);
@@ -116,22 +288,95 @@ SpkFile::load_ephemeris(NAIFbody code, J2000_s begin, J2000_s end) const
         return {};
     }
 
+    size_t record_size = erm.rsize;
+    size_t n_records   = end_element - begin_element + 1;
+    size_t n_values    = record_size - 2; // Coefficients, without MID, RADIUS
+    size_t internal_offset_byte
+        = (begin_element * record_size + summary.start_i - 1) * size_of_double;
+    size_t n_bytes = n_records * record_size * size_of_double;
+
     Ephemeris eph;
     eph.target_code = summary.target_id;
     eph.center_code = summary.center_id;
     eph.begin_s     = erm.init + begin_element * erm.intlen;
     eph.interval_s  = erm.intlen;
-    eph.elements.resize(end_element - begin_element + 1);
+    eph.n_coeff     = n_coeff;
+    eph.has_vel     = summary.data_type == 3;
 
-    size_t internal_offset_byte
-        = (begin_element * erm.rsize + summary.start_i - 1) * size_of_double;
-    nasa_spk_file.seekg(internal_offset_byte);
-    for (size_t i = 0; i < end_element - begin_element + 1; i++) {
-        eph.elements[i].read(nasa_spk_file, n_coeff, summary.data_type);
+    // The records themselves are only read once the simulation gets to them
+    EphemerisRecords::Loader loader;
+    if (mapped) {
+        if (!mapped->contains(internal_offset_byte, n_bytes)) {
+            LOG_S(ERROR) << path << ": " << std::to_string(int(code));
+            LOG_S(ERROR) << "Element records out of bounds.";
+            return {};
+        }
+
+        // The kernel itself is our arena. Once we are done with a chunk the
+        // pages under it can go
+        eph.stride  = record_size;
+        auto file   = mapped;
+        auto offset = internal_offset_byte;
+        loader      = [file, offset, record_size](size_t first, size_t n) {
+            size_t chunk_offset = offset + first * record_size * size_of_double;
+            size_t chunk_bytes  = n * record_size * size_of_double;
+
+            auto chunk = std::make_unique<EphemerisChunk>();
+            const double* data = file->at<double>(chunk_offset);
+            copy_mid_and_radius(data, record_size, n, *chunk);
+            chunk->coeff   = data + 2;
+            chunk->records = std::shared_ptr<const void>(
+                data, [file, chunk_offset, chunk_bytes](const void*) {
+                    file->release(chunk_offset, chunk_bytes);
+                });
+            return chunk;
+        };
+    } else {
+        std::error_code ec;
+        if ((fs::file_size(path, ec) < internal_offset_byte + n_bytes) || ec) {
+            LOG_S(ERROR) << path << ": " << std::to_string(int(code));
+            LOG_S(ERROR) << "Element records out of bounds.";
+            return {};
+        }
+
+        const size_t per_line = arena_alignment / size_of_double;
+        eph.stride = (n_values + per_line - 1) / per_line * per_line;
+
+        auto file   = path;
+        auto offset = internal_offset_byte;
+        auto stride = eph.stride;
+        loader      = [file, offset, record_size, n_values, stride](
+                     size_t first, size_t n) {
+            // One read for the whole chunk, rather than one per record
+            dbl_vec_t     buf(n * record_size);
+            std::ifstream nasa_spk_file(file, std::ios::binary);
+            nasa_spk_file.seekg(offset + first * record_size * size_of_double);
+            nasa_spk_file.read((char*)buf.data(), buf.size() * size_of_double);
+            if (!nasa_spk_file) {
+                LOG_S(ERROR) << file << ": Could not read element records.";
+                return std::unique_ptr<EphemerisChunk>();
+            }
+
+            auto chunk = std::make_unique<EphemerisChunk>();
+            copy_mid_and_radius(buf.data(), record_size, n, *chunk);
+
+            auto arena = make_arena(n * stride);
+            for (size_t i = 0; i < n; i++) {
+                std::copy_n(
+                    buf.data() + i * record_size + 2,
+                    n_values,
+                    arena.get() + i * stride);
+            }
+            chunk->coeff   = arena.get();
+            chunk->records = arena;
+            return chunk;
+        };
     }
+    eph.records = std::make_shared<EphemerisRecords>(
+        n_records, eph.stride, loader);
 
     DLOG_S(INFO) << "Ephemeris for " << summary.target_id << ": " << n_coeff - 1
-                 << " order polynomial, " << eph.elements.size()
+                 << " order polynomial, " << eph.size()
                  << " elements, ";
 
     return eph;
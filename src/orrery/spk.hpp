@@ -10,15 +10,21 @@ chebyshev coefficients stored in the SPK/DAF file to compute vector positions
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <stdlib.h>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "chebyshev.hpp"
 #include "naifbody.hpp"
 #include "units.hpp"
 #include "v3d.hpp"
@@ -29,47 +35,134 @@ namespace fs = std::filesystem;
 
 typedef std::vector<double> dbl_vec_t;
 
-struct Elements {
-    J2000_s   t_mid;  // same as MID
-    J2000_s   t_half; // same as RADIUS
-    dbl_vec_t A;
-    size_t    off1, off2, off3;
+// A run of consecutive records. Record j of the chunk has MID t_mid[j], RADIUS
+// t_half[j] and its coefficients start at coeff + j * stride, laid out as
+// X[n_coeff], Y[n_coeff], Z[n_coeff] followed, for Type III, by the velocity
+// coefficients.
+struct EphemerisChunk {
+    dbl_vec_t     t_mid;
+    dbl_vec_t     t_half;
+    const double* coeff;
+
+    // Memory the coefficients live in: the memory mapped kernel (stride is then
+    // the SPK record size and we skip over MID and RADIUS) or an aligned heap
+    // copy where each record starts on a cache line
+    std::shared_ptr<const void> records;
+};
+
+// The records for the epoch we are interested in, loaded a chunk at a time the
+// first time they are needed. A run only ever looks at a short stretch of time
+// at once, so we also drop the chunks it has moved past and what we hold on to
+// tracks a window around the current time rather than the whole epoch.
+//
+// Chunks can be loaded from any number of threads, but release_before should
+// only be called while no one is evaluating the ephemeris.
+class EphemerisRecords {
+public:
+    static constexpr size_t chunk_records = 64;
+
+    // Load records [first, first + n), or return null if they can't be read
+    typedef std::function<std::unique_ptr<EphemerisChunk>(
+        size_t first, size_t n)>
+        Loader;
+
+    // stride is the distance, in doubles, between records in a chunk
+    EphemerisRecords(size_t n_records, size_t stride, Loader loader);
+
+    size_t size() const { return n_records; }
+
+    // A chunk could not be loaded. Its records evaluate to NaN, so whoever
+    // asked for them has to check this before using what they got
+    bool failed() const { return load_failed.load(std::memory_order_acquire); }
 
-    void   read(std::ifstream& nasa_spk_file, int n_coeff, int data_type);
-    double cheby_eval_one(double t, size_t i0, size_t i1) const
+    const EphemerisChunk& chunk(size_t c) const
     {
-        // https://en.wikipedia.org/wiki/Clenshaw_algorithm#Special_case_for_Chebyshev_series
-        double x  = (t - t_mid) / t_half;
-        double x2 = 2 * x;
-        double Tn, Tn_1 = x, Tn_2 = 1.0;
-        double b = A[i0] * Tn_2 + A[i0 + 1] * Tn_1;
-        for (size_t i = i0 + 2; i < i1; i++) {
-            Tn = x2 * Tn_1 - Tn_2;
-            b += Tn * A[i];
-            Tn_2 = Tn_1;
-            Tn_1 = Tn;
-        }
-        return b;
+        auto p = loaded[c].load(std::memory_order_acquire);
+        return p ? *p : load(c);
     }
-};
 
-typedef std::vector<Elements> elem_vec_t;
+    // Drop the chunks before chunk c
+    void release_before(size_t c);
+
+    // Number of chunks held
+    size_t resident() const;
+
+private:
+    const EphemerisChunk& load(size_t c) const;
+
+    const size_t n_records;
+    const size_t stride;
+    const Loader loader;
+
+    mutable std::atomic<bool>                                    load_failed{};
+    mutable std::mutex                                           mutex;
+    mutable std::unique_ptr<std::atomic<const EphemerisChunk*>[]> loaded;
+    mutable std::vector<std::unique_ptr<EphemerisChunk>>          owned;
+};
 
 struct Ephemeris {
-    int        target_code; // NASA/JPL code for this body
-    int        center_code; // NASA/JPL code for reference body
-    J2000_s    begin_s;     // Start time
-    J2000_s    interval_s;  // Length of interval
-    elem_vec_t elements; // coefficients for just the epoch we are interested in
+    int     target_code; // NASA/JPL code for this body
+    int     center_code; // NASA/JPL code for reference body
+    J2000_s begin_s;     // Start time
+    J2000_s interval_s;  // Length of interval
+    size_t  n_coeff;     // Coefficients per axis (polynomial order + 1)
+    size_t  stride;      // Distance, in doubles, between records in a chunk
+    bool    has_vel;     // Type III: records carry velocity coefficients
+
+    std::shared_ptr<EphemerisRecords> records;
+
+    size_t size() const { return records->size(); }
+    bool   failed() const { return records->failed(); }
+
+    // MID, RADIUS and coefficients of record i
+    struct Record {
+        double        t_mid;
+        double        t_half;
+        const double* coeff;
+    };
+    Record record(size_t i) const
+    {
+        const auto& c = records->chunk(i / EphemerisRecords::chunk_records);
+        size_t      j = i % EphemerisRecords::chunk_records;
+        return { c.t_mid[j], c.t_half[j], c.coeff + j * stride };
+    }
 
-    void eval(double t, V3d& pos) const
+    // Let go of the records that end before t
+    void release_before(double t)
     {
-        const auto& element = elements[std::floor((t - begin_s) / interval_s)];
+        size_t i = std::max(0.0, std::floor((t - begin_s) / interval_s));
+        records->release_before(i / EphemerisRecords::chunk_records);
+    }
 
-        pos.x = element.cheby_eval_one(t, 0, element.off1);
-        pos.y = element.cheby_eval_one(t, element.off1, element.off2);
-        pos.z = element.cheby_eval_one(t, element.off2, element.off3);
+    void eval(double t, V3d& pos) const
+    {
+        size_t i = std::floor((t - begin_s) / interval_s);
+        auto   r = record(i);
+        double x = (t - r.t_mid) / r.t_half;
+
+        double xyz[3];
+        cheby_eval_xyz(r.coeff, n_coeff, x, xyz);
+        pos.x = xyz[0];
+        pos.y = xyz[1];
+        pos.z = xyz[2];
     }
+
+    // Position, velocity and acceleration. For Type II the velocity and
+    // acceleration come from differentiating the position series. For Type III
+    // we have the velocity series and differentiate that for the acceleration
+    void eval(double t, V3d& pos, V3d& vel, V3d& acc) const;
+
+    // Evaluate at t0, t0 + dt, ... and write to pos[0], pos[out_stride], ...
+    // and likewise for vel and acc. Times that fall in the same record are
+    // evaluated together
+    void eval_over(
+        double t0,
+        double dt,
+        size_t n,
+        V3d*   pos,
+        V3d*   vel,
+        V3d*   acc,
+        size_t out_stride) const;
 };
 
 typedef std::vector<Ephemeris> ephem_vec_t;
@@ -91,15 +184,24 @@ struct Summary {
 
 typedef std::unordered_map<NAIFbody, Summary> sumry_map_t;
 
+class MappedFile;
+
 struct SpkFile {
+    // MMAP looks at the kernel in place and falls back to STREAM (reading
+    // records into memory through std::ifstream) if the file can't be mapped
+    enum Access { MMAP = 0, STREAM };
+
     fs::path    path;
     std::string comment;
     sumry_map_t summaries;
 
+    std::shared_ptr<const MappedFile> mapped; // null when using STREAM
+
     std::optional<Ephemeris>
     load_ephemeris(NAIFbody code, J2000_s begin, J2000_s end_s) const;
 
-    static std::optional<SpkFile> load(const fs::path& path);
+    static std::optional<SpkFile>
+    load(const fs::path& path, Access access = Access::MMAP);
 };
 
 typedef std::vector<SpkFile> spk_vec_t;
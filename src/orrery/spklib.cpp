@@ -5,6 +5,8 @@ Copyright (c) 2018-2020 by Kaushik Ghose. Some rights reserved, see LICENSE
 Low level functions and data structures to load data from a SPK file
 */
 
+#include <cstring>
+
 #include "spklib.hpp"
 
 #define LOGURU_WITH_STREAMS 1
@@ -12,6 +14,8 @@ Low level functions and data structures to load data from a SPK file
 
 namespace groho {
 
+static std::optional<FileRecord> check_file_record(const FileRecord& hdr);
+
 // Read the file header record
 std::optional<FileRecord> read_file_record(std::ifstream& nasa_spk_file)
 {
@@ -19,7 +23,27 @@ std::optional<FileRecord> read_file_record(std::ifstream& nasa_spk_file)
 
     nasa_spk_file.seekg(0);
     nasa_spk_file.read((char*)&hdr, sizeof(hdr));
+    if (!nasa_spk_file) {
+        LOG_S(ERROR) << "File too short to be a DAF file.";
+        return {};
+    }
+
+    return check_file_record(hdr);
+}
+
+std::optional<FileRecord> read_file_record(const MappedFile& nasa_spk_file)
+{
+    FileRecord hdr;
+    if (!nasa_spk_file.read(0, hdr)) {
+        LOG_S(ERROR) << "File too short to be a DAF file.";
+        return {};
+    }
+
+    return check_file_record(hdr);
+}
 
+static std::optional<FileRecord> check_file_record(const FileRecord& hdr)
+{
     if (integrity_check_template.compare(hdr.integrity_string) != 0) {
         LOG_S(ERROR) << "Header integrity check fail.";
         return {};
@@ -47,6 +71,9 @@ std::optional<FileRecord> read_file_record(std::ifstream& nasa_spk_file)
 // with \n and \4 with \0 at which point we have the whole comment and can stop.
 // Considering we don't have any use for the comment string, this was really not
 // necessary and done more out of a desire to be completionist.
+static bool append_comment_block(char (&buf)[block_size], std::string& comment);
+static std::string trim_comment(const std::string& comment);
+
 std::string
 read_comment_blocks(std::ifstream& nasa_spk_file, std::optional<FileRecord> hdr)
 {
@@ -59,19 +86,56 @@ read_comment_blocks(std::ifstream& nasa_spk_file, std::optional<FileRecord> hdr)
     for (size_t i = 2; i < hdr->first_summary_block; i++) {
         char buf[block_size];
         nasa_spk_file.read(buf, block_size);
-        for (size_t j = 0; j < 1000; j++) {
-            if (buf[j] == '\0') {
-                buf[j] = '\n';
-            } else {
-                if (buf[j] == '\4') {
-                    buf[j] = '\0';
-                    break;
-                }
+        if (append_comment_block(buf, comment)) {
+            break;
+        }
+    }
+
+    return trim_comment(comment);
+}
+
+std::string read_comment_blocks(
+    const MappedFile& nasa_spk_file, std::optional<FileRecord> hdr)
+{
+    if (!hdr) {
+        return "";
+    }
+
+    std::string comment;
+    for (size_t i = 2; i < hdr->first_summary_block; i++) {
+        char buf[block_size];
+        if (!nasa_spk_file.read((i - 1) * block_size, buf)) {
+            break;
+        }
+        if (append_comment_block(buf, comment)) {
+            break;
+        }
+    }
+
+    return trim_comment(comment);
+}
+
+// Returns true if this was the last block of the comment
+static bool append_comment_block(char (&buf)[block_size], std::string& comment)
+{
+    bool done = false;
+    for (size_t j = 0; j < 1000; j++) {
+        if (buf[j] == '\0') {
+            buf[j] = '\n';
+        } else {
+            if (buf[j] == '\4') {
+                buf[j] = '\0';
+                done   = true;
+                break;
             }
         }
-        comment += buf;
     }
+    comment.append(buf, done ? std::strlen(buf) : 1000);
+    return done;
+}
 
+static std::string trim_comment(const std::string& comment)
+{
     const auto strEnd   = comment.find_last_not_of(" \n");
     const auto strRange = strEnd + 1;
 
@@ -112,6 +176,47 @@ sumry_map_t read_summaries(
     return sv;
 }
 
+sumry_map_t read_summaries(
+    const MappedFile& nasa_spk_file, std::optional<const FileRecord> hdr)
+{
+    SummaryRecordBlockHeader srbh;
+    sumry_map_t              sv;
+
+    if (!hdr) {
+        return sv;
+    }
+
+    size_t summaries_read = 0;
+    size_t offset         = block_size * (hdr->first_summary_block - 1);
+
+    for (;;) {
+        if (!nasa_spk_file.read(offset, srbh)) {
+            LOG_S(ERROR) << "Summary record block out of bounds.";
+            break;
+        }
+        offset += sizeof(srbh);
+
+        DLOG_S(INFO) << "Summary record block#" << ++summaries_read;
+        for (size_t j = 0; j < srbh.n_summaries; j++) {
+            Summary es;
+            if (!nasa_spk_file.read(offset, es)) {
+                LOG_S(ERROR) << "Summary out of bounds.";
+                return sv;
+            }
+            offset += sizeof(es);
+            sv[es.target_id] = es;
+            DLOG_S(INFO) << "Summary " << j + 1 << "/" << srbh.n_summaries;
+        }
+
+        if (srbh.next_summary_record_blk == 0)
+            break;
+
+        offset = block_size * (srbh.next_summary_record_blk - 1);
+    }
+
+    return sv;
+}
+
 ElementRecordMetadata
 read_element_record_metadata(std::ifstream& nasa_spk_file, const Summary& s)
 {
@@ -120,4 +225,14 @@ read_element_record_metadata(std::ifstream& nasa_spk_file, const Summary& s)
     nasa_spk_file.read((char*)&erm, sizeof(erm));
     return erm;
 }
+
+std::optional<ElementRecordMetadata> read_element_record_metadata(
+    const MappedFile& nasa_spk_file, const Summary& s)
+{
+    ElementRecordMetadata erm;
+    if (!nasa_spk_file.read((s.end_i - 4) * 8, erm)) {
+        return {};
+    }
+    return erm;
+}
 }
\ No newline at end of file
@@ -11,6 +11,7 @@ Low level functions and data structures to load data from a SPK file
 #include <optional>
 #include <stdlib.h>
 
+#include "mappedfile.hpp"
 #include "spk.hpp"
 
 namespace groho {
@@ -56,12 +57,15 @@ struct FileRecord {
 } __attribute__((__packed__));
 
 std::optional<FileRecord> read_file_record(std::ifstream& nasa_spk_file);
+std::optional<FileRecord> read_file_record(const MappedFile& nasa_spk_file);
 
 // There is usually a comments section after this which is free form, taking
 // one or more 1024 byte blocks.
 
 std::string read_comment_blocks(
     std::ifstream& nasa_spk_file, std::optional<FileRecord> hdr);
+std::string read_comment_blocks(
+    const MappedFile& nasa_spk_file, std::optional<FileRecord> hdr);
 
 // The comment records are followed by summary records.
 // Blocks of summary records are chained like a linked list with each block
@@ -112,6 +116,8 @@ struct SummaryRecordBlockHeader {
 
 sumry_map_t read_summaries(
     std::ifstream& nasa_spk_file, std::optional<const FileRecord> hdr);
+sumry_map_t read_summaries(
+    const MappedFile& nasa_spk_file, std::optional<const FileRecord> hdr);
 
 // At the end of the set of element records is a footer carrying some
 // metadata for that block of element records
@@ -124,5 +130,7 @@ struct ElementRecordMetadata {
 
 ElementRecordMetadata
 read_element_record_metadata(std::ifstream& nasa_spk_file, const Summary& s);
+std::optional<ElementRecordMetadata> read_element_record_metadata(
+    const MappedFile& nasa_spk_file, const Summary& s);
 
 }
\ No newline at end of file
@@ -0,0 +1,302 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include "bodyconstant.hpp"
+#include "spklib.hpp"
+#include "syntheticspk.hpp"
+
+#define LOGURU_WITH_STREAMS 1
+#include "loguru.hpp"
+
+namespace groho {
+
+const double AU_km               = 149597870.7;
+const double synthetic_GM        = 1.3271244004193938E+11; // the Sun's
+const size_t summaries_per_block = 25; // (128 - 3) doubles, 5 per summary
+
+static double kepler_period(double a)
+{
+    return 2 * M_PI * std::sqrt(a * a * a / synthetic_GM);
+}
+
+// Fractional parts of k * alpha, for an even spread of the asteroids' orbits
+static double spread(size_t k, double alpha)
+{
+    double v = k * alpha;
+    return v - std::floor(v);
+}
+
+// (x, y) in the plane of the orbit to (x, y, z)
+V3d orient(const SyntheticBody& b, double x, double y, double t)
+{
+    double ci = std::cos(b.inclination), si = std::sin(b.inclination);
+    double cn = std::cos(b.node), sn = std::sin(b.node);
+    double yi = y * ci;
+    return { x * cn - yi * sn, x * sn + yi * cn, y * si, t };
+}
+
+V3d SyntheticBody::pos(double t) const
+{
+    double theta = phase + 2 * M_PI * t / period;
+    return orient(
+        *this, radius * std::cos(theta), radius * std::sin(theta), t);
+}
+
+V3d SyntheticBody::vel(double t) const
+{
+    double w     = 2 * M_PI / period;
+    double theta = phase + w * t;
+    return orient(
+        *this, -radius * w * std::sin(theta), radius * w * std::cos(theta), t);
+}
+
+std::vector<SyntheticBody> synthetic_bodies(size_t n)
+{
+    const double planet_a[]
+        = { 0.387, 0.723, 1.000, 1.524, 5.203, 9.537, 19.19, 30.07, 39.48 };
+    const double month = 27.321661 * 86400;
+
+    std::vector<SyntheticBody> bodies;
+    auto add = [&](const SyntheticBody& b) {
+        if (bodies.size() < n) {
+            bodies.push_back(b);
+        }
+    };
+
+    // The Sun wobbles about the SSB, mostly because of Jupiter
+    add({ 10, 0, 7.4e5, kepler_period(5.203 * AU_km), 0, 0, 0 });
+    for (int i = 1; i <= 9; i++) {
+        double a = planet_a[i - 1] * AU_km;
+        add({ i, 0, a, kepler_period(a), 2.4 * i, 0.02 * i, 0.7 * i });
+    }
+    for (int i = 1; i <= 9; i++) {
+        add({ 100 * i + 99, i, 4671, month, 1.3 * i, 0.1, 0.5 * i });
+    }
+    add({ 301, 3, 384400, month, 1.3 * 3 + M_PI, 0.1, 0.5 * 3 });
+
+    for (size_t k = 0; bodies.size() < n; k++) {
+        double a = (2.1 + 1.2 * spread(k, 0.6180339887498949)) * AU_km;
+        add({ int(2000001 + k),
+              10,
+              a,
+              kepler_period(a),
+              2 * M_PI * spread(k, 0.4142135623730951),
+              0.3 * spread(k, 0.7320508075688772),
+              2 * M_PI * spread(k, 0.2360679774997897) });
+    }
+    return bodies;
+}
+
+// The Chebyshev series through f at the n_coeff Chebyshev nodes of the record
+// interpolates f about as well as the best fit of that degree would
+class ChebyshevFit {
+public:
+    explicit ChebyshevFit(size_t n)
+        : n(n)
+        , node(n)
+        , basis(n * n)
+    {
+        for (size_t j = 0; j < n; j++) {
+            node[j] = std::cos(M_PI * (j + 0.5) / n);
+            for (size_t k = 0; k < n; k++) {
+                basis[k * n + j] = std::cos(M_PI * k * (j + 0.5) / n);
+            }
+        }
+    }
+
+    // Coefficients for f at the nodes, to A[n]
+    void operator()(const double* f, double* A) const
+    {
+        for (size_t k = 0; k < n; k++) {
+            double c = 0;
+            for (size_t j = 0; j < n; j++) {
+                c += f[j] * basis[k * n + j];
+            }
+            A[k] = c * (k == 0 ? 1.0 : 2.0) / n;
+        }
+    }
+
+    const size_t        n;
+    std::vector<double> node;
+
+private:
+    std::vector<double> basis;
+};
+
+// One segment: the records, then INIT, INTLEN, RSIZE, N
+static void synthetic_segment(
+    const SyntheticBody&   body,
+    const SyntheticKernel& kernel,
+    size_t                 n_records,
+    const ChebyshevFit&    fit,
+    std::vector<double>&   data)
+{
+    const size_t n      = kernel.n_coeff;
+    const size_t n_axes = kernel.data_type == 3 ? 6 : 3;
+    const size_t rsize  = 2 + n_axes * n;
+    const double t_half = kernel.record_s / 2;
+
+    data.resize(n_records * rsize + 4);
+    std::vector<double> f(n_axes * n);
+    for (size_t r = 0; r < n_records; r++) {
+        double* rec   = data.data() + r * rsize;
+        double  t_mid = kernel.begin + (r + 0.5) * kernel.record_s;
+        for (size_t j = 0; j < n; j++) {
+            double t = t_mid + t_half * fit.node[j];
+            V3d    p = body.pos(t);
+
+            f[0 * n + j] = p.x;
+            f[1 * n + j] = p.y;
+            f[2 * n + j] = p.z;
+            if (n_axes == 6) {
+                V3d v        = body.vel(t);
+                f[3 * n + j] = v.x;
+                f[4 * n + j] = v.y;
+                f[5 * n + j] = v.z;
+            }
+        }
+        rec[0] = t_mid;
+        rec[1] = t_half;
+        for (size_t a = 0; a < n_axes; a++) {
+            fit(f.data() + a * n, rec + 2 + a * n);
+        }
+    }
+
+    double* footer = data.data() + n_records * rsize;
+    footer[0]      = kernel.begin;
+    footer[1]      = kernel.record_s;
+    footer[2]      = rsize;
+    footer[3]      = n_records;
+}
+
+// Text records are blank padded
+static void copy_padded(char* dst, size_t size, const std::string& src)
+{
+    std::memset(dst, ' ', size);
+    std::memcpy(dst, src.data(), std::min(size, src.size()));
+}
+
+bool write_synthetic_spk(const fs::path& path, const SyntheticKernel& kernel)
+{
+    if ((kernel.bodies == 0) || (kernel.n_coeff < 2)
+        || ((kernel.data_type != 2) && (kernel.data_type != 3))
+        || !(kernel.record_s > 0) || !(kernel.end > kernel.begin)) {
+        LOG_S(ERROR) << path << ": Synthetic kernel needs bodies, at least two "
+                     << "coefficients, type 2 or 3 and a time span";
+        return false;
+    }
+
+    const auto   bodies = synthetic_bodies(kernel.bodies);
+    const size_t n_records
+        = std::ceil((kernel.end - kernel.begin) / kernel.record_s);
+    const size_t rsize
+        = 2 + (kernel.data_type == 3 ? 6 : 3) * kernel.n_coeff;
+    const size_t segment = n_records * rsize + 4;
+
+    // File record, a comment record, then each block of summaries followed by
+    // its block of names, then the segments
+    const size_t doubles_per_block = block_size / size_of_double;
+    const size_t n_summary_blocks
+        = (bodies.size() + summaries_per_block - 1) / summaries_per_block;
+    const size_t first_address
+        = (2 + 2 * n_summary_blocks) * doubles_per_block + 1;
+    const size_t free_address = first_address + bodies.size() * segment;
+    if (free_address > std::numeric_limits<u_int32_t>::max()) {
+        LOG_S(ERROR) << path << ": Synthetic kernel too large for a DAF file";
+        return false;
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        LOG_S(ERROR) << "Could not open " << path << " for writing.";
+        return false;
+    }
+
+    FileRecord hdr = {};
+    std::memcpy(hdr.file_architecture, "DAF/SPK ", 8);
+    hdr.n_double_precision = 2;
+    hdr.n_integers         = 6;
+    copy_padded(hdr.internal_name, sizeof(hdr.internal_name), "GROHO SYNTH");
+    hdr.first_summary_block = 3;
+    hdr.last_summary_block  = 3 + 2 * (n_summary_blocks - 1);
+    hdr.first_free_address  = free_address;
+    std::memcpy(hdr.numeric_format, "LTL-IEEE", 8);
+    const char ftp[] = "FTPSTR:\r:\n:\r\n:\r\x00:\x81:\x10\xce:ENDFTP";
+    std::memcpy(hdr.integrity_string, ftp, sizeof(hdr.integrity_string));
+    file.write((const char*)&hdr, sizeof(hdr));
+
+    char comment[block_size] = {};
+    std::string text         = "Synthetic ephemeris written by groho: "
+        + std::to_string(bodies.size()) + " bodies on circular orbits\4";
+    std::memcpy(comment, text.data(), text.size());
+    file.write(comment, block_size);
+
+    for (size_t b = 0; b < n_summary_blocks; b++) {
+        size_t first = b * summaries_per_block;
+        size_t n     = std::min(summaries_per_block, bodies.size() - first);
+
+        char summaries[block_size] = {};
+        char names[block_size];
+        std::memset(names, ' ', block_size);
+
+        SummaryRecordBlockHeader srbh;
+        srbh.next_summary_record_blk
+            = (b + 1 < n_summary_blocks) ? 3 + 2 * (b + 1) : 0;
+        srbh.prev_summary_record_blk = (b > 0) ? 3 + 2 * (b - 1) : 0;
+        srbh.n_summaries             = n;
+        std::memcpy(summaries, &srbh, sizeof(srbh));
+
+        for (size_t j = 0; j < n; j++) {
+            const auto& body = bodies[first + j];
+            size_t      i    = first_address + (first + j) * segment;
+
+            Summary s;
+            s.begin_second = kernel.begin;
+            s.end_second   = kernel.begin + n_records * kernel.record_s;
+            s.target_id    = int(body.code);
+            s.center_id    = int(body.center);
+            s.frame_id     = 1;
+            s.data_type    = kernel.data_type;
+            s.start_i      = i;
+            s.end_i        = i + segment - 1;
+            std::memcpy(
+                summaries + sizeof(srbh) + j * sizeof(Summary),
+                &s,
+                sizeof(s));
+            copy_padded(
+                names + j * sizeof(Summary),
+                sizeof(Summary),
+                get_body_name(body.code));
+        }
+        file.write(summaries, block_size);
+        file.write(names, block_size);
+    }
+
+    ChebyshevFit        fit(kernel.n_coeff);
+    std::vector<double> data;
+    for (const auto& body : bodies) {
+        synthetic_segment(body, kernel, n_records, fit, data);
+        file.write((const char*)data.data(), data.size() * sizeof(double));
+    }
+
+    size_t tail = (free_address - 1) % doubles_per_block;
+    if (tail > 0) {
+        std::vector<double> zeros(doubles_per_block - tail);
+        file.write((const char*)zeros.data(), zeros.size() * sizeof(double));
+    }
+
+    if (!file) {
+        LOG_S(ERROR) << "Error writing " << path;
+        return false;
+    }
+    return true;
+}
+
+}
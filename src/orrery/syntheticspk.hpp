@@ -0,0 +1,66 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Synthetic SPK kernels.
+
+The JPL kernels run to GBs and are not in the repository. For benchmarks and
+tests we write our own: a made-up solar system of bodies on circular orbits,
+fitted record by record with Chebyshev series, in a DAF/SPK file of Type II or
+III that loads like any other kernel.
+
+The bodies are taken, as many as asked for, in this order
+
+    10                  the Sun, about the SSB
+    1 - 9               barycenters, about the SSB, at the planets' distances
+    199 - 999           planets, about their barycenters
+    301                 the Moon, about the Earth barycenter
+    2000001, ...        asteroids, about the Sun, between 2.1 and 3.3 AU
+
+so a kernel of 20 bodies has the usual cast and the gravity field of a real
+one, and larger kernels add asteroids.
+*/
+
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+#include "naifbody.hpp"
+#include "units.hpp"
+#include "v3d.hpp"
+
+namespace groho {
+
+namespace fs = std::filesystem;
+
+struct SyntheticBody {
+    NAIFbody code;
+    NAIFbody center;
+    double   radius;      // km
+    double   period;      // s
+    double   phase;       // rad, at J2000
+    double   inclination; // rad, of the orbit to the xy plane
+    double   node;        // rad, where the orbit crosses the xy plane
+
+    // Exact position (km) and velocity (km/s) about the center at t
+    V3d pos(double t) const;
+    V3d vel(double t) const;
+};
+
+// The first n bodies of the synthetic solar system
+std::vector<SyntheticBody> synthetic_bodies(size_t n);
+
+struct SyntheticKernel {
+    size_t   bodies    = 20;
+    uint32_t data_type = 2;         // II: position, III: with velocity
+    size_t   n_coeff   = 12;        // per axis: polynomial degree + 1
+    double   record_s  = 8 * 86400; // time span of each record
+    J2000_s  begin     = GregorianDate{ 2000, 1, 1, 0 };
+    J2000_s  end       = GregorianDate{ 2050, 1, 1, 0 };
+};
+
+// Write the kernel. The segments cover at least [begin, end]
+bool write_synthetic_spk(const fs::path& path, const SyntheticKernel& kernel);
+
+}
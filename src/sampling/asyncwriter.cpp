@@ -0,0 +1,129 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <cstring> // gcc needs this for strerror
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "asyncwriter.hpp"
+
+#define LOGURU_WITH_STREAMS 1
+#include "loguru.hpp"
+
+namespace groho {
+
+static void write_now(
+    const fs::path&          path,
+    uint64_t                 offset,
+    const std::vector<char>& data,
+    bool                     truncate)
+{
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd == -1) {
+        LOG_S(ERROR) << path << ": " << std::strerror(errno);
+        return;
+    }
+
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = ::pwrite(
+            fd, data.data() + done, data.size() - done, offset + done);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_S(ERROR) << path << ": " << std::strerror(errno);
+            break;
+        }
+        done += n;
+    }
+
+    if (truncate && (::ftruncate(fd, offset + data.size()) == -1)) {
+        LOG_S(ERROR) << path << ": " << std::strerror(errno);
+    }
+    ::close(fd);
+}
+
+void write_at(
+    AsyncWriter*        writer,
+    const fs::path&     path,
+    uint64_t            offset,
+    std::vector<char>&& data,
+    bool                truncate)
+{
+    if (writer) {
+        writer->write(path, offset, std::move(data), truncate);
+    } else {
+        write_now(path, offset, data, truncate);
+    }
+}
+
+AsyncWriter::AsyncWriter(size_t max_queue_bytes)
+    : max_queue_bytes(max_queue_bytes)
+{
+    thread = std::thread(&AsyncWriter::writer_loop, this);
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    job_available.notify_one();
+    thread.join();
+}
+
+void AsyncWriter::write(
+    const fs::path&     path,
+    uint64_t            offset,
+    std::vector<char>&& data,
+    bool                truncate)
+{
+    size_t bytes = data.size();
+    {
+        // A job bigger than the whole queue still goes in once the queue is
+        // empty
+        std::unique_lock<std::mutex> lock(mutex);
+        job_done.wait(lock, [&]() {
+            return queue.empty()
+                || (queued_bytes + bytes <= max_queue_bytes);
+        });
+        queue.push_back({ path, offset, std::move(data), truncate });
+        queued_bytes += bytes;
+    }
+    job_available.notify_one();
+}
+
+void AsyncWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    job_done.wait(lock, [this]() { return queue.empty() && !busy; });
+}
+
+void AsyncWriter::writer_loop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        job_available.wait(lock, [this]() { return stop || !queue.empty(); });
+        if (queue.empty()) {
+            return; // stop, and everything is written
+        }
+
+        Job job = std::move(queue.front());
+        queue.pop_front();
+        busy = true;
+
+        lock.unlock();
+        write_now(job.path, job.offset, job.data, job.truncate);
+        lock.lock();
+
+        queued_bytes -= job.data.size();
+        busy = false;
+        job_done.notify_all();
+    }
+}
+
+}
@@ -0,0 +1,96 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+One thread that does all the writing to disk.
+
+The histories of every body hand their blocks of output, each with the file
+and offset it goes to, to a single writer. It puts them on a queue and a
+background thread writes them out, opening each file just for the write. So the
+simulation only waits on the disk if the queue fills up, and neither the
+threads nor the open files grow with the number of bodies.
+
+Writes to the same file are made in the order they were queued.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace groho {
+
+namespace fs = std::filesystem;
+
+class AsyncWriter {
+public:
+    static constexpr size_t default_queue_bytes = 64 << 20;
+
+    // The simulation waits when more than this much is waiting to be written
+    explicit AsyncWriter(size_t max_queue_bytes = default_queue_bytes);
+
+    // Writes out whatever is still queued
+    ~AsyncWriter();
+
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    // Write data at offset, creating the file if needed. With truncate the
+    // file is cut off after the data
+    void write(
+        const fs::path&     path,
+        uint64_t            offset,
+        std::vector<char>&& data,
+        bool                truncate = false);
+
+    // Wait until everything queued so far is on disk
+    void flush();
+
+private:
+    struct Job {
+        fs::path          path;
+        uint64_t          offset;
+        std::vector<char> data;
+        bool              truncate;
+    };
+
+    void writer_loop();
+
+    const size_t max_queue_bytes;
+
+    std::deque<Job> queue;
+    size_t          queued_bytes = 0;
+    bool            busy         = false; // a job is being written
+    bool            stop         = false;
+
+    std::mutex              mutex;
+    std::condition_variable job_available, job_done;
+
+    std::thread thread;
+};
+
+// Add the bytes of v[0 .. n) to a block of output
+template <typename T>
+void append(std::vector<char>& block, const T* v, size_t n)
+{
+    size_t at = block.size();
+    block.resize(at + n * sizeof(T));
+    std::memcpy(block.data() + at, v, n * sizeof(T));
+}
+
+// Write data at offset, through the writer if there is one, otherwise
+// straight away
+void write_at(
+    AsyncWriter*        writer,
+    const fs::path&     path,
+    uint64_t            offset,
+    std::vector<char>&& data,
+    bool                truncate = false);
+
+}
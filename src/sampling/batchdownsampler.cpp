@@ -0,0 +1,266 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <cmath>
+
+#include "batchdownsampler.hpp"
+#include "simd.hpp"
+
+#ifdef GROHO_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace groho {
+
+// The columns the kernels work on, and where the positions come from
+struct Columns {
+    double *      curve, *lx, *ly, *lz, *lt, *sx, *sy, *sz, *st;
+    const double *ratio, *linear;
+    const V3d*    pos;
+    const size_t* index;
+};
+
+// The sums are done in the same order as in FractalDownsampler, so that the
+// same samples come out, bit for bit
+static void downsample_scalar(
+    const Columns& c, size_t begin, size_t end, std::vector<size_t>& accepted)
+{
+    for (size_t i = begin; i < end; i++) {
+        const V3d& v  = c.pos[c.index[i]];
+        double     dx = v.x - c.lx[i], dy = v.y - c.ly[i], dz = v.z - c.lz[i];
+        double curve  = c.curve[i] + std::sqrt(dx * dx + dy * dy + dz * dz);
+
+        dx            = v.x - c.sx[i];
+        dy            = v.y - c.sy[i];
+        dz            = v.z - c.sz[i];
+        double linear = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+        c.lx[i] = v.x;
+        c.ly[i] = v.y;
+        c.lz[i] = v.z;
+        c.lt[i] = v.t;
+        if (((curve / linear) > c.ratio[i])
+            | (std::abs(curve - linear) > c.linear[i])) {
+            c.curve[i] = 0;
+            c.sx[i]    = v.x;
+            c.sy[i]    = v.y;
+            c.sz[i]    = v.z;
+            c.st[i]    = v.t;
+            accepted.push_back(i);
+        } else {
+            c.curve[i] = curve;
+        }
+    }
+}
+
+#ifdef GROHO_X86_SIMD
+
+static void
+downsample_sse2(const Columns& c, size_t n, std::vector<size_t>& accepted)
+{
+    const __m128d sign = _mm_set1_pd(-0.0);
+
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        // (x, y) and (z, t) of two bodies to columns
+        const V3d& p0  = c.pos[c.index[i]];
+        const V3d& p1  = c.pos[c.index[i + 1]];
+        __m128d    xy0 = _mm_loadu_pd(&p0.x), zt0 = _mm_loadu_pd(&p0.z);
+        __m128d    xy1 = _mm_loadu_pd(&p1.x), zt1 = _mm_loadu_pd(&p1.z);
+
+        __m128d vx = _mm_unpacklo_pd(xy0, xy1), vy = _mm_unpackhi_pd(xy0, xy1),
+                vz = _mm_unpacklo_pd(zt0, zt1), vt = _mm_unpackhi_pd(zt0, zt1);
+
+        __m128d dx = _mm_sub_pd(vx, _mm_loadu_pd(c.lx + i));
+        __m128d dy = _mm_sub_pd(vy, _mm_loadu_pd(c.ly + i));
+        __m128d dz = _mm_sub_pd(vz, _mm_loadu_pd(c.lz + i));
+        __m128d curve = _mm_add_pd(
+            _mm_loadu_pd(c.curve + i),
+            _mm_sqrt_pd(_mm_add_pd(
+                _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)),
+                _mm_mul_pd(dz, dz))));
+
+        __m128d sx = _mm_loadu_pd(c.sx + i), sy = _mm_loadu_pd(c.sy + i),
+                sz = _mm_loadu_pd(c.sz + i), st = _mm_loadu_pd(c.st + i);
+        dx             = _mm_sub_pd(vx, sx);
+        dy             = _mm_sub_pd(vy, sy);
+        dz             = _mm_sub_pd(vz, sz);
+        __m128d linear = _mm_sqrt_pd(_mm_add_pd(
+            _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)),
+            _mm_mul_pd(dz, dz)));
+
+        // Ordered compares, so a 0/0 is not accepted, as in the scalar code
+        __m128d accept = _mm_or_pd(
+            _mm_cmpgt_pd(
+                _mm_div_pd(curve, linear), _mm_loadu_pd(c.ratio + i)),
+            _mm_cmpgt_pd(
+                _mm_andnot_pd(sign, _mm_sub_pd(curve, linear)),
+                _mm_loadu_pd(c.linear + i)));
+
+        _mm_storeu_pd(c.lx + i, vx);
+        _mm_storeu_pd(c.ly + i, vy);
+        _mm_storeu_pd(c.lz + i, vz);
+        _mm_storeu_pd(c.lt + i, vt);
+        _mm_storeu_pd(c.curve + i, _mm_andnot_pd(accept, curve));
+
+        int mask = _mm_movemask_pd(accept);
+        if (mask == 0) {
+            continue;
+        }
+        auto pick = [accept](__m128d v, __m128d s) {
+            return _mm_or_pd(_mm_and_pd(accept, v), _mm_andnot_pd(accept, s));
+        };
+        _mm_storeu_pd(c.sx + i, pick(vx, sx));
+        _mm_storeu_pd(c.sy + i, pick(vy, sy));
+        _mm_storeu_pd(c.sz + i, pick(vz, sz));
+        _mm_storeu_pd(c.st + i, pick(vt, st));
+        for (size_t j = 0; j < 2; j++) {
+            if (mask & (1 << j)) {
+                accepted.push_back(i + j);
+            }
+        }
+    }
+    downsample_scalar(c, i, n, accepted);
+}
+
+GROHO_TARGET_AVX2 static void downsample_avx2(
+    const Columns& c, size_t n, std::vector<size_t>& accepted)
+{
+    const __m256d sign = _mm256_set1_pd(-0.0);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // Four (x, y, z, t) rows to columns
+        __m256d r0 = _mm256_loadu_pd(&c.pos[c.index[i]].x);
+        __m256d r1 = _mm256_loadu_pd(&c.pos[c.index[i + 1]].x);
+        __m256d r2 = _mm256_loadu_pd(&c.pos[c.index[i + 2]].x);
+        __m256d r3 = _mm256_loadu_pd(&c.pos[c.index[i + 3]].x);
+
+        __m256d t0 = _mm256_unpacklo_pd(r0, r1); // x0 x1 z0 z1
+        __m256d t1 = _mm256_unpackhi_pd(r0, r1); // y0 y1 t0 t1
+        __m256d t2 = _mm256_unpacklo_pd(r2, r3); // x2 x3 z2 z3
+        __m256d t3 = _mm256_unpackhi_pd(r2, r3); // y2 y3 t2 t3
+
+        __m256d vx = _mm256_permute2f128_pd(t0, t2, 0x20);
+        __m256d vy = _mm256_permute2f128_pd(t1, t3, 0x20);
+        __m256d vz = _mm256_permute2f128_pd(t0, t2, 0x31);
+        __m256d vt = _mm256_permute2f128_pd(t1, t3, 0x31);
+
+        // No FMA: the products are rounded as in the scalar code
+        __m256d dx    = _mm256_sub_pd(vx, _mm256_loadu_pd(c.lx + i));
+        __m256d dy    = _mm256_sub_pd(vy, _mm256_loadu_pd(c.ly + i));
+        __m256d dz    = _mm256_sub_pd(vz, _mm256_loadu_pd(c.lz + i));
+        __m256d curve = _mm256_add_pd(
+            _mm256_loadu_pd(c.curve + i),
+            _mm256_sqrt_pd(_mm256_add_pd(
+                _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+                _mm256_mul_pd(dz, dz))));
+
+        __m256d sx = _mm256_loadu_pd(c.sx + i), sy = _mm256_loadu_pd(c.sy + i),
+                sz = _mm256_loadu_pd(c.sz + i), st = _mm256_loadu_pd(c.st + i);
+        dx             = _mm256_sub_pd(vx, sx);
+        dy             = _mm256_sub_pd(vy, sy);
+        dz             = _mm256_sub_pd(vz, sz);
+        __m256d linear = _mm256_sqrt_pd(_mm256_add_pd(
+            _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+            _mm256_mul_pd(dz, dz)));
+
+        __m256d accept = _mm256_or_pd(
+            _mm256_cmp_pd(
+                _mm256_div_pd(curve, linear),
+                _mm256_loadu_pd(c.ratio + i),
+                _CMP_GT_OQ),
+            _mm256_cmp_pd(
+                _mm256_andnot_pd(sign, _mm256_sub_pd(curve, linear)),
+                _mm256_loadu_pd(c.linear + i),
+                _CMP_GT_OQ));
+
+        _mm256_storeu_pd(c.lx + i, vx);
+        _mm256_storeu_pd(c.ly + i, vy);
+        _mm256_storeu_pd(c.lz + i, vz);
+        _mm256_storeu_pd(c.lt + i, vt);
+        _mm256_storeu_pd(c.curve + i, _mm256_andnot_pd(accept, curve));
+
+        int mask = _mm256_movemask_pd(accept);
+        if (mask == 0) {
+            continue;
+        }
+        _mm256_storeu_pd(c.sx + i, _mm256_blendv_pd(sx, vx, accept));
+        _mm256_storeu_pd(c.sy + i, _mm256_blendv_pd(sy, vy, accept));
+        _mm256_storeu_pd(c.sz + i, _mm256_blendv_pd(sz, vz, accept));
+        _mm256_storeu_pd(c.st + i, _mm256_blendv_pd(st, vt, accept));
+        for (size_t j = 0; j < 4; j++) {
+            if (mask & (1 << j)) {
+                accepted.push_back(i + j);
+            }
+        }
+    }
+    downsample_scalar(c, i, n, accepted);
+}
+
+#endif
+
+size_t BatchDownsampler::add(const FractalDownsampler& sampler)
+{
+    curve.push_back(sampler.cumulative_curve_dist);
+    lx.push_back(sampler.last_v.x);
+    ly.push_back(sampler.last_v.y);
+    lz.push_back(sampler.last_v.z);
+    lt.push_back(sampler.last_v.t);
+    sx.push_back(sampler.last_sample_v.x);
+    sy.push_back(sampler.last_sample_v.y);
+    sz.push_back(sampler.last_sample_v.z);
+    st.push_back(sampler.last_sample_v.t);
+    ratio.push_back(sampler.ratio_threshold);
+    linear.push_back(sampler.linear_threshold);
+    return curve.size() - 1;
+}
+
+FractalDownsampler BatchDownsampler::get(size_t i) const
+{
+    FractalDownsampler sampler(ratio[i], linear[i]);
+    sampler.cumulative_curve_dist = curve[i];
+    sampler.last_v                = { lx[i], ly[i], lz[i], lt[i] };
+    sampler.last_sample_v         = { sx[i], sy[i], sz[i], st[i] };
+    return sampler;
+}
+
+void BatchDownsampler::operator()(
+    const v3d_vec_t&           pos,
+    const std::vector<size_t>& index,
+    std::vector<size_t>&       accepted)
+{
+    const size_t n = size();
+    Columns      c = { curve.data(), lx.data(),    ly.data(),
+                  lz.data(),    lt.data(),    sx.data(),
+                  sy.data(),    sz.data(),    st.data(),
+                  ratio.data(), linear.data(), pos.data(),
+                  index.data() };
+
+    accepted.clear();
+    switch (simd_level()) {
+#ifdef GROHO_X86_SIMD
+    case SimdLevel::AVX2:
+        downsample_avx2(c, n, accepted);
+        return;
+    case SimdLevel::SSE2:
+        downsample_sse2(c, n, accepted);
+        return;
+#endif
+    default:
+        downsample_scalar(c, 0, n, accepted);
+    }
+}
+
+bool BatchDownsampler::flush(size_t i, V3d& v) const
+{
+    if (curve[i] != 0) {
+        v = { lx[i], ly[i], lz[i], lt[i] };
+        return true;
+    }
+    return false;
+}
+
+}
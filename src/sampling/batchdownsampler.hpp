@@ -0,0 +1,49 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+The fractal downsamplers of all the bodies, run together.
+
+Each step every body's downsampler does the same few sums on its own position.
+Here their state is held as columns, one element per body, so a step is a
+straight run down the columns with SIMD. Every body accepts exactly the samples
+its own FractalDownsampler would.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "fractaldownsampler.hpp"
+#include "v3d.hpp"
+
+namespace groho {
+
+class BatchDownsampler {
+public:
+    // Add a downsampler, in whatever state it is in. Returns its index
+    size_t add(const FractalDownsampler& sampler);
+
+    // The state of downsampler i, as a FractalDownsampler
+    FractalDownsampler get(size_t i) const;
+
+    size_t size() const { return curve.size(); }
+
+    // Downsampler i looks at pos[index[i]]. The indexes of those that take
+    // the sample are put in accepted, in order
+    void operator()(
+        const v3d_vec_t&           pos,
+        const std::vector<size_t>& index,
+        std::vector<size_t>&       accepted);
+
+    // As FractalDownsampler::flush
+    bool flush(size_t i, V3d& v) const;
+
+private:
+    std::vector<double> curve;          // cumulative curve distance
+    std::vector<double> lx, ly, lz, lt; // last position
+    std::vector<double> sx, sy, sz, st; // last sample
+    std::vector<double> ratio, linear;  // thresholds
+};
+
+}
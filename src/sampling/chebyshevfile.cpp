@@ -0,0 +1,399 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "chebyshev.hpp"
+#include "chebyshevfile.hpp"
+
+#define LOGURU_WITH_STREAMS 1
+#include "loguru.hpp"
+
+namespace groho {
+
+// The least squares fit is made to at most this many of the samples, spread
+// evenly over the run. A series of n_coeff terms is pinned down well by these
+// and the fit then costs the same however long the run. Every sample is checked
+// against the tolerance
+const size_t max_fit_points = 8 * ChebyshevWriter::n_coeff;
+
+const size_t record_size = 2 + 3 * ChebyshevWriter::n_coeff;
+
+static bool read_header(std::ifstream& file, ChebyshevHeader& header)
+{
+    file.read((char*)&header, sizeof(header));
+    return file
+        && (std::memcmp(header.magic, ChebyshevHeader::magic_value, 8) == 0);
+}
+
+bool is_chebyshev_trajectory(const fs::path& path)
+{
+    ChebyshevHeader header;
+    std::ifstream   file(path, std::ios::binary);
+    return read_header(file, header);
+}
+
+std::optional<ChebyshevTrajectory>
+read_chebyshev_trajectory(const fs::path& path)
+{
+    std::error_code ec;
+    uint64_t        size = fs::file_size(path, ec);
+    std::ifstream   file(path, std::ios::binary);
+    if (ec || !file) {
+        LOG_S(ERROR) << "Could not open " << path;
+        return {};
+    }
+
+    ChebyshevHeader header;
+    if (!read_header(file, header)) {
+        LOG_S(ERROR) << path << ": Not a Chebyshev trajectory file";
+        return {};
+    }
+    if (header.version != ChebyshevHeader::current_version) {
+        LOG_S(ERROR) << path << ": Chebyshev trajectory file version "
+                     << header.version << ", expected "
+                     << ChebyshevHeader::current_version;
+        return {};
+    }
+    if ((header.n_coeff == 0) || (header.n_coeff > max_cheby_coeff)) {
+        LOG_S(ERROR) << path << ": " << header.n_coeff
+                     << " coefficients per axis is more than we can handle";
+        return {};
+    }
+
+    ChebyshevTrajectory trajectory;
+    trajectory.code      = header.code;
+    trajectory.n_coeff   = header.n_coeff;
+    trajectory.tolerance = header.tolerance;
+
+    size_t record_bytes = trajectory.record_size() * sizeof(double);
+    size_t n            = (size - sizeof(header)) / record_bytes;
+    trajectory.records.resize(n * trajectory.record_size());
+    file.read((char*)trajectory.records.data(), n * record_bytes);
+    if (!file) {
+        LOG_S(ERROR) << path << ": Could not read records";
+        return {};
+    }
+    return trajectory;
+}
+
+std::optional<size_t> chebyshev_records(const fs::path& path)
+{
+    std::error_code ec;
+    uint64_t        size = fs::file_size(path, ec);
+    std::ifstream   file(path, std::ios::binary);
+    ChebyshevHeader header;
+    if (ec || !read_header(file, header) || (header.n_coeff == 0)) {
+        return {};
+    }
+    size_t record_bytes = (2 + 3 * header.n_coeff) * sizeof(double);
+    return (size - sizeof(header)) / record_bytes;
+}
+
+double ChebyshevTrajectory::t_begin() const { return records[0] - records[1]; }
+
+double ChebyshevTrajectory::t_end() const
+{
+    const double* last = records.data() + (size() - 1) * record_size();
+    return last[0] + last[1];
+}
+
+V3d ChebyshevTrajectory::at(double t) const
+{
+    // The last record that starts at or before t
+    size_t lo = 0, hi = size();
+    while (hi - lo > 1) {
+        size_t        mid    = (lo + hi) / 2;
+        const double* record = records.data() + mid * record_size();
+        if (record[0] - record[1] <= t) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    const double* record = records.data() + lo * record_size();
+    double        x      = (record[1] > 0) ? (t - record[0]) / record[1] : 0;
+    double        xyz[3];
+    cheby_eval_xyz(record + 2, n_coeff, x, xyz);
+    return { xyz[0], xyz[1], xyz[2], t };
+}
+
+ChebyshevWriter::ChebyshevWriter(
+    const fs::path& path,
+    NAIFbody        code,
+    double          tolerance,
+    AsyncWriter*    writer)
+    : path(path)
+    , writer(writer)
+    , tolerance(tolerance)
+{
+    start_file(code);
+}
+
+ChebyshevWriter::ChebyshevWriter(
+    const fs::path&  path,
+    NAIFbody         code,
+    double           tolerance,
+    size_t           n,
+    const v3d_vec_t& pending,
+    AsyncWriter*     writer)
+    : path(path)
+    , writer(writer)
+    , tolerance(tolerance)
+{
+    // Whatever is still on its way to the file has to get there first
+    if (writer) {
+        writer->flush();
+    }
+
+    auto existing = chebyshev_records(path);
+    if (!existing || (*existing < n)) {
+        LOG_S(WARNING) << path << ": Starting trajectory afresh";
+        start_file(code);
+        return;
+    }
+
+    std::error_code ec;
+    fs::resize_file(
+        path, sizeof(ChebyshevHeader) + n * record_size * sizeof(double), ec);
+
+    n_records = n;
+    samples   = pending;
+    next_fit  = std::max(2 * n_coeff, samples.size() + 1);
+}
+
+void ChebyshevWriter::start_file(NAIFbody code)
+{
+    ChebyshevHeader header = {};
+    std::memcpy(header.magic, ChebyshevHeader::magic_value, 8);
+    header.version   = ChebyshevHeader::current_version;
+    header.code      = int(code);
+    header.n_coeff   = n_coeff;
+    header.tolerance = tolerance;
+
+    std::vector<char> bytes;
+    append(bytes, &header, 1);
+    write_at(writer, path, 0, std::move(bytes), true);
+
+    next_fit = 2 * n_coeff;
+}
+
+void ChebyshevWriter::write(const V3d& v)
+{
+    samples.push_back(v);
+    if (samples.size() < next_fit) {
+        return;
+    }
+
+    // We look for the longest run that fits by doubling, then bisecting
+    size_t              n = samples.size();
+    std::vector<double> record;
+    if (!fit(n, record)) {
+        fit_longest(fitted, n);
+        return;
+    }
+
+    fitted        = n;
+    fitted_record = std::move(record);
+    if (n == max_samples) {
+        write_record(fitted, fitted_record);
+    } else {
+        next_fit = std::min(2 * n, max_samples);
+    }
+}
+
+void ChebyshevWriter::close_segment()
+{
+    std::vector<double> record;
+    while (samples.size() > 1) {
+        size_t n = samples.size();
+        if (fit(n, record)) {
+            write_record(n, record);
+        } else {
+            fit_longest(fitted, n);
+        }
+    }
+}
+
+void ChebyshevWriter::fit_longest(size_t lo, size_t hi)
+{
+    std::vector<double> lo_record = fitted_record, record;
+
+    // Two samples are always matched, by a line, whatever the tolerance says
+    if (lo < 2) {
+        lo = 2;
+        fit(lo, lo_record);
+    }
+
+    // Getting within an eighth of the longest run is good enough
+    while (hi - lo > std::max(size_t(1), lo / 8)) {
+        size_t mid = (lo + hi) / 2;
+        if (fit(mid, record)) {
+            lo = mid;
+            lo_record.swap(record);
+        } else {
+            hi = mid;
+        }
+    }
+
+    write_record(lo, lo_record);
+}
+
+bool ChebyshevWriter::fit(size_t n, std::vector<double>& record) const
+{
+    const V3d& first = samples[0];
+    const V3d& last  = samples[n - 1];
+
+    record.assign(record_size, 0.0);
+    record[0]    = 0.5 * (first.t + last.t);
+    record[1]    = 0.5 * (last.t - first.t);
+    double* X    = record.data() + 2;
+    double* Y    = X + n_coeff;
+    double* Z    = Y + n_coeff;
+    auto    norm = [&record](double t) { return (t - record[0]) / record[1]; };
+
+    if (record[1] <= 0) {
+        X[0] = first.x;
+        Y[0] = first.y;
+        Z[0] = first.z;
+        return n == 1;
+    }
+
+    // Least squares, by the normal equations. The series are fitted to the
+    // offsets from the first sample, which keeps the sums small. A short run
+    // gets fewer terms than samples, since a series through every one of a few
+    // evenly spaced samples swings about between them
+    const size_t k = std::min(n_coeff, std::max(size_t(2), n / 2));
+    const size_t m = std::min(n, max_fit_points);
+
+    double G[n_coeff][n_coeff] = {};
+    double b[3][n_coeff]       = {};
+    double T[n_coeff];
+    for (size_t j = 0; j < m; j++) {
+        const V3d& s = samples[(m > 1) ? j * (n - 1) / (m - 1) : 0];
+        double     x = norm(s.t);
+        T[0]         = 1.0;
+        T[1]         = x;
+        for (size_t i = 2; i < k; i++) {
+            T[i] = 2 * x * T[i - 1] - T[i - 2];
+        }
+        double d[3] = { s.x - first.x, s.y - first.y, s.z - first.z };
+        for (size_t r = 0; r < k; r++) {
+            for (size_t c = 0; c <= r; c++) {
+                G[r][c] += T[r] * T[c];
+            }
+            for (size_t a = 0; a < 3; a++) {
+                b[a][r] += T[r] * d[a];
+            }
+        }
+    }
+
+    // Cholesky, G = L L^T, in place in the lower triangle
+    for (size_t r = 0; r < k; r++) {
+        for (size_t c = 0; c <= r; c++) {
+            double sum = G[r][c];
+            for (size_t i = 0; i < c; i++) {
+                sum -= G[r][i] * G[c][i];
+            }
+            if (r == c) {
+                if (!(sum > 0)) {
+                    return false;
+                }
+                G[r][r] = std::sqrt(sum);
+            } else {
+                G[r][c] = sum / G[c][c];
+            }
+        }
+    }
+
+    double* coeff[3] = { X, Y, Z };
+    for (size_t a = 0; a < 3; a++) {
+        double* y = b[a];
+        for (size_t r = 0; r < k; r++) {
+            for (size_t i = 0; i < r; i++) {
+                y[r] -= G[r][i] * y[i];
+            }
+            y[r] /= G[r][r];
+        }
+        for (size_t r = k; r-- > 0;) {
+            for (size_t i = r + 1; i < k; i++) {
+                y[r] -= G[i][r] * y[i];
+            }
+            y[r] /= G[r][r];
+        }
+        std::copy_n(y, k, coeff[a]);
+    }
+    X[0] += first.x;
+    Y[0] += first.y;
+    Z[0] += first.z;
+
+    // Checked with the same evaluation a reader will use, a batch at a time
+    const size_t batch = 64;
+    double       x[batch], xyz[3 * batch];
+    for (size_t j = 0; j < n; j += batch) {
+        size_t nb = std::min(batch, n - j);
+        for (size_t i = 0; i < nb; i++) {
+            x[i] = norm(samples[j + i].t);
+        }
+        cheby_eval_xyz_n(X, n_coeff, x, nb, xyz);
+        for (size_t i = 0; i < nb; i++) {
+            const V3d& s  = samples[j + i];
+            double     dx = xyz[3 * i] - s.x;
+            double     dy = xyz[3 * i + 1] - s.y;
+            double     dz = xyz[3 * i + 2] - s.z;
+            if (dx * dx + dy * dy + dz * dz > tolerance * tolerance) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void ChebyshevWriter::write_record(size_t n, const std::vector<double>& record)
+{
+    append(block, record.data(), record.size());
+    n_records++;
+    if (block.size() == block_records * record_size * sizeof(double)) {
+        write_block();
+    }
+
+    samples.erase(samples.begin(), samples.begin() + n - 1);
+    fitted = 0;
+    fitted_record.clear();
+    next_fit = std::max(2 * n_coeff, samples.size() + 1);
+}
+
+void ChebyshevWriter::write_block()
+{
+    // The block holds the records just before n_records
+    size_t   in_block = block.size() / (record_size * sizeof(double));
+    uint64_t offset   = sizeof(ChebyshevHeader)
+        + (n_records - in_block) * record_size * sizeof(double);
+    write_at(writer, path, offset, std::move(block));
+    block.clear();
+}
+
+ChebyshevWriter::~ChebyshevWriter()
+{
+    close_segment();
+
+    // A trajectory of a single sample
+    if ((n_records == 0) && (samples.size() == 1)) {
+        std::vector<double> record;
+        fit(1, record);
+        append(block, record.data(), record.size());
+        n_records++;
+    }
+
+    if (!block.empty()) {
+        write_block();
+    }
+}
+
+}
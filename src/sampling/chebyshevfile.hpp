@@ -0,0 +1,149 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Chebyshev trajectory files.
+
+Instead of downsampled points we can store a trajectory the way an SPK kernel
+stores an ephemeris: as a run of Chebyshev series, each covering a stretch of
+time. The fit is made as the samples come in. Samples pile up until a series of
+n_coeff terms no longer fits them to within the tolerance, and the longest run
+that did fit is written out as a record. Consecutive records share the sample
+at their boundary.
+
+A record is laid out as in an SPK Type 2 segment
+
+    t_mid, t_half, X[n_coeff], Y[n_coeff], Z[n_coeff]
+
+covering [t_mid - t_half, t_mid + t_half], so it can be evaluated with the same
+code as the orrery. Records are all the same size and follow a header
+
+    ChebyshevHeader
+    record x n_records
+
+All in native byte order. The records are in time order, so a reader finds the
+one for a given time by bisection.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include "asyncwriter.hpp"
+#include "naifbody.hpp"
+#include "v3d.hpp"
+
+namespace groho {
+
+namespace fs = std::filesystem;
+
+struct ChebyshevHeader {
+    static constexpr char     magic_value[8]  = "GROHOCB";
+    static constexpr uint32_t current_version = 1;
+
+    char     magic[8];
+    uint32_t version;
+    int32_t  code;      // NAIF code of the body
+    uint64_t n_coeff;   // per axis
+    double   tolerance; // km, the fit is this good at every sample
+};
+
+static_assert(sizeof(ChebyshevHeader) == 32, "Keep the header packed");
+
+// Does the file start like a Chebyshev trajectory file?
+bool is_chebyshev_trajectory(const fs::path& path);
+
+struct ChebyshevTrajectory {
+    NAIFbody            code;
+    size_t              n_coeff;
+    double              tolerance;
+    std::vector<double> records; // back to back
+
+    size_t record_size() const { return 2 + 3 * n_coeff; }
+    size_t size() const { return records.size() / record_size(); }
+
+    double t_begin() const;
+    double t_end() const;
+
+    // Position at t, which has to lie in [t_begin(), t_end()]
+    V3d at(double t) const;
+};
+
+// A record cut off at the end of the file is left out
+std::optional<ChebyshevTrajectory>
+read_chebyshev_trajectory(const fs::path& path);
+
+// Number of whole records in a Chebyshev trajectory file
+std::optional<size_t> chebyshev_records(const fs::path& path);
+
+class ChebyshevWriter {
+public:
+    static constexpr size_t n_coeff = 16;
+
+    // Longest run of samples a record is fitted to. Longer ones would rarely
+    // fit anyway and hold up the output
+    static constexpr size_t max_samples = 8192;
+
+    // Records are handed to the writer (or written straight away, without
+    // one) this many at a time
+    static constexpr size_t block_records = 64;
+
+    ChebyshevWriter(
+        const fs::path& path,
+        NAIFbody        code,
+        double          tolerance,
+        AsyncWriter*    writer = nullptr);
+
+    // Keep the first n records already in the file and carry on fitting from
+    // the samples that were pending when they were written
+    ChebyshevWriter(
+        const fs::path&  path,
+        NAIFbody         code,
+        double           tolerance,
+        size_t           n,
+        const v3d_vec_t& pending,
+        AsyncWriter*     writer = nullptr);
+
+    ChebyshevWriter(const ChebyshevWriter&) = delete;
+    ChebyshevWriter& operator=(const ChebyshevWriter&) = delete;
+
+    // Fits and writes out what is left
+    ~ChebyshevWriter();
+
+    void write(const V3d& v);
+
+    // Write out records for all the samples so far. Only the last one is kept,
+    // to start the next record from
+    void close_segment();
+
+    size_t           records() const { return n_records; }
+    const v3d_vec_t& pending() const { return samples; }
+
+private:
+    void start_file(NAIFbody code);
+
+    // Fit a series to the first n samples. True if it is within tolerance
+    bool fit(size_t n, std::vector<double>& record) const;
+
+    // The longest run, of at least lo and less than hi samples, that fits
+    void fit_longest(size_t lo, size_t hi);
+
+    void write_record(size_t n, const std::vector<double>& record);
+    void write_block();
+
+    fs::path          path;
+    AsyncWriter*      writer;
+    double            tolerance;
+    size_t            n_records = 0;
+    std::vector<char> block; // records not yet handed to the writer
+
+    v3d_vec_t           samples;    // not yet written out, the first is shared
+    size_t              fitted = 0; // the first this many samples fit
+    std::vector<double> fitted_record;
+    size_t              next_fit;   // try again at this many samples
+};
+
+}
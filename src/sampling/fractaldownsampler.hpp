@@ -7,6 +7,7 @@ This handles the downsampling of the data
 
 #pragma once
 
+#include <cmath>
 #include <limits>
 
 #include "v3d.hpp"
@@ -31,7 +32,8 @@ public:
         double linear_dist = (v - last_sample_v).norm();
 
         if (((cumulative_curve_dist / linear_dist) > ratio_threshold)
-            | (abs(cumulative_curve_dist - linear_dist) > linear_threshold)) {
+            | (std::abs(cumulative_curve_dist - linear_dist)
+               > linear_threshold)) {
             accept_sample(v);
             return true;
         }
@@ -50,6 +52,8 @@ public:
     }
 
 private:
+    friend class BatchDownsampler;
+
     void accept_sample(const V3d& v)
     {
         cumulative_curve_dist = 0;
@@ -9,11 +9,13 @@ Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
 #include <memory>
 #include <vector>
 
+#include "batchdownsampler.hpp"
+#include "chebyshevfile.hpp"
 #include "fractaldownsampler.hpp"
 #include "naifbody.hpp"
 #include "simparams.hpp"
 // #include "threadedbuffer.hpp"
-#include "simplebuffer.hpp"
+#include "trajectoryfile.hpp"
 #include "v3d.hpp"
 
 namespace fs = std::filesystem;
@@ -23,28 +25,108 @@ namespace groho {
 class History {
 
 public:
-    History(const SimParams& sim_params, NAIFbody code, fs::path path)
+    // Enough to carry on writing a history from some point onwards
+    struct Snapshot {
+        FractalDownsampler sampler;
+        size_t             samples = 0; // samples (or records) in the file
+        v3d_vec_t          pending;     // samples not yet fitted (Chebyshev)
+    };
+
+    // The history's downsampler goes into samplers, if given, which picks the
+    // samples that reach write() for point output (and those that are
+    // streamed). Without samplers every sample is written. Output goes through
+    // the writer if there is one
+    History(
+        const SimParams&                  sim_params,
+        NAIFbody                          code,
+        fs::path                          path,
+        std::shared_ptr<BatchDownsampler> samplers,
+        AsyncWriter*                      writer = nullptr)
         : dt(sim_params.dt)
         , code(code)
         , rotx(-3.14159265358979323846264338327950288419 * 23.5 / 180.0)
     {
-        sampler = FractalDownsampler(sim_params.rt, sim_params.lt);
+        if (samplers) {
+            this->samplers = samplers;
+            sampler_idx    = samplers->add(
+                FractalDownsampler(sim_params.rt, sim_params.lt));
+        }
+        if (sim_params.output == SimParams::CHEBYSHEV) {
+            fitter.reset(new ChebyshevWriter(
+                path, code, sim_params.output_tolerance, writer));
+            return;
+        }
         // buffer.reset(new ThreadedBuffer<V3d>(path));
-        buffer.reset(new SimpleBuffer<V3d>(path));
+        buffer.reset(new TrajectoryWriter(path, code, writer));
     }
 
-    void sample(const V3d& pos)
+    // Drop whatever was written after the snapshot was taken and carry on
+    History(
+        const SimParams&                  sim_params,
+        NAIFbody                          code,
+        fs::path                          path,
+        const Snapshot&                   from,
+        std::shared_ptr<BatchDownsampler> samplers,
+        AsyncWriter*                      writer = nullptr)
+        : dt(sim_params.dt)
+        , code(code)
+        , rotx(-3.14159265358979323846264338327950288419 * 23.5 / 180.0)
     {
-        if (sampler(pos)) {
-            // buffer->write(rotx(pos));
-            buffer->write(pos);
+        samples = from.samples;
+        if (samplers) {
+            this->samplers = samplers;
+            sampler_idx    = samplers->add(from.sampler);
+        }
+        if (sim_params.output == SimParams::CHEBYSHEV) {
+            fitter.reset(new ChebyshevWriter(
+                path,
+                code,
+                sim_params.output_tolerance,
+                samples,
+                from.pending,
+                writer));
+            return;
         }
+        buffer.reset(new TrajectoryWriter(path, code, samples, writer));
+    }
+
+    // A sample the downsampler took, or, for Chebyshev output, every sample
+    void write(const V3d& pos)
+    {
+        if (fitter) {
+            fitter->write(pos);
+            return;
+        }
+        // buffer->write(rotx(pos));
+        buffer->write(pos);
+        samples++;
+    }
+
+    // A Chebyshev fit is written out up to here first, so that the snapshot
+    // only has to carry the one sample the next record starts from
+    Snapshot snapshot()
+    {
+        Snapshot snap;
+        if (samplers) {
+            snap.sampler = samplers->get(sampler_idx);
+        }
+        if (fitter) {
+            fitter->close_segment();
+            snap.samples = fitter->records();
+            snap.pending = fitter->pending();
+        } else {
+            snap.samples = samples;
+        }
+        return snap;
     }
 
     ~History()
     {
+        if (fitter || !samplers) {
+            return;
+        }
         V3d last_pos;
-        if (sampler.flush(last_pos)) {
+        if (samplers->flush(sampler_idx, last_pos)) {
             // buffer->write(rotx(last_pos));
             buffer->write(last_pos);
         }
@@ -54,11 +136,14 @@ private:
     const double   dt;
     const NAIFbody code;
 
-    FractalDownsampler sampler;
-    RotateX            rotx;
+    std::shared_ptr<BatchDownsampler> samplers;
+    size_t                            sampler_idx = 0;
+    RotateX                           rotx;
+    size_t                            samples = 0;
 
     // std::shared_ptr<ThreadedBuffer<V3d>> buffer;
-    std::shared_ptr<SimpleBuffer<V3d>> buffer;
+    std::shared_ptr<TrajectoryWriter> buffer;
+    std::shared_ptr<ChebyshevWriter>  fitter; // instead, for Chebyshev output
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,255 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <algorithm>
+#include <cstring> // gcc needs this for strerror
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "asyncwriter.hpp"
+#include "samplestream.hpp"
+
+#define LOGURU_WITH_STREAMS 1
+#include "loguru.hpp"
+
+// A viewer going away must not take us down with a SIGPIPE
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace groho {
+
+static bool set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    return (flags != -1) && (fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1);
+}
+
+SampleStream::SampleStream(const fs::path& path, size_t max_queue_bytes)
+    : path(path)
+    , max_queue_bytes(max_queue_bytes)
+{
+    sockaddr_un addr = {};
+    addr.sun_family  = AF_UNIX;
+    if (path.native().size() >= sizeof(addr.sun_path)) {
+        LOG_S(ERROR) << path << ": Socket path is too long";
+        return;
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+
+    // Left behind by a run that was killed
+    std::error_code ec;
+    if (fs::is_socket(path, ec)) {
+        fs::remove(path, ec);
+    }
+
+    listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((listen_fd == -1)
+        || (::bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) == -1)
+        || (::listen(listen_fd, 16) == -1) || !set_nonblocking(listen_fd)
+        || (::pipe(wake_fd) == -1) || !set_nonblocking(wake_fd[0])
+        || !set_nonblocking(wake_fd[1])) {
+        LOG_S(ERROR) << path << ": " << std::strerror(errno);
+        for (int fd : { listen_fd, wake_fd[0], wake_fd[1] }) {
+            if (fd != -1) {
+                ::close(fd);
+            }
+        }
+        listen_fd = -1;
+        return;
+    }
+
+    LOG_S(INFO) << "Streaming samples to " << path;
+    thread = std::thread(&SampleStream::loop, this);
+}
+
+SampleStream::~SampleStream()
+{
+    if (!is_open()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake();
+    thread.join();
+
+    for (auto& sub : subs) {
+        ::close(sub.fd);
+    }
+    ::close(listen_fd);
+    ::close(wake_fd[0]);
+    ::close(wake_fd[1]);
+
+    std::error_code ec;
+    fs::remove(path, ec);
+}
+
+size_t SampleStream::subscribers()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return subs.size();
+}
+
+void SampleStream::begin_run(double begin, double end)
+{
+    pending.clear();
+    if (active) {
+        publish(StreamHeader::RUN, begin, end);
+    }
+}
+
+void SampleStream::send()
+{
+    if (pending.empty()) {
+        return;
+    }
+    auto [lo, hi] = std::minmax_element(
+        pending.begin(), pending.end(), [](const auto& a, const auto& b) {
+            return a.t < b.t;
+        });
+    publish(StreamHeader::SAMPLES, lo->t, hi->t);
+    pending.clear();
+}
+
+void SampleStream::publish(StreamHeader::Type type, double begin, double end)
+{
+    StreamHeader header = {};
+    std::memcpy(header.magic, StreamHeader::magic_value, 4);
+    header.type  = type;
+    header.seq   = seq++;
+    header.n     = pending.size();
+    header.begin = begin;
+    header.end   = end;
+
+    auto bytes = std::make_shared<std::vector<char>>();
+    bytes->reserve(sizeof(header) + pending.size() * sizeof(StreamSample));
+    append(*bytes, &header, 1);
+    append(*bytes, pending.data(), pending.size());
+
+    {
+        // A viewer that is too far behind misses this one
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& sub : subs) {
+            if (!sub.queue.empty()
+                && (sub.queued_bytes + bytes->size() > max_queue_bytes)) {
+                continue;
+            }
+            sub.queue.push_back(bytes);
+            sub.queued_bytes += bytes->size();
+        }
+    }
+    wake();
+}
+
+void SampleStream::wake()
+{
+    char    c = 0;
+    ssize_t n = ::write(wake_fd[1], &c, 1);
+    (void)n; // a full pipe will wake the loop anyway
+}
+
+bool SampleStream::write_some(Subscriber& sub)
+{
+    while (!sub.queue.empty()) {
+        const auto& message = *sub.queue.front();
+        ssize_t     n       = ::send(
+            sub.fd,
+            message.data() + sub.offset,
+            message.size() - sub.offset,
+            MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+        }
+        sub.offset += n;
+        if (sub.offset == message.size()) {
+            sub.queued_bytes -= message.size();
+            sub.queue.pop_front();
+            sub.offset = 0;
+        }
+    }
+    return true;
+}
+
+void SampleStream::loop()
+{
+    std::vector<pollfd> fds;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stop) {
+                return;
+            }
+            fds.clear();
+            fds.push_back({ listen_fd, POLLIN, 0 });
+            fds.push_back({ wake_fd[0], POLLIN, 0 });
+            for (const auto& sub : subs) {
+                short events = POLLIN | (sub.queue.empty() ? 0 : POLLOUT);
+                fds.push_back({ sub.fd, events, 0 });
+            }
+        }
+
+        if (::poll(fds.data(), fds.size(), -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_S(ERROR) << path << ": " << std::strerror(errno);
+            return;
+        }
+
+        char buf[256];
+        while (::read(wake_fd[0], buf, sizeof(buf)) > 0) {
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Only this thread adds or removes viewers, so they still line up
+        // with fds. Anything a viewer sends us is ignored
+        for (size_t i = subs.size(); i-- > 0;) {
+            auto& sub    = subs[i];
+            short events = fds[2 + i].revents;
+            bool  gone   = events & (POLLERR | POLLNVAL);
+            if (!gone && (events & (POLLIN | POLLHUP))) {
+                ssize_t n = ::recv(sub.fd, buf, sizeof(buf), MSG_DONTWAIT);
+                gone      = (n == 0)
+                    || ((n == -1) && (errno != EAGAIN) && (errno != EINTR));
+            }
+            if (!gone) {
+                gone = !write_some(sub);
+            }
+            if (gone) {
+                ::close(sub.fd);
+                subs.erase(subs.begin() + i);
+                LOG_S(INFO) << "Viewer disconnected from " << path;
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd;
+            while ((fd = ::accept(listen_fd, nullptr, nullptr)) != -1) {
+                if (!set_nonblocking(fd)) {
+                    ::close(fd);
+                    continue;
+                }
+                Subscriber sub;
+                sub.fd = fd;
+                subs.push_back(std::move(sub));
+                LOG_S(INFO) << "Viewer connected to " << path;
+            }
+        }
+
+        active = !subs.empty();
+    }
+}
+
+}
@@ -0,0 +1,128 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Live output over a Unix domain socket.
+
+While a simulation runs, the samples that the downsamplers take are published
+to any number of local viewers connected to the socket, as they are taken,
+without going through the disk. Each step's samples go out as one message
+
+    StreamHeader
+    StreamSample x n
+
+and each run starts with a message of type RUN and no samples, giving the span
+of the run. All in native byte order. A body's samples come in time order
+within a run. A rerun that rewrites only part of the scenario streams just the
+bodies it rewrites, from where it picks up: a viewer should drop the samples
+it has for such a body from the first new sample's time on.
+
+The simulation never waits on a viewer. A viewer that falls more than
+max_queue_bytes behind misses messages, which shows as a gap in seq. A viewer
+that connects part way through a run gets the samples from then on; the rest
+are in the output files.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "naifbody.hpp"
+#include "v3d.hpp"
+
+namespace groho {
+
+namespace fs = std::filesystem;
+
+struct StreamHeader {
+    static constexpr char magic_value[4] = "GRS";
+    enum Type : uint32_t { RUN = 1, SAMPLES };
+
+    char     magic[4];
+    uint32_t type;
+    uint64_t seq; // counts the messages sent, from 0
+    uint64_t n;   // samples that follow
+    double   begin, end; // RUN: span of the run, SAMPLES: span of the samples
+};
+
+static_assert(sizeof(StreamHeader) == 40, "Keep the header packed");
+
+struct StreamSample {
+    int64_t code; // NAIF code of the body
+    double  t, x, y, z;
+};
+
+class SampleStream {
+public:
+    static constexpr size_t default_queue_bytes = 16 << 20;
+
+    // Listen on the socket, replacing a stale one left at the path
+    explicit SampleStream(
+        const fs::path& path, size_t max_queue_bytes = default_queue_bytes);
+
+    // Disconnects the viewers and removes the socket
+    ~SampleStream();
+
+    SampleStream(const SampleStream&) = delete;
+    SampleStream& operator=(const SampleStream&) = delete;
+
+    bool is_open() const { return listen_fd != -1; }
+
+    // Viewers connected right now
+    size_t subscribers();
+
+    void begin_run(double begin, double end);
+
+    // Held until send(). Free when no one is listening
+    void add(NAIFbody code, const V3d& v)
+    {
+        if (active) {
+            pending.push_back({ int(code), v.t, v.x, v.y, v.z });
+        }
+    }
+
+    // Hand the samples added since the last send to every viewer, as one
+    // message
+    void send();
+
+private:
+    using Message = std::shared_ptr<const std::vector<char>>;
+
+    struct Subscriber {
+        int                 fd;
+        std::deque<Message> queue;
+        size_t              offset       = 0; // of the front message, written
+        size_t              queued_bytes = 0;
+    };
+
+    void publish(StreamHeader::Type type, double begin, double end);
+    void loop();
+    void wake();
+
+    // Write what we can without blocking. False if the viewer has gone
+    bool write_some(Subscriber& sub);
+
+    fs::path     path;
+    const size_t max_queue_bytes;
+    int          listen_fd  = -1;
+    int          wake_fd[2] = { -1, -1 }; // to get the loop to look again
+
+    std::vector<StreamSample> pending;
+    uint64_t                  seq    = 0;
+    std::atomic<bool>         active = false; // someone is subscribed
+
+    std::mutex              mutex;
+    std::vector<Subscriber> subs;
+    bool                    stop = false;
+
+    std::thread thread;
+};
+
+}
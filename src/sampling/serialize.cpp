@@ -10,10 +10,7 @@ Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
 
 namespace groho {
 
-Serialize::Serialize(
-    const SimParams&             sim_params,
-    const std::vector<NAIFbody>& objects,
-    const fs::path&              outdir)
+static void check_outdir(const fs::path& outdir)
 {
     if (fs::exists(outdir)) {
         if (!fs::is_directory(outdir)) {
@@ -22,19 +19,120 @@ Serialize::Serialize(
     } else {
         fs::create_directories(outdir);
     }
+}
+
+fs::path history_file(const fs::path& outdir, NAIFbody code)
+{
+    return outdir / ("pos" + std::to_string(int(code)) + ".bin");
+}
+
+Serialize::Serialize(
+    const SimParams&             sim_params,
+    const std::vector<NAIFbody>& objects,
+    const fs::path&              outdir,
+    AsyncWriter*                 writer,
+    bool                         downsample,
+    SampleStream*                stream)
+    : codes(objects)
+    , stream(stream)
+{
+    check_outdir(outdir);
+
+    // Chebyshev output still runs the downsamplers, to pick what to stream
+    if (downsample) {
+        samplers  = std::make_shared<BatchDownsampler>();
+        write_all = sim_params.output == SimParams::CHEBYSHEV;
+    }
 
     history.reserve(objects.size());
     for (size_t i = 0; i < objects.size(); i++) {
-        auto fname
-            = outdir / ("pos" + std::to_string(int(objects[i])) + ".bin");
-        history.emplace_back(sim_params, objects[i], fname);
+        history.emplace_back(
+            sim_params,
+            objects[i],
+            history_file(outdir, objects[i]),
+            samplers,
+            writer);
+        index.push_back(i);
+    }
+}
+
+Serialize::Serialize(
+    const SimParams&                                     sim_params,
+    const std::vector<NAIFbody>&                         objects,
+    const fs::path&                                      outdir,
+    const std::vector<std::optional<History::Snapshot>>& resume_from,
+    AsyncWriter*                                         writer,
+    SampleStream*                                        stream)
+    : stream(stream)
+{
+    check_outdir(outdir);
+    samplers  = std::make_shared<BatchDownsampler>();
+    write_all = sim_params.output == SimParams::CHEBYSHEV;
+
+    history.reserve(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        if (!resume_from[i]) {
+            continue;
+        }
+        history.emplace_back(
+            sim_params,
+            objects[i],
+            history_file(outdir, objects[i]),
+            *resume_from[i],
+            samplers,
+            writer);
+        index.push_back(i);
+        codes.push_back(objects[i]);
     }
 }
 
 void Serialize::append(const v3d_vec_t& pos)
+{
+    if (samplers) {
+        (*samplers)(pos, index, accepted);
+    }
+
+    if (write_all) {
+        for (size_t i = 0; i < history.size(); i++) {
+            history[i].write(pos[index[i]]);
+        }
+    } else {
+        for (auto i : accepted) {
+            history[i].write(pos[index[i]]);
+        }
+    }
+
+    if (!stream) {
+        return;
+    }
+    if (samplers) {
+        for (auto i : accepted) {
+            stream->add(codes[i], pos[index[i]]);
+        }
+    } else {
+        for (size_t i = 0; i < history.size(); i++) {
+            stream->add(codes[i], pos[index[i]]);
+        }
+    }
+}
+
+void Serialize::stream_last()
+{
+    if (!stream || !samplers) {
+        return;
+    }
+    V3d last;
+    for (size_t i = 0; i < history.size(); i++) {
+        if (samplers->flush(i, last)) {
+            stream->add(codes[i], last);
+        }
+    }
+}
+
+void Serialize::snapshot(std::vector<History::Snapshot>& snapshots)
 {
     for (size_t i = 0; i < history.size(); i++) {
-        history[i].sample(pos[i]);
+        snapshots[index[i]] = history[i].snapshot();
     }
 }
 
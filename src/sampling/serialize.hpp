@@ -11,29 +11,70 @@ serializer also supplies velocity and acceleration data on request.
 
 #include <filesystem>
 #include <memory>
+#include <optional>
 #include <vector>
 
 #include "history.hpp"
 #include "naifbody.hpp"
+#include "samplestream.hpp"
 #include "simparams.hpp"
 
 namespace groho {
 
 namespace fs = std::filesystem;
 
+// Where the history of this object goes
+fs::path history_file(const fs::path& outdir, NAIFbody code);
+
 class Serialize {
 
 public:
     Serialize() { ; }
+    // Output goes through the writer if there is one, or is written out on
+    // the calling thread. Without downsample every sample given to append is
+    // written out. The samples the points output would keep also go to the
+    // stream, if there is one
     Serialize(
         const SimParams&             sim_params,
         const std::vector<NAIFbody>& objects,
-        const fs::path&              outdir);
+        const fs::path&              outdir,
+        AsyncWriter*                 writer     = nullptr,
+        bool                         downsample = true,
+        SampleStream*                stream     = nullptr);
+
+    // Carry on from where an earlier run got to. Objects without a snapshot
+    // are left alone: we neither write to nor truncate their files
+    Serialize(
+        const SimParams&                                     sim_params,
+        const std::vector<NAIFbody>&                         objects,
+        const fs::path&                                      outdir,
+        const std::vector<std::optional<History::Snapshot>>& resume_from,
+        AsyncWriter*                                         writer = nullptr,
+        SampleStream*                                        stream = nullptr);
+
     size_t size() { return history.size(); }
     void   append(const v3d_vec_t& pos);
 
+    // The last sample each downsampler is holding back is only written out
+    // when the histories close. This streams them
+    void stream_last();
+
+    // Fill in snapshots for the objects we are writing. Others are untouched.
+    // Chebyshev output is written out up to this point
+    void snapshot(std::vector<History::Snapshot>& snapshots);
+
 private:
-    std::vector<History> history;
+    std::vector<History>  history;
+    std::vector<size_t>   index; // element of pos each history samples
+    std::vector<NAIFbody> codes;
+
+    // The downsamplers of all the histories. They pick the samples for
+    // downsampled point output, and for the stream
+    std::shared_ptr<BatchDownsampler> samplers;
+    std::vector<size_t>               accepted;
+    bool                              write_all = true; // not just accepted
+
+    SampleStream* stream = nullptr;
 };
 
 }
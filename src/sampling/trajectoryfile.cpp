@@ -0,0 +1,282 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <cstring>
+#include <fstream>
+
+#include "trajectoryfile.hpp"
+
+#define LOGURU_WITH_STREAMS 1
+#include "loguru.hpp"
+
+namespace groho {
+
+using namespace trajectory;
+
+static uint64_t chunk_bytes(uint64_t n)
+{
+    return sizeof(ChunkHeader) + 4 * n * sizeof(double);
+}
+
+template <typename T>
+static bool read_at(std::ifstream& file, uint64_t offset, T& dst)
+{
+    file.seekg(offset);
+    file.read((char*)&dst, sizeof(T));
+    return bool(file);
+}
+
+// The first n samples of a chunk, as columns
+static bool read_columns(
+    std::ifstream&       file,
+    const IndexEntry&    entry,
+    size_t               n,
+    std::vector<double>* columns[4])
+{
+    for (size_t c = 0; c < 4; c++) {
+        columns[c]->resize(n);
+        file.seekg(
+            entry.offset + sizeof(ChunkHeader) + c * entry.n * sizeof(double));
+        file.read((char*)columns[c]->data(), n * sizeof(double));
+    }
+    return bool(file);
+}
+
+std::optional<std::vector<IndexEntry>>
+read_trajectory_index(const fs::path& path)
+{
+    std::error_code ec;
+    uint64_t        size = fs::file_size(path, ec);
+    std::ifstream   file(path, std::ios::binary);
+    if (ec || !file) {
+        LOG_S(ERROR) << "Could not open " << path;
+        return {};
+    }
+
+    FileHeader header;
+    if (!read_at(file, 0, header)
+        || (std::memcmp(header.magic, file_magic, sizeof(file_magic)) != 0)) {
+        LOG_S(ERROR) << path << ": Not a trajectory file";
+        return {};
+    }
+    if (header.version != version) {
+        LOG_S(ERROR) << path << ": Trajectory file version " << header.version
+                     << ", expected " << version;
+        return {};
+    }
+
+    // A closed file ends with the index
+    FileFooter footer;
+    IndexHeader index_header;
+    if ((size >= sizeof(FileHeader) + sizeof(FileFooter))
+        && read_at(file, size - sizeof(FileFooter), footer)
+        && (std::memcmp(footer.magic, footer_magic, sizeof(footer_magic)) == 0)
+        && read_at(file, footer.index_offset, index_header)
+        && (std::memcmp(index_header.tag, index_tag, sizeof(index_tag)) == 0)
+        && (footer.index_offset + sizeof(IndexHeader)
+                + index_header.n_chunks * sizeof(IndexEntry)
+                + sizeof(FileFooter)
+            == size)) {
+        std::vector<IndexEntry> index(index_header.n_chunks);
+        file.read((char*)index.data(), index.size() * sizeof(IndexEntry));
+        if (file) {
+            return index;
+        }
+        file.clear();
+    }
+
+    // Otherwise we walk the chunks
+    std::vector<IndexEntry> index;
+    uint64_t                offset = sizeof(FileHeader);
+    ChunkHeader             chunk;
+    while ((offset + sizeof(ChunkHeader) <= size)
+           && read_at(file, offset, chunk)
+           && (std::memcmp(chunk.tag, chunk_tag, sizeof(chunk_tag)) == 0)
+           && (offset + chunk_bytes(chunk.n) <= size)) {
+        index.push_back({ offset, chunk.n, chunk.t_begin, chunk.t_end });
+        offset += chunk_bytes(chunk.n);
+    }
+    return index;
+}
+
+std::optional<v3d_vec_t>
+read_trajectory(const fs::path& path, double t_begin, double t_end)
+{
+    auto index = read_trajectory_index(path);
+    if (!index) {
+        return {};
+    }
+
+    std::ifstream       file(path, std::ios::binary);
+    std::vector<double> t, x, y, z;
+    std::vector<double>* columns[4] = { &t, &x, &y, &z };
+
+    v3d_vec_t samples;
+    for (const auto& entry : *index) {
+        if ((entry.t_end < t_begin) || (entry.t_begin > t_end)) {
+            continue;
+        }
+        if (!read_columns(file, entry, entry.n, columns)) {
+            LOG_S(ERROR) << path << ": Could not read chunk";
+            return {};
+        }
+        for (size_t i = 0; i < entry.n; i++) {
+            samples.push_back({ x[i], y[i], z[i], t[i] });
+        }
+    }
+    return samples;
+}
+
+std::optional<size_t> trajectory_samples(const fs::path& path)
+{
+    auto index = read_trajectory_index(path);
+    if (!index) {
+        return {};
+    }
+    size_t n = 0;
+    for (const auto& entry : *index) {
+        n += entry.n;
+    }
+    return n;
+}
+
+TrajectoryWriter::TrajectoryWriter(
+    const fs::path& path, NAIFbody code, AsyncWriter* writer)
+    : path(path)
+    , writer(writer)
+{
+    start_file(code);
+}
+
+TrajectoryWriter::TrajectoryWriter(
+    const fs::path& path, NAIFbody code, size_t n, AsyncWriter* writer)
+    : path(path)
+    , writer(writer)
+{
+    // Whatever is still on its way to the file has to get there first
+    if (writer) {
+        writer->flush();
+    }
+
+    auto existing = read_trajectory_index(path);
+    if (!existing) {
+        LOG_S(WARNING) << path << ": Starting trajectory afresh";
+        start_file(code);
+        return;
+    }
+
+    // Full chunks before sample n stay as they are. The samples of the chunk
+    // after them go back into the buffer so that it comes out as it would have
+    // had we never stopped
+    offset      = sizeof(FileHeader);
+    size_t kept = 0;
+    for (const auto& entry : *existing) {
+        if ((entry.n != chunk_samples) || (kept + entry.n > n)) {
+            break;
+        }
+        index.push_back(entry);
+        kept += entry.n;
+        offset += chunk_bytes(entry.n);
+    }
+
+    if (kept < n) {
+        if (index.size() < existing->size()) {
+            const auto&          entry = (*existing)[index.size()];
+            std::ifstream        in(path, std::ios::binary);
+            std::vector<double>* columns[4] = { &t, &x, &y, &z };
+            size_t               samples = std::min(n - kept, size_t(entry.n));
+            read_columns(in, entry, samples, columns);
+        }
+        if (kept + t.size() < n) {
+            LOG_S(WARNING) << path << ": Only " << kept + t.size() << " of "
+                           << n << " samples to carry on from";
+        }
+    }
+
+    std::error_code ec;
+    fs::resize_file(path, offset, ec);
+    t.reserve(chunk_samples);
+    x.reserve(chunk_samples);
+    y.reserve(chunk_samples);
+    z.reserve(chunk_samples);
+}
+
+void TrajectoryWriter::start_file(NAIFbody code)
+{
+    FileHeader header = {};
+    std::memcpy(header.magic, file_magic, sizeof(file_magic));
+    header.version       = version;
+    header.code          = int(code);
+    header.chunk_samples = chunk_samples;
+
+    std::vector<char> block;
+    append(block, &header, 1);
+    write_at(writer, path, 0, std::move(block), true);
+    offset = sizeof(header);
+
+    t.reserve(chunk_samples);
+    x.reserve(chunk_samples);
+    y.reserve(chunk_samples);
+    z.reserve(chunk_samples);
+}
+
+void TrajectoryWriter::write(const V3d& v)
+{
+    t.push_back(v.t);
+    x.push_back(v.x);
+    y.push_back(v.y);
+    z.push_back(v.z);
+    if (t.size() == chunk_samples) {
+        write_chunk();
+    }
+}
+
+void TrajectoryWriter::write_chunk()
+{
+    ChunkHeader chunk = {};
+    std::memcpy(chunk.tag, chunk_tag, sizeof(chunk_tag));
+    chunk.n       = t.size();
+    chunk.t_begin = t.front();
+    chunk.t_end   = t.back();
+
+    std::vector<char> block;
+    block.reserve(chunk_bytes(chunk.n));
+    append(block, &chunk, 1);
+    for (const auto* column : { &t, &x, &y, &z }) {
+        append(block, column->data(), chunk.n);
+    }
+    write_at(writer, path, offset, std::move(block));
+
+    index.push_back({ offset, chunk.n, chunk.t_begin, chunk.t_end });
+    offset += chunk_bytes(chunk.n);
+
+    t.clear();
+    x.clear();
+    y.clear();
+    z.clear();
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+    if (!t.empty()) {
+        write_chunk();
+    }
+
+    IndexHeader index_header = {};
+    std::memcpy(index_header.tag, index_tag, sizeof(index_tag));
+    index_header.n_chunks = index.size();
+
+    FileFooter footer = {};
+    footer.index_offset = offset;
+    std::memcpy(footer.magic, footer_magic, sizeof(footer_magic));
+
+    std::vector<char> block;
+    append(block, &index_header, 1);
+    append(block, index.data(), index.size());
+    append(block, &footer, 1);
+    write_at(writer, path, offset, std::move(block));
+}
+
+}
@@ -0,0 +1,134 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Trajectory files.
+
+Each body's samples go into a file of chunks. A chunk holds up to
+chunk_samples samples as four float64 columns, t, x, y and z, so a reader can
+map a column straight into an array. Every chunk starts with its sample count
+and the times of its first and last samples, and a closed file ends with an
+index of the chunks, so a reader can go straight to the chunks for a time
+window. The index is only written when the file is closed. While a simulation
+is still running (or if it was cut short) a reader walks the chunk headers
+instead.
+
+    FileHeader
+    ChunkHeader, t[n], x[n], y[n], z[n]
+    ChunkHeader, ...
+    ...
+    IndexHeader, IndexEntry x n_chunks
+    FileFooter
+
+All in native byte order.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include "asyncwriter.hpp"
+#include "naifbody.hpp"
+#include "v3d.hpp"
+
+namespace groho {
+
+namespace fs = std::filesystem;
+
+namespace trajectory {
+
+static constexpr char     file_magic[8]   = "GROHOTR";
+static constexpr char     chunk_tag[8]    = "CHUNK";
+static constexpr char     index_tag[8]    = "INDEX";
+static constexpr char     footer_magic[8] = "GROHOIX";
+static constexpr uint32_t version         = 1;
+
+struct FileHeader {
+    char     magic[8];
+    uint32_t version;
+    int32_t  code;          // NAIF code of the body
+    uint64_t chunk_samples; // most samples in a chunk
+    uint64_t reserved;
+};
+
+struct ChunkHeader {
+    char     tag[8];
+    uint64_t n;       // samples in this chunk
+    double   t_begin; // time of the first sample
+    double   t_end;   // and of the last
+};
+
+struct IndexHeader {
+    char     tag[8];
+    uint64_t n_chunks;
+};
+
+struct IndexEntry {
+    uint64_t offset; // bytes, from the start of the file to the ChunkHeader
+    uint64_t n;
+    double   t_begin;
+    double   t_end;
+};
+
+struct FileFooter {
+    uint64_t index_offset; // bytes, to the IndexHeader
+    char     magic[8];
+};
+
+}
+
+// The chunks of a trajectory file, from its index or, for a file that was
+// not closed, by walking the chunks. A chunk cut off at the end of the file is
+// left out
+std::optional<std::vector<trajectory::IndexEntry>>
+read_trajectory_index(const fs::path& path);
+
+// Samples from the chunks that overlap [t_begin, t_end]
+std::optional<v3d_vec_t> read_trajectory(
+    const fs::path& path,
+    double          t_begin = -INFINITY,
+    double          t_end   = INFINITY);
+
+// Total number of samples in a trajectory file
+std::optional<size_t> trajectory_samples(const fs::path& path);
+
+class TrajectoryWriter {
+public:
+    static constexpr size_t chunk_samples = 5000;
+
+    // Chunks are written out through the writer, if given, or else straight
+    // away
+    TrajectoryWriter(
+        const fs::path& path, NAIFbody code, AsyncWriter* writer = nullptr);
+
+    // Keep the first n samples already in the file and append after them
+    TrajectoryWriter(
+        const fs::path& path,
+        NAIFbody        code,
+        size_t          n,
+        AsyncWriter*    writer = nullptr);
+
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    // Writes out the last chunk and the index
+    ~TrajectoryWriter();
+
+    void write(const V3d& v);
+
+private:
+    void start_file(NAIFbody code);
+    void write_chunk();
+
+    fs::path                            path;
+    AsyncWriter*                        writer;
+    uint64_t                            offset; // where the next chunk goes
+    std::vector<trajectory::IndexEntry> index;
+    std::vector<double>                 t, x, y, z;
+};
+
+}
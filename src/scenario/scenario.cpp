@@ -6,6 +6,8 @@ Parse scenario input file and return Scenario struct
 */
 #include <algorithm>
 #include <iostream>
+#include <limits>
+#include <optional>
 
 #include "parsing.hpp"
 #include "scenario.hpp"
@@ -25,9 +27,34 @@ Scenario::Scenario(const Lines& lines_)
     log_issues(lines);
 }
 
+// Returns the tolerance in km, or sets an error on the line
+static std::optional<double> parse_tolerance(Line& line)
+{
+    double tolerance = 0;
+    try {
+        tolerance = std::stod(line.value);
+    } catch (const std::exception& e) {
+        line.status = { ParseStatus::ERROR,
+                        "Couldn't parse tolerance " + std::string(e.what()) };
+        return {};
+    }
+    if (!(tolerance > 0)) {
+        line.status = { ParseStatus::ERROR, "Tolerance should be positive" };
+        return {};
+    }
+    line.status.code = ParseStatus::OK;
+    return tolerance;
+}
+
 void Scenario::parse_preamble(Lines& lines)
 {
+    // A tolerance given after a plan line belongs to that plan
+    bool in_plans = false;
     for (auto& line : lines) {
+        if (line.key == "plan") {
+            in_plans = true;
+        }
+
         if ((line.key == "start") || (line.key == "end")) {
             auto [date, err] = as_gregorian_date(line.value);
             if (err.length() > 0) {
@@ -54,6 +81,74 @@ void Scenario::parse_preamble(Lines& lines)
         } else if (line.key == "lt") {
             sim.lt           = std::stod(line.value);
             line.status.code = ParseStatus::OK;
+
+        } else if (line.key == "integrator") {
+            if (line.value == "fixed") {
+                sim.integrator   = SimParams::FIXED;
+                line.status.code = ParseStatus::OK;
+            } else if (line.value == "adaptive") {
+                sim.integrator   = SimParams::ADAPTIVE;
+                line.status.code = ParseStatus::OK;
+            } else if (line.value == "block") {
+                sim.integrator   = SimParams::BLOCK;
+                line.status.code = ParseStatus::OK;
+            } else if (line.value == "forest_ruth") {
+                sim.integrator   = SimParams::FOREST_RUTH;
+                line.status.code = ParseStatus::OK;
+            } else if (line.value == "yoshida6") {
+                sim.integrator   = SimParams::YOSHIDA6;
+                line.status.code = ParseStatus::OK;
+            } else if (line.value == "radau") {
+                sim.integrator   = SimParams::RADAU;
+                line.status.code = ParseStatus::OK;
+            } else if (line.value == "encke") {
+                sim.integrator   = SimParams::ENCKE;
+                line.status.code = ParseStatus::OK;
+            } else {
+                line.status = { ParseStatus::ERROR,
+                                "Integrator should be fixed, forest_ruth, "
+                                "yoshida6, encke, adaptive, block or radau" };
+            }
+
+        } else if (line.key == "output") {
+            if (line.value == "points") {
+                sim.output       = SimParams::POINTS;
+                line.status.code = ParseStatus::OK;
+            } else if (line.value == "chebyshev") {
+                sim.output       = SimParams::CHEBYSHEV;
+                line.status.code = ParseStatus::OK;
+            } else {
+                line.status = { ParseStatus::ERROR,
+                                "Output should be points or chebyshev" };
+            }
+
+        } else if (line.key == "output_tolerance") {
+            if (auto tolerance = parse_tolerance(line)) {
+                sim.output_tolerance = *tolerance;
+            }
+
+        } else if (line.key == "orrery_dt") {
+            double orrery_dt = 0;
+            try {
+                orrery_dt = std::stod(line.value);
+            } catch (const std::exception& e) {
+                line.status
+                    = { ParseStatus::ERROR,
+                        "Couldn't parse orrery step " + std::string(e.what()) };
+                continue;
+            }
+            if (orrery_dt < 0) {
+                line.status
+                    = { ParseStatus::ERROR, "Orrery step can't be negative" };
+                continue;
+            }
+            sim.orrery_dt    = orrery_dt;
+            line.status.code = ParseStatus::OK;
+
+        } else if ((line.key == "tolerance") && !in_plans) {
+            if (auto tolerance = parse_tolerance(line)) {
+                sim.tolerance = *tolerance;
+            }
         }
     }
 }
@@ -132,6 +227,13 @@ void Scenario::parse_plans(Lines& lines)
                 = { 0, 0, "orbiting", tokens };
             line.status.code = ParseStatus::OK;
 
+        } else if (line.key == "tolerance") {
+            if (plan_name == "") {
+                no_associated_craft(line);
+                continue;
+            }
+            spacecraft_tokens.back().tolerance = parse_tolerance(line);
+
         } else if (line.key == "code") {
             if (plan_name == "") {
                 no_associated_craft(line);
@@ -232,4 +334,101 @@ bool Scenario::operator!=(const Scenario& rhs)
     return false;
 }
 
-}
\ No newline at end of file
+static bool same_command(const CommandToken& a, const CommandToken& b)
+{
+    return (a.start == b.start) && (a.duration == b.duration)
+        && (a.command == b.command) && (a.params == b.params);
+}
+
+static bool same_setup(const Scenario& a, const Scenario& b)
+{
+    if ((a.sim.begin != b.sim.begin) || (a.sim.end != b.sim.end)
+        || (a.sim.dt != b.sim.dt) || (a.sim.rt != b.sim.rt)
+        || (a.sim.lt != b.sim.lt) || (a.sim.integrator != b.sim.integrator)
+        || (a.sim.tolerance != b.sim.tolerance)
+        || (a.sim.output != b.sim.output)
+        || (a.sim.output_tolerance != b.sim.output_tolerance)
+        || (a.sim.orrery_dt != b.sim.orrery_dt)) {
+        return false;
+    }
+
+    if (a.kernel_tokens.size() != b.kernel_tokens.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.kernel_tokens.size(); i++) {
+        if ((a.kernel_tokens[i].path != b.kernel_tokens[i].path)
+            || (a.kernel_tokens[i].codes != b.kernel_tokens[i].codes)) {
+            return false;
+        }
+    }
+
+    if (a.spacecraft_tokens.size() != b.spacecraft_tokens.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.spacecraft_tokens.size(); i++) {
+        const auto& craft_a = a.spacecraft_tokens[i];
+        const auto& craft_b = b.spacecraft_tokens[i];
+        if ((int(craft_a.code) != int(craft_b.code))
+            || (craft_a.craft_name != craft_b.craft_name)
+            || !same_command(
+                craft_a.initial_condition, craft_b.initial_condition)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Commands are sorted by start time, so everything before the first one that
+// differs plays out the same way in both plans
+static std::optional<J2000_s>
+first_difference(const CommandTokens& a, const CommandTokens& b)
+{
+    size_t n = std::min(a.size(), b.size());
+    for (size_t i = 0; i < n; i++) {
+        if (!same_command(a[i], b[i])) {
+            return std::min(a[i].start, b[i].start);
+        }
+    }
+    if (a.size() > n) {
+        return a[n].start;
+    }
+    if (b.size() > n) {
+        return b[n].start;
+    }
+    return {};
+}
+
+ScenarioChanges Scenario::changes_from(const Scenario& old) const
+{
+    ScenarioChanges changes;
+    changes.from = std::numeric_limits<double>::infinity();
+
+    if (!same_setup(*this, old)) {
+        changes.setup = true;
+        changes.from  = sim.begin;
+        changes.craft = std::vector<bool>(spacecraft_tokens.size(), true);
+        return changes;
+    }
+
+    for (size_t i = 0; i < spacecraft_tokens.size(); i++) {
+        // A new tolerance changes the craft's steps from the start
+        if (spacecraft_tokens[i].tolerance != old.spacecraft_tokens[i].tolerance) {
+            changes.craft.push_back(true);
+            changes.from = sim.begin;
+            continue;
+        }
+
+        auto t = first_difference(
+            spacecraft_tokens[i].command_tokens,
+            old.spacecraft_tokens[i].command_tokens);
+        changes.craft.push_back(bool(t));
+        if (t && (*t < changes.from)) {
+            changes.from = *t;
+        }
+    }
+
+    return changes;
+}
+
+}
@@ -6,6 +6,7 @@ Copyright (c) 2017-2020 by Kaushik Ghose. Some rights reserved, see LICENSE
 
 #pragma once
 
+#include <algorithm>
 #include <filesystem>
 #include <string>
 #include <unordered_set>
@@ -21,6 +22,19 @@ namespace groho {
 
 namespace fs = std::filesystem;
 
+// What an edit to a scenario changes, as far as the simulation is concerned
+struct ScenarioChanges {
+    bool              setup = false; // grid, kernels or the craft themselves
+    J2000_s           from;          // otherwise, earliest command affected
+    std::vector<bool> craft;         // and whose plans changed
+
+    bool any() const
+    {
+        return setup
+            || (std::find(craft.begin(), craft.end(), true) != craft.end());
+    }
+};
+
 struct Scenario {
 
     Scenario() { ; }
@@ -40,5 +54,8 @@ struct Scenario {
     void log_issues(const Lines& lines) const;
 
     bool operator != (const Scenario& rhs);
+
+    // Compared to an earlier version of this scenario
+    ScenarioChanges changes_from(const Scenario& old) const;
 };
 }
\ No newline at end of file
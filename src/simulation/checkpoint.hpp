@@ -0,0 +1,55 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Every so often during a run we note down everything needed to carry on from
+that point. When an edit to the scenario only changes the later part of a
+plan we can then pick up from the last checkpoint before the change instead of
+starting over.
+*/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "history.hpp"
+#include "state.hpp"
+#include "units.hpp"
+
+namespace groho {
+
+// What an integrator carries from one step to the next besides the State. Each
+// integrator that keeps any derives its own, see Integrator::memory
+struct IntegratorMemory {
+    virtual ~IntegratorMemory() = default;
+};
+
+struct Checkpoint {
+    size_t  step; // first step that is still to be run
+    J2000_s t;    // and its time
+    State   state;
+
+    std::vector<size_t>            plan_progress{}; // see Plan::progress
+    std::vector<History::Snapshot> spacecraft{};    // how far each output got
+
+    std::shared_ptr<const IntegratorMemory> integrator{};
+};
+
+typedef std::vector<Checkpoint> Checkpoints;
+
+// The last checkpoint from before anything at time t was simulated
+inline const Checkpoint*
+last_checkpoint_before(const Checkpoints& checkpoints, J2000_s t)
+{
+    const Checkpoint* found = nullptr;
+    for (const auto& checkpoint : checkpoints) {
+        if (checkpoint.t > t) {
+            break;
+        }
+        found = &checkpoint;
+    }
+    return found;
+}
+
+}
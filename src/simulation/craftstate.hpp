@@ -23,12 +23,14 @@ public:
         pos.resize(codes.size());
         vel.resize(codes.size());
         acc.resize(codes.size());
+        step.resize(codes.size());
     }
 
     size_t idx_of(NAIFbody naif) const { return naif_to_idx_.at(naif); }
 
 public:
-    v3d_vec_t pos, vel, acc;
+    v3d_vec_t           pos, vel, acc;
+    std::vector<double> step; // next step to try, adaptive and block integrators
 
 private:
     std::unordered_map<NAIFbody, size_t> naif_to_idx_;
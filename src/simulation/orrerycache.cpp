@@ -0,0 +1,161 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "orrerycache.hpp"
+#include "profile.hpp"
+#include "serialize.hpp"
+
+#define LOGURU_WITH_STREAMS 1
+#include "loguru.hpp"
+
+namespace groho {
+
+OrreryKey::OrreryKey(const SimParams& sim, const KernelTokens& kernel_tokens)
+    : begin(sim.begin)
+    , end(sim.end)
+    , dt(sim.dt)
+{
+    for (const auto& token : kernel_tokens) {
+        Kernel kernel;
+        kernel.path = token.path;
+
+        // A kernel that has been replaced on disk is a different kernel
+        std::error_code ec;
+        kernel.modified = fs::last_write_time(token.path, ec);
+
+        for (auto code : token.codes) {
+            kernel.codes.push_back(int(code));
+        }
+        std::sort(kernel.codes.begin(), kernel.codes.end());
+        kernels.push_back(kernel);
+    }
+}
+
+bool OrreryKey::operator==(const OrreryKey& rhs) const
+{
+    if ((begin != rhs.begin) || (end != rhs.end) || (dt != rhs.dt)
+        || (kernels.size() != rhs.kernels.size())) {
+        return false;
+    }
+    for (size_t i = 0; i < kernels.size(); i++) {
+        if ((kernels[i].path != rhs.kernels[i].path)
+            || (kernels[i].modified != rhs.kernels[i].modified)
+            || (kernels[i].codes != rhs.kernels[i].codes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool OrreryCache::prepare(
+    const SimParams& sim, const KernelTokens& kernel_tokens)
+{
+    OrreryKey new_key(sim, kernel_tokens);
+    // A failed read may have left NaNs in the cached positions, so we start
+    // over in case the kernel has since been fixed
+    if ((n_steps > 0) && (new_key == key) && !orrery_.failed()) {
+        LOG_S(INFO) << "Reusing orrery (" << retained / (1 << 20)
+                    << " MB of positions cached)";
+        return true;
+    }
+
+    key = new_key;
+    {
+        ProfileScope timer(KERNEL_LOAD);
+        orrery_ = Orrery(sim.begin, sim.end, kernel_tokens, pool);
+        bodies_ = orrery_.get_bodies();
+    }
+    n_steps = std::max(0.0, std::ceil((sim.end - sim.begin) / sim.dt));
+
+    blocks.clear();
+    blocks.resize((n_steps + block_steps - 1) / block_steps);
+    scratch.clear();
+    scratch_block  = SIZE_MAX;
+    window_block   = SIZE_MAX;
+    retained       = 0;
+    output_current = false;
+
+    return false;
+}
+
+void OrreryCache::state_at_step(
+    size_t k, v3d_vec_t& pos, v3d_vec_t& vel, v3d_vec_t& acc)
+{
+    size_t n     = orrery_.size();
+    auto   first = row(k);
+    std::copy(first, first + n, pos.begin());
+    std::copy(first + n, first + 2 * n, vel.begin());
+    std::copy(first + 2 * n, first + 3 * n, acc.begin());
+}
+
+const V3d* OrreryCache::row(size_t k)
+{
+    size_t b = k / block_steps;
+    size_t i = k % block_steps;
+    size_t n = 3 * orrery_.size();
+
+    // Steps are taken in order, so once we are into a new block the records
+    // before it (and the step that leads into it) are done with
+    if (b != window_block) {
+        if (b > 0) {
+            orrery_.release_before(time_at_step(b * block_steps - 1));
+        }
+        window_block = b;
+    }
+
+    if (!blocks[b].empty()) {
+        return &blocks[b][i * n];
+    }
+
+    if (scratch_block != b) {
+        size_t rows = std::min(block_steps, n_steps - b * block_steps);
+        orrery_.state_over(
+            time_at_step(b * block_steps), key.dt, rows, scratch);
+        scratch_block = b;
+
+        size_t bytes = scratch.size() * sizeof(V3d);
+        if (retained + bytes <= budget_bytes) {
+            blocks[b] = scratch;
+            retained += bytes;
+            return &blocks[b][i * n];
+        }
+    }
+    return &scratch[i * n];
+}
+
+bool OrreryCache::output_is_current(
+    const fs::path& outdir, const SimParams& sim) const
+{
+    if (!output_current || (outdir != output_dir) || (sim.rt != output_rt)
+        || (sim.lt != output_lt) || (sim.output != output_mode)
+        || (sim.output_tolerance != output_tolerance)
+        || (sim.orrery_dt != output_orrery_dt)) {
+        return false;
+    }
+    // Someone may have cleaned out the directory under us
+    for (const auto& body : bodies_) {
+        if (!fs::exists(history_file(outdir, body.code))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void OrreryCache::set_output_current(
+    const fs::path& outdir, const SimParams& sim)
+{
+    output_current   = true;
+    output_dir       = outdir;
+    output_rt        = sim.rt;
+    output_lt        = sim.lt;
+    output_mode      = sim.output;
+    output_tolerance = sim.output_tolerance;
+    output_orrery_dt = sim.orrery_dt;
+}
+
+}
@@ -0,0 +1,123 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+The orrery depends only on the kernels, the bodies we pick from them and the
+time grid (begin, end, dt). When we are editing a scenario we mostly change the
+spacecraft plans, so we hold on to the loaded orrery and the body positions we
+have evaluated on that grid, and hand them back on the next run as long as
+those inputs stay the same.
+
+Positions (with velocities and accelerations) are computed in blocks of steps,
+the first time a run asks for them, and retained up to a memory budget. Blocks
+beyond the budget are computed as needed and not kept.
+*/
+
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+#include "orrery.hpp"
+#include "simparams.hpp"
+#include "threadpool.hpp"
+#include "tokens.hpp"
+#include "v3d.hpp"
+
+namespace groho {
+
+namespace fs = std::filesystem;
+
+// Everything that decides what the orrery computes
+struct OrreryKey {
+    struct Kernel {
+        fs::path           path;
+        fs::file_time_type modified;
+        std::vector<int>   codes; // sorted
+    };
+
+    std::vector<Kernel> kernels;
+    J2000_s             begin;
+    J2000_s             end;
+    double              dt;
+
+    OrreryKey() { ; }
+    OrreryKey(const SimParams& sim, const KernelTokens& kernel_tokens);
+
+    bool operator==(const OrreryKey& rhs) const;
+    bool operator!=(const OrreryKey& rhs) const { return !(*this == rhs); }
+};
+
+class OrreryCache {
+public:
+    static constexpr size_t block_steps = 1024;
+
+    static constexpr size_t default_budget = size_t(1) << 30;
+
+    // Kernels are loaded on the pool, if there is one
+    OrreryCache(
+        size_t budget_bytes = default_budget, ThreadPool* pool = nullptr)
+        : budget_bytes(budget_bytes)
+        , pool(pool)
+    {
+    }
+
+    // Load the orrery for this grid, unless we already have it. Returns true
+    // if the cached orrery (and positions) were reused
+    bool prepare(const SimParams& sim, const KernelTokens& kernel_tokens);
+
+    const Orrery&                    orrery() const { return orrery_; }
+    const std::vector<BodyConstant>& bodies() const { return bodies_; }
+
+    // Number of steps in the grid: t_k = begin + k * dt < end
+    size_t steps() const { return n_steps; }
+
+    // Time at step k. This is begin + k * dt, but rounded the same way as the
+    // times in the position blocks, so the two match exactly
+    J2000_s time_at_step(size_t k) const
+    {
+        size_t b = k / block_steps;
+        size_t i = k % block_steps;
+        return (key.begin + b * block_steps * key.dt) + i * key.dt;
+    }
+
+    // Positions, velocities and accelerations of all the bodies at step k
+    void
+    state_at_step(size_t k, v3d_vec_t& pos, v3d_vec_t& vel, v3d_vec_t& acc);
+
+    // The solar system output is a function of the orrery and the output
+    // parameters. Once a run has written it completely we can skip it until
+    // one of these changes
+    bool output_is_current(const fs::path& outdir, const SimParams& sim) const;
+    void set_output_current(const fs::path& outdir, const SimParams& sim);
+
+    size_t retained_bytes() const { return retained; }
+
+private:
+    const V3d* row(size_t k);
+
+    const size_t budget_bytes;
+    ThreadPool*  pool;
+
+    OrreryKey key;
+    Orrery    orrery_;
+    size_t    n_steps = 0;
+
+    std::vector<BodyConstant> bodies_;
+
+    std::vector<v3d_vec_t> blocks; // empty if not computed, or not retained
+    v3d_vec_t              scratch;
+    size_t                 scratch_block = SIZE_MAX;
+    size_t                 window_block  = SIZE_MAX; // orrery records held from
+    size_t                 retained      = 0;
+
+    bool     output_current = false;
+    fs::path output_dir;
+    double   output_rt, output_lt;
+
+    SimParams::Output output_mode;
+    double            output_tolerance;
+    double            output_orrery_dt;
+};
+
+}
@@ -2,9 +2,9 @@
 This file is part of Groho, a simulator for inter-planetary travel and warfare.
 Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
 
-While the spacecraft vel and accel are computed and set explicitly, only the
-position of an orrery body is set. We use a rolling buffer to keep track of this
-and enable vel and accel computations.
+Positions, velocities and accelerations of the orrery bodies at the current
+step. The orrery fills all three in from the ephemeris, so unlike the
+spacecraft there is nothing to integrate here.
 */
 
 #pragma once
@@ -19,74 +19,29 @@ public:
     OrreryState() {}
     OrreryState(
         const std::vector<BodyConstant>& bodies,
-        const std::vector<size_t>&       grav_body_idx,
-        double                           dt)
+        const std::vector<size_t>&       grav_body_idx)
         : bodies_(bodies)
         , grav_body_idx_(grav_body_idx)
-        , dt(dt)
     {
         for (size_t i = 0; i < bodies_.size(); i++) {
             naif_to_idx_[bodies_[i].code] = i;
         }
 
         size_t n = bodies_.size();
-        vec[0].resize(n);
-        vec[1].resize(n);
-        vec[2].resize(n);
+        pos_.resize(n);
+        vel_.resize(n);
+        acc_.resize(n);
     }
 
-    /*
-       idx    0    1    2
-        0    P0   P-2  P-1
-        1    P-1  P0   P-2
-        2    P-2  P-1  P0
+    // For the orrery to fill in
+    v3d_vec_t& pos() { return pos_; }
+    v3d_vec_t& vel() { return vel_; }
+    v3d_vec_t& acc() { return acc_; }
 
-        V0  = (P0 - P-1) / dt
-        V-1 = (P-1 - P-2) / dt
-
-        A0  = (V0 - V-1) / dt
-    */
-
-    v3d_vec_t& next_pos()
-    {
-        idx++;
-        if (idx > 2) {
-            idx = 0;
-        }
-        return vec[idx];
-    }
-
-    const v3d_vec_t& pos() const { return vec[idx]; }
-    const V3d&       pos(size_t i) const { return vec[idx][i]; }
-
-    V3d vel(size_t i) const
-    {
-        switch (idx) {
-        case 0:
-            return (vec[0][i] - vec[2][i]) / dt;
-        case 1:
-            return (vec[1][i] - vec[0][i]) / dt;
-        case 2:
-            return (vec[2][i] - vec[1][i]) / dt;
-        }
-    }
-    V3d acc(size_t i) const
-    {
-        switch (idx) {
-        case 0:
-            //                 V0                            V-1
-            return ((vec[0][i] - vec[2][i]) / dt - (vec[2][i] - vec[1][i]) / dt)
-                / dt;
-        case 1:
-            //                 V0                            V-1
-            return ((vec[1][i] - vec[0][i]) / dt - (vec[0][i] - vec[2][i]) / dt)
-                / dt;
-        case 2:
-            //                 V0                            V-1
-            return ((vec[2][i] - vec[1][i]) / dt - (vec[1][i] - vec[0][i]) / dt)
-                / dt;
-        }
-    }
+    const v3d_vec_t& pos() const { return pos_; }
+    const V3d&       pos(size_t i) const { return pos_[i]; }
+    const V3d&       vel(size_t i) const { return vel_[i]; }
+    const V3d&       acc(size_t i) const { return acc_[i]; }
 
     size_t idx_of(NAIFbody naif) const { return naif_to_idx_.at(naif); }
     size_t size() const { return bodies_.size(); }
@@ -98,14 +53,11 @@ public:
     const std::vector<size_t>& grav_body_idx() const { return grav_body_idx_; }
 
 private:
-    double dt;
-
-    v3d_vec_t vec[3];
-    size_t    idx = 0;
+    v3d_vec_t pos_, vel_, acc_;
 
     std::vector<BodyConstant>            bodies_;
     std::vector<size_t>                  grav_body_idx_;
     std::unordered_map<NAIFbody, size_t> naif_to_idx_;
 };
 
-}
\ No newline at end of file
+}
@@ -5,38 +5,175 @@ Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
 
 #include "simulation.hpp"
 
+#define LOGURU_WITH_STREAMS 1
+#include "loguru.hpp"
+
 namespace groho {
 
-Simulation::Simulation(const Scenario& scenario_, const fs::path& outdir)
+Simulation::Simulation(
+    const Scenario& scenario_,
+    const fs::path& outdir,
+    OrreryCache&    orrery,
+    AsyncWriter*    writer,
+    SampleStream*   stream)
+    : orrery(orrery)
+    , writer(writer)
+    , stream(stream)
 {
     set_from_new_scenario(scenario_, outdir);
 }
 
+Simulation::Simulation(
+    const Scenario&          scenario_,
+    const fs::path&          outdir,
+    OrreryCache&             orrery,
+    const Checkpoint*        resume_from,
+    const std::vector<bool>& rewrite,
+    AsyncWriter*             writer,
+    SampleStream*            stream)
+    : orrery(orrery)
+    , writer(writer)
+    , stream(stream)
+{
+    set_from_new_scenario(scenario_, outdir, resume_from, rewrite);
+}
+
+// The craft files we are going to carry on writing must still hold at least
+// what they held when the checkpoint was taken
+static bool craft_output_intact(
+    const std::vector<NAIFbody>& codes,
+    const fs::path&              outdir,
+    const SimParams&             sim,
+    const Checkpoint&            checkpoint,
+    const std::vector<bool>&     rewrite)
+{
+    for (size_t i = 0; i < codes.size(); i++) {
+        auto path    = history_file(outdir, codes[i]);
+        auto samples = (sim.output == SimParams::CHEBYSHEV)
+            ? chebyshev_records(path)
+            : trajectory_samples(path);
+        if (!samples) {
+            return false;
+        }
+        if (rewrite[i] && (*samples < checkpoint.spacecraft[i].samples)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void Simulation::set_from_new_scenario(
-    const Scenario& scenario_, const fs::path& outdir)
+    const Scenario&          scenario_,
+    const fs::path&          outdir,
+    const Checkpoint*        resume_from,
+    const std::vector<bool>& rewrite)
 {
-    // For our first implementation, we don't do any work reuse
+    // The orrery is only reloaded if the kernels or the time grid changed, and
+    // its output only rewritten if that or the downsampling changed
     scenario = scenario_;
 
-    orrery
-        = Orrery(scenario.sim.begin, scenario.sim.end, scenario.kernel_tokens);
+    // Output of an earlier run has to be on disk before we look at it
+    if (writer) {
+        writer->flush();
+    }
+
+    orrery.prepare(scenario.sim, scenario.kernel_tokens);
 
-    auto bodies = orrery.get_bodies();
+    const auto& bodies = orrery.bodies();
 
-    std::vector<NAIFbody> oo_naifs;
-    for (const auto& oo : bodies) {
-        oo_naifs.push_back(oo.code);
+    write_solar_system = !orrery.output_is_current(outdir, scenario.sim);
+    if (resume_from && write_solar_system) {
+        LOG_S(INFO) << "Solar system output incomplete, starting over";
+        resume_from = nullptr;
     }
-    solar_system = Serialize(scenario.sim, oo_naifs, outdir);
 
     std::vector<NAIFbody> sc_naifs;
     for (const auto& craft : scenario.spacecraft_tokens) {
         sc_naifs.push_back(craft.code);
     }
-    spacecraft = Serialize(scenario.sim, sc_naifs, outdir);
 
-    state
-        = State(bodies, orrery.get_grav_body_idx(), sc_naifs, scenario.sim.dt);
+    if (resume_from
+        && !craft_output_intact(
+            sc_naifs, outdir, scenario.sim, *resume_from, rewrite)) {
+        LOG_S(INFO) << "Spacecraft output has changed, starting over";
+        resume_from = nullptr;
+    }
+    resumed_from = resume_from;
+
+    if (write_solar_system) {
+        std::vector<NAIFbody> oo_naifs;
+        for (const auto& oo : bodies) {
+            oo_naifs.push_back(oo.code);
+        }
+        solar_system = Serialize(
+            scenario.sim,
+            oo_naifs,
+            outdir,
+            writer,
+            scenario.sim.orrery_dt == 0,
+            stream);
+        orrery_samples = 0;
+        orrery_pos.resize(oo_naifs.size());
+    } else {
+        solar_system = Serialize();
+        LOG_S(INFO) << "Solar system output is up to date";
+    }
+
+    if (resumed_from) {
+        std::vector<std::optional<History::Snapshot>> from(sc_naifs.size());
+        for (size_t i = 0; i < sc_naifs.size(); i++) {
+            if (rewrite[i]) {
+                from[i] = resumed_from->spacecraft[i];
+            }
+        }
+        spacecraft
+            = Serialize(scenario.sim, sc_naifs, outdir, from, writer, stream);
+        state      = State(resumed_from->state);
+        return;
+    }
+
+    spacecraft
+        = Serialize(scenario.sim, sc_naifs, outdir, writer, true, stream);
+
+    state = State(bodies, orrery.orrery().get_grav_body_idx(), sc_naifs);
+}
+
+void Simulation::append_solar_system(size_t step)
+{
+    const double orrery_dt = scenario.sim.orrery_dt;
+    if (orrery_dt == 0) {
+        solar_system.append(state.orrery.pos());
+        return;
+    }
+
+    // Cadence times are counted off, like the steps, so they don't drift
+    auto cadence = [&](size_t k) {
+        return J2000_s(scenario.sim.begin + k * orrery_dt);
+    };
+    J2000_s t = orrery.time_at_step(step);
+    for (; cadence(orrery_samples) <= t; orrery_samples++) {
+        orrery.orrery().pos_at(cadence(orrery_samples), orrery_pos);
+        solar_system.append(orrery_pos);
+    }
+
+    // So the trajectories run to the end, however the cadence falls
+    if ((step + 1 == orrery.steps()) && (cadence(orrery_samples - 1) < t)) {
+        solar_system.append(state.orrery.pos());
+    }
+}
+
+void Simulation::close_output()
+{
+    if (stream) {
+        solar_system.stream_last();
+        spacecraft.stream_last();
+        stream->send();
+    }
+    solar_system = Serialize();
+    spacecraft   = Serialize();
+    if (writer) {
+        writer->flush();
+    }
 }
 
 }
\ No newline at end of file
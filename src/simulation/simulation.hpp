@@ -6,7 +6,8 @@ Copyright (c) 2017-2020 by Kaushik Ghose. Some rights reserved, see LICENSE
 
 #include <filesystem>
 
-#include "orrery.hpp"
+#include "checkpoint.hpp"
+#include "orrerycache.hpp"
 #include "scenario.hpp"
 #include "serialize.hpp"
 #include "simparams.hpp"
@@ -18,18 +19,59 @@ namespace fs = std::filesystem;
 
 struct Simulation {
 
-    Simulation(const Scenario& scenario, const fs::path& outdir);
+    // Output is written through the writer, and published on the stream, if
+    // given
+    Simulation(
+        const Scenario& scenario,
+        const fs::path& outdir,
+        OrreryCache&    orrery,
+        AsyncWriter*    writer = nullptr,
+        SampleStream*   stream = nullptr);
 
-    Scenario  scenario;
-    Orrery    orrery;
-    Serialize solar_system, spacecraft;
+    // Pick up from a checkpoint of an earlier run, rewriting the output of
+    // just the craft marked in `rewrite`. If that run's output can't be
+    // carried on from we start from the beginning, and resumed_from is null
+    Simulation(
+        const Scenario&          scenario,
+        const fs::path&          outdir,
+        OrreryCache&             orrery,
+        const Checkpoint*        resume_from,
+        const std::vector<bool>& rewrite,
+        AsyncWriter*             writer = nullptr,
+        SampleStream*            stream = nullptr);
+
+    Scenario      scenario;
+    OrreryCache&  orrery;
+    AsyncWriter*  writer;
+    SampleStream* stream;
+    Serialize     solar_system, spacecraft;
+
+    // False when an earlier run has already written this orrery out
+    bool write_solar_system = true;
 
     State state;
 
-    void
-    set_from_new_scenario(const Scenario& scenario, const fs::path& outdir);
+    const Checkpoint* resumed_from = nullptr;
+
+    void set_from_new_scenario(
+        const Scenario&          scenario,
+        const fs::path&          outdir,
+        const Checkpoint*        resume_from = nullptr,
+        const std::vector<bool>& rewrite     = {});
+
+    bool requires_state_initialization() { return resumed_from == nullptr; }
+
+    // Write out the solar system as of this step. With an orrery cadence the
+    // bodies are instead written at every cadence time up to the step, and at
+    // the last step of the run, straight from the ephemeris
+    void append_solar_system(size_t step);
+
+    // Write out (and stream) the last of the histories and let go of them
+    void close_output();
 
-    bool requires_state_initialization() { return true; }
+private:
+    size_t    orrery_samples = 0; // cadence times written so far
+    v3d_vec_t orrery_pos;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,149 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "adaptive.hpp"
+#include "profile.hpp"
+
+namespace groho {
+
+// Where the bodies are when a step ends between grid points
+struct Midpoint {
+    double       t = std::nan("");
+    v3d_vec_t    pos;
+    GravityField field;
+};
+
+// The last few midpoints we looked up. Craft whose steps are cut short by the
+// same command end, and tries that land on the same stop, share a lookup
+class Midpoints {
+public:
+    static constexpr size_t kept = 8;
+
+    const Midpoint& at(const Orrery& orrery, const State& state, double t)
+    {
+        for (const auto& mid : mids) {
+            if (mid.t == t) {
+                return mid;
+            }
+        }
+        auto& mid = mids[next];
+        next      = (next + 1) % kept;
+        mid.t     = t;
+        mid.pos.resize(orrery.size());
+        orrery.pos_at(t, mid.pos);
+        mid.field.set(state.orrery, mid.pos);
+        return mid;
+    }
+
+private:
+    Midpoint mids[kept];
+    size_t   next = 0;
+};
+
+size_t adaptive_step(
+    const Orrery&              orrery,
+    const GravityField&        field,
+    J2000_s                    t0,
+    const std::vector<double>& tolerance,
+    std::vector<Plan>&         plans,
+    State&                     state,
+    size_t                     begin,
+    size_t                     end)
+{
+    const double t1    = state.t;
+    size_t       taken = 0;
+    Midpoints    mids;
+
+    // A try is too quick to time its gravity and thrust apart, so they go in
+    // with the integration. The orrery between grid points is timed on its own
+    ProfileLap lap;
+
+    for (size_t i = begin; i < end; i++) {
+        V3d    x = state.spacecraft.pos[i];
+        V3d    v = state.spacecraft.vel[i];
+        V3d    a = state.spacecraft.acc[i];
+        double h = state.spacecraft.step[i];
+
+        double t = t0;
+        while (t < t1) {
+            // Cut the step short to land on the grid or a command's start/end
+            // The step is what t actually moves by, which is not quite h once
+            // t + h is rounded. Using h would have the craft drift out of step
+            // with the orrery over many short steps
+            double stop    = std::min<double>(t1, plans[i].next_event(t));
+            bool   clipped = t + h >= stop;
+            double t_next  = clipped ? stop : t + h;
+            double h_try   = t_next - t;
+
+            const v3d_vec_t*    bodies  = &state.orrery.pos();
+            const GravityField* gravity = &field;
+            if (t_next != t1) {
+                lap(INTEGRATION);
+                const auto& mid = mids.at(orrery, state, t_next);
+                lap(ORRERY);
+                bodies  = &mid.pos;
+                gravity = &mid.field;
+            }
+
+            V3d v_half = v + 0.5 * a * h_try;
+            V3d x_next = x + v_half * h_try;
+            V3d a_next;
+            gravitational_acceleration(*gravity, &x_next, &a_next, 1);
+            a_next += plans[i].thrust(state, t_next, x_next, v_half, *bodies);
+
+            double err   = (a_next - a).norm() * h_try * h_try / 6;
+            double scale
+                = err > 0 ? 0.9 * std::cbrt(tolerance[i] / err) : max_scale;
+            scale = std::clamp(scale, min_scale, max_scale);
+
+            if ((err > tolerance[i]) && (h > min_step)) {
+                h = std::max(h_try * scale, min_step);
+                continue;
+            }
+
+            // A step cut short says nothing about how long the next can be
+            h = std::max(clipped ? std::max(h, h_try * scale) : h_try * scale,
+                         min_step);
+
+            x = x_next;
+            v = v_half + 0.5 * a_next * h_try;
+            a = a_next;
+            t = t_next;
+            taken++;
+        }
+
+        x.t                      = t1;
+        state.spacecraft.pos[i]  = x;
+        state.spacecraft.vel[i]  = v;
+        state.spacecraft.acc[i]  = a;
+        state.spacecraft.step[i] = std::min(h, t1 - t0);
+        plans[i].advance(t1);
+    }
+    lap(INTEGRATION);
+
+    return taken;
+}
+
+size_t AdaptiveSteps::step(
+    const Orrery&       orrery,
+    const GravityField& field,
+    J2000_s             t0,
+    std::vector<Plan>&  plans,
+    State&              state,
+    ThreadPool&         pool)
+{
+    std::atomic<size_t> taken = 0;
+    pool.parallel_for(plans.size(), craft_grain, [&](size_t begin, size_t end) {
+        taken += adaptive_step(
+            orrery, field, t0, tolerance, plans, state, begin, end);
+    });
+    return taken;
+}
+
+}
@@ -0,0 +1,59 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Adaptive step velocity Verlet.
+
+With the adaptive integrator dt is the step of the time grid the orrery and
+the outputs are on, and the longest step a craft will take. Inside each grid
+step every craft takes as many steps of its own as it needs to keep the local
+position error, which we estimate as |a1 - a0| h^2 / 6, under its tolerance. A
+craft out in cruise takes one step per grid step while a craft flying by a
+planet takes many short ones.
+
+Steps are cut to end on the grid and on the start and end of commands, so a
+burn begins and ends exactly on time. Where a step ends between grid points
+the orrery positions come straight from the ephemeris.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "integrator.hpp"
+
+namespace groho {
+
+// Carry craft [begin, end) from t0 to state.t. field is the gravity at
+// state.t. Each craft's step size is kept in state.spacecraft.step from one
+// grid step to the next. Returns the number of steps taken
+size_t adaptive_step(
+    const Orrery&              orrery,
+    const GravityField&        field,
+    J2000_s                    t0,
+    const std::vector<double>& tolerance,
+    std::vector<Plan>&         plans,
+    State&                     state,
+    size_t                     begin,
+    size_t                     end);
+
+class AdaptiveSteps : public Integrator {
+public:
+    explicit AdaptiveSteps(const std::vector<double>& tolerance)
+        : tolerance(tolerance)
+    {
+    }
+
+    size_t step(
+        const Orrery&       orrery,
+        const GravityField& field,
+        J2000_s             t0,
+        std::vector<Plan>&  plans,
+        State&              state,
+        ThreadPool&         pool) override;
+
+private:
+    const std::vector<double> tolerance;
+};
+
+}
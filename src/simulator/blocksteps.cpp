@@ -0,0 +1,155 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "blocksteps.hpp"
+#include "profile.hpp"
+
+namespace groho {
+
+// A craft only moves to a coarser level if the error would stay well under
+// the tolerance with the longer step (which has about 8 times the error)
+const double coarsen_margin = 0.8;
+
+size_t BlockSteps::step(
+    const Orrery&       orrery,
+    const GravityField& field,
+    J2000_s             t0_,
+    std::vector<Plan>&  plans,
+    State&              state,
+    ThreadPool&         pool)
+{
+    t0      = t0_;
+    t1      = state.t;
+    tick_dt = (t1 - t0) / ticks;
+
+    levels.assign(max_level + 1, {});
+    level_of.resize(plans.size());
+    for (size_t i = 0; i < plans.size(); i++) {
+        long level  = std::lround(std::log2(dt / state.spacecraft.step[i]));
+        level_of[i] = std::clamp(level, 0l, long(max_level));
+        levels[level_of[i]].push_back(i);
+    }
+
+    size_t taken = 0;
+    for (size_t tick = 0; tick < ticks;) {
+        size_t finest = max_level;
+        while ((finest > 0) && levels[finest].empty()) {
+            finest--;
+        }
+        tick += stride(finest);
+
+        active.clear();
+        for (size_t level = 0; level <= max_level; level++) {
+            if (tick % stride(level) == 0) {
+                active.insert(
+                    active.end(), levels[level].begin(), levels[level].end());
+                levels[level].clear();
+            }
+        }
+
+        // The orrery at the end of dt we have already, other times we look up
+        const v3d_vec_t*    bodies  = &state.orrery.pos();
+        const GravityField* gravity = &field;
+        if (tick != ticks) {
+            ProfileScope timer(ORRERY);
+            mid_bodies.resize(orrery.size());
+            orrery.pos_at(time_at(tick), mid_bodies);
+            mid_field.set(state.orrery, mid_bodies);
+            bodies  = &mid_bodies;
+            gravity = &mid_field;
+        }
+
+        pos.resize(active.size());
+        acc.resize(active.size());
+        pool.parallel_for(
+            active.size(), craft_grain, [&](size_t begin, size_t end) {
+                step_active(tick, *bodies, *gravity, plans, state, begin, end);
+            });
+
+        for (size_t i : active) {
+            levels[level_of[i]].push_back(i);
+        }
+        taken += active.size();
+    }
+
+    for (size_t i = 0; i < plans.size(); i++) {
+        state.spacecraft.pos[i].t = t1;
+        state.spacecraft.step[i]  = dt / double(size_t(1) << level_of[i]);
+        plans[i].advance(t1);
+    }
+
+    return taken;
+}
+
+void BlockSteps::step_active(
+    size_t              tick,
+    const v3d_vec_t&    bodies,
+    const GravityField& gravity,
+    std::vector<Plan>&  plans,
+    State&              state,
+    size_t              begin,
+    size_t              end)
+{
+    auto&        craft = state.spacecraft;
+    const double t     = time_at(tick);
+
+    // The thrust is looked up craft by craft in the middle of the integration,
+    // so it is counted with it
+    ProfileLap lap;
+    for (size_t j = begin; j < end; j++) {
+        size_t i = active[j];
+        double h = t - time_at(tick - stride(level_of[i]));
+        craft.vel[i] += 0.5 * craft.acc[i] * h;
+        craft.pos[i] += craft.vel[i] * h;
+        pos[j] = craft.pos[i];
+    }
+
+    lap(INTEGRATION);
+    gravitational_acceleration(gravity, &pos[begin], &acc[begin], end - begin);
+    lap(GRAVITY);
+
+    for (size_t j = begin; j < end; j++) {
+        size_t i     = active[j];
+        size_t level = level_of[i];
+        double h     = t - time_at(tick - stride(level));
+
+        V3d a = acc[j]
+            + plans[i].thrust(state, t, craft.pos[i], craft.vel[i], bodies);
+        double err = (a - craft.acc[i]).norm() * h * h / 6;
+        craft.vel[i] += 0.5 * a * h;
+        craft.acc[i] = a;
+
+        // A command starting or ending inside the next step. Closing in on
+        // these a level at a time lands the craft within a step of the finest
+        // level of the event
+        J2000_s event        = plans[i].next_event(t);
+        auto    event_within = [&](size_t level) {
+            return event < time_at(tick + stride(level));
+        };
+
+        // Finer for the next step if this one was too coarse. Coarser only if
+        // the longer step still ends on the coarser grid
+        if (err > tolerance[i]) {
+            while ((err > tolerance[i]) && (level < max_level)) {
+                level++;
+                err *= 0.125;
+            }
+        } else if (
+            (level > 0) && (8 * err < coarsen_margin * tolerance[i])
+            && (tick % stride(level - 1) == 0) && !event_within(level - 1)) {
+            level--;
+        }
+        if ((level < max_level) && event_within(level)) {
+            level++;
+        }
+        level_of[i] = level;
+    }
+    lap(INTEGRATION);
+}
+
+}
@@ -0,0 +1,96 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Power of two block time steps.
+
+Each craft steps at dt / 2^level. A craft out in cruise stays at level 0 and
+takes one step per dt, while one deep in a gravity well or in the middle of a
+burn drops down as many levels as it needs. All the craft meet up again at the
+end of every dt.
+
+Because the steps are powers of two, the craft on a level all end their steps
+together: the orrery is evaluated once for each of these times and their
+gravity is computed as a batch. A craft moves to a finer level at the end of
+any of its steps, but only to a coarser one when its next step would still
+line up with the coarser grid. The error of a step is estimated, as for the
+adaptive integrator, as |a1 - a0| h^2 / 6.
+
+Commands don't start and stop on the grid. Instead a craft closes in on a
+command event by halving its step whenever the event falls inside its next
+one, so an event is off by at most dt / 2^max_level. Craft start on the finest
+level and coarsen from there, since there is no step rejection to fall back on.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "integrator.hpp"
+
+namespace groho {
+
+class BlockSteps : public Integrator {
+public:
+    // The finest level: 2^max_level steps per dt
+    static constexpr size_t max_level = 16;
+    static constexpr size_t ticks     = size_t(1) << max_level;
+
+    // Craft start on the finest level and work their way up from there
+    double first_step(double dt) const override { return dt / ticks; }
+
+    BlockSteps(double dt, const std::vector<double>& tolerance)
+        : dt(dt)
+        , tolerance(tolerance)
+    {
+    }
+
+    // Carry every craft from t0 to state.t. field is the gravity at state.t.
+    // The craft's levels are kept in state.spacecraft.step, as dt / 2^level.
+    // Returns the number of craft steps taken
+    size_t step(
+        const Orrery&       orrery,
+        const GravityField& field,
+        J2000_s             t0,
+        std::vector<Plan>&  plans,
+        State&              state,
+        ThreadPool&         pool) override;
+
+private:
+    size_t stride(size_t level) const
+    {
+        return size_t(1) << (max_level - level);
+    }
+    double time_at(size_t tick) const
+    {
+        return tick == ticks ? t1 : t0 + tick * tick_dt;
+    }
+
+    // The part of the active craft [begin, end) that finish a step at tick
+    void step_active(
+        size_t              tick,
+        const v3d_vec_t&    bodies,
+        const GravityField& gravity,
+        std::vector<Plan>&  plans,
+        State&              state,
+        size_t              begin,
+        size_t              end);
+
+    const double              dt;
+    const std::vector<double> tolerance;
+
+    double t0, t1, tick_dt; // of the current dt
+
+    // Craft by level, and the craft that finish a step at the current tick
+    std::vector<std::vector<size_t>> levels;
+    std::vector<size_t>              active;
+    std::vector<size_t>              level_of;
+
+    // Positions and accelerations of the active craft, for the gravity kernel
+    v3d_vec_t pos, acc;
+
+    v3d_vec_t    mid_bodies;
+    GravityField mid_field;
+};
+
+}
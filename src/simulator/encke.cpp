@@ -0,0 +1,311 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "encke.hpp"
+#include "profile.hpp"
+
+#define LOGURU_WITH_STREAMS 1
+#include "loguru.hpp"
+
+namespace groho {
+
+// Stumpff functions c2(z) and c3(z), by their series close to z = 0 where the
+// closed forms cancel out
+static void stumpff(double z, double& c2, double& c3)
+{
+    if (std::abs(z) < 0.1) {
+        c2 = 1.0 / 2;
+        c3 = 1.0 / 6;
+        double term2 = c2, term3 = c3;
+        for (int k = 1; k <= 6; k++) {
+            term2 *= -z / ((2 * k + 1) * (2 * k + 2));
+            term3 *= -z / ((2 * k + 2) * (2 * k + 3));
+            c2 += term2;
+            c3 += term3;
+        }
+    } else if (z > 0) {
+        double s = std::sqrt(z);
+        c2       = (1 - std::cos(s)) / z;
+        c3       = (s - std::sin(s)) / (z * s);
+    } else {
+        double s = std::sqrt(-z);
+        c2       = (std::cosh(s) - 1) / -z;
+        c3       = (std::sinh(s) - s) / (-z * s);
+    }
+}
+
+void kepler_step(
+    const V3d& r0, const V3d& v0, double mu, double dt, V3d& r, V3d& v)
+{
+    if (mu == 0) {
+        r = r0 + v0 * dt;
+        v = v0;
+        return;
+    }
+
+    const double sqrt_mu = std::sqrt(mu);
+    const double r0_n    = r0.norm();
+    const double rv0     = dot(r0, v0) / sqrt_mu;
+    const double alpha   = 2 / r0_n - v0.norm_sq() / mu; // 1 / a
+
+    // Whole revolutions of an ellipse only lose us precision
+    if (alpha > 0) {
+        double period = 2 * M_PI / (sqrt_mu * alpha * std::sqrt(alpha));
+        dt            = std::fmod(dt, period);
+    }
+    if (dt == 0) {
+        r = r0;
+        v = v0;
+        return;
+    }
+
+    // Newton's method on the universal anomaly x, which the time of flight
+    // only grows with. It starts from the mean motion on an ellipse and from
+    // Vallado's guess on a hyperbola, where the time of flight grows too
+    // quickly with x to start anywhere far out. Close to a parabola that guess
+    // can fail, and a straight line will do
+    double x = sqrt_mu * dt * alpha;
+    if (alpha < 0) {
+        double a   = 1 / alpha;
+        double sgn = dt > 0 ? 1 : -1;
+        x          = sgn * std::sqrt(-a)
+            * std::log(
+                  -2 * mu * alpha * dt
+                  / (dot(r0, v0)
+                     + sgn * std::sqrt(-mu * a) * (1 - r0_n * alpha)));
+    }
+    if (!(x * dt > 0)) {
+        x = sqrt_mu * dt / r0_n;
+    }
+    double z = 0, c2 = 0.5, c3 = 1.0 / 6, rn = r0_n;
+    for (int it = 0; it < 100; it++) {
+        z = alpha * x * x;
+        stumpff(z, c2, c3);
+        double x2 = x * x;
+        double t  = rv0 * x2 * c2 + (1 - alpha * r0_n) * x2 * x * c3 + r0_n * x;
+        rn = rv0 * x * (1 - z * c3) + (1 - alpha * r0_n) * x2 * c2 + r0_n;
+        double step = (sqrt_mu * dt - t) / rn;
+        x += step;
+        if (std::abs(step) <= 1e-15 * std::max(std::abs(x), 1.0)) {
+            break;
+        }
+    }
+    z = alpha * x * x;
+    stumpff(z, c2, c3);
+
+    double x2 = x * x;
+    double f  = 1 - x2 / r0_n * c2;
+    double g  = dt - x2 * x / sqrt_mu * c3;
+    V3d    r1 = f * r0 + g * v0;
+    rn        = r1.norm();
+    double fd = sqrt_mu / (rn * r0_n) * x * (z * c3 - 1);
+    double gd = 1 - x2 / rn * c2;
+    v         = fd * r0 + gd * v0;
+    r         = r1;
+}
+
+double Encke::soi(size_t body, const v3d_vec_t& bodies) const
+{
+    if (body == root) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return (bodies[body] - bodies[soi_parent[body]]).norm() * soi_ratio[body];
+}
+
+size_t
+Encke::primary_of(const V3d& pos, size_t from, const v3d_vec_t& bodies) const
+{
+    size_t p = from;
+    if (p == none) {
+        return none;
+    }
+    while ((p != root) && ((pos - bodies[p]).norm() > soi(p, bodies))) {
+        p = soi_parent[p];
+    }
+    for (;;) {
+        auto inner = std::find_if(
+            soi_children[p].begin(), soi_children[p].end(), [&](size_t c) {
+                return (pos - bodies[c]).norm() < soi(c, bodies);
+            });
+        if (inner == soi_children[p].end()) {
+            return p;
+        }
+        p = *inner;
+    }
+}
+
+void Encke::start(const Orrery& orrery, J2000_s t0, const State& state)
+{
+    v3d_vec_t pos(orrery.size()), vel(orrery.size()), acc(orrery.size());
+    orrery.state_at(t0, pos, vel, acc);
+
+    auto GM = [&state](size_t i) { return double(state.orrery.body(i).GM); };
+
+    // Heaviest first, so a body's heavier ones are sorted out before it is
+    std::vector<size_t> massive;
+    for (auto i : state.orrery.grav_body_idx()) {
+        if (GM(i) > 0) {
+            massive.push_back(i);
+        }
+    }
+    std::stable_sort(massive.begin(), massive.end(), [&](size_t a, size_t b) {
+        return GM(a) > GM(b);
+    });
+
+    soi_ratio.assign(orrery.size(), 0);
+    soi_parent.assign(orrery.size(), none);
+    soi_children.assign(orrery.size(), {});
+    root = massive.empty() ? none : massive.front();
+    for (size_t k = 1; k < massive.size(); k++) {
+        size_t j      = massive[k];
+        size_t parent = root;
+        for (size_t m = 1; m < k; m++) {
+            size_t i = massive[m];
+            double r = soi(i, pos);
+            if (((pos[j] - pos[i]).norm() < r) && (r < soi(parent, pos))) {
+                parent = i;
+            }
+        }
+        soi_parent[j] = parent;
+        soi_ratio[j]  = std::pow(GM(j) / GM(parent), 0.4);
+        soi_children[parent].push_back(j);
+    }
+    if (root == none) {
+        LOG_S(WARNING) << "No body has GM data: craft will fly straight";
+    }
+
+    orbit.resize(state.spacecraft.pos.size());
+    for (size_t i = 0; i < orbit.size(); i++) {
+        Orbit& o  = orbit[i];
+        o.primary = primary_of(state.spacecraft.pos[i], root, pos);
+        o.r       = state.spacecraft.pos[i];
+        o.v       = state.spacecraft.vel[i];
+        o.da      = state.spacecraft.acc[i];
+
+        // With no primary the orbit is about the origin
+        if (o.primary != none) {
+            size_t p  = o.primary;
+            o.r       = o.r - pos[p];
+            o.v       = o.v - vel[p];
+            double rn = o.r.norm();
+            o.da      = o.da + (GM(p) / (rn * rn * rn)) * o.r - acc[p];
+        }
+    }
+}
+
+std::shared_ptr<const IntegratorMemory> Encke::memory() const
+{
+    auto saved          = std::make_shared<Memory>();
+    saved->orbit        = orbit;
+    saved->soi_ratio    = soi_ratio;
+    saved->soi_parent   = soi_parent;
+    saved->soi_children = soi_children;
+    saved->root         = root;
+    return saved;
+}
+
+// With nothing to go on the orbits are started over at the next step
+void Encke::restore(const IntegratorMemory* memory)
+{
+    auto saved = dynamic_cast<const Memory*>(memory);
+    if (saved) {
+        orbit        = saved->orbit;
+        soi_ratio    = saved->soi_ratio;
+        soi_parent   = saved->soi_parent;
+        soi_children = saved->soi_children;
+        root         = saved->root;
+    } else {
+        orbit.clear();
+    }
+}
+
+size_t Encke::step(
+    const Orrery&       orrery,
+    const GravityField& field,
+    J2000_s             t0,
+    std::vector<Plan>&  plans,
+    State&              state,
+    ThreadPool&         pool)
+{
+    if (orbit.size() != plans.size()) {
+        ProfileScope timer(ORRERY);
+        start(orrery, t0, state);
+    }
+
+    const double t1     = state.t;
+    const double dt     = t1 - t0;
+    const auto&  bodies = state.orrery.pos();
+
+    // The primary's position, velocity, acceleration and GM
+    const V3d zero{};
+    auto      P    = [&](size_t p) { return p == none ? zero : bodies[p]; };
+    auto V = [&](size_t p) { return p == none ? zero : state.orrery.vel(p); };
+    auto A = [&](size_t p) { return p == none ? zero : state.orrery.acc(p); };
+    auto GM
+        = [&](size_t p) { return p == none ? 0 : state.orrery.body(p).GM; };
+    auto code = [&](size_t p) {
+        return p == none ? 0 : int(state.orrery.body(p).code);
+    };
+
+    // Everything but the primary's pull on the craft, less the pull on the
+    // primary, given the craft's acceleration
+    auto perturbation = [&](const Orbit& o, const V3d& a) {
+        double rn = o.r.norm();
+        return a + (GM(o.primary) / (rn * rn * rn)) * o.r - A(o.primary);
+    };
+
+    auto& pos = state.spacecraft.pos;
+    auto& vel = state.spacecraft.vel;
+    auto& acc = state.spacecraft.acc;
+    pool.parallel_for(plans.size(), craft_grain, [&](size_t begin, size_t end) {
+        ProfileLap lap;
+        for (size_t i = begin; i < end; i++) {
+            Orbit& o = orbit[i];
+            o.v += 0.5 * o.da * dt;
+            kepler_step(o.r, o.v, GM(o.primary), dt, o.r, o.v);
+            pos[i]   = P(o.primary) + o.r;
+            pos[i].t = t1;
+            vel[i]   = V(o.primary) + o.v;
+        }
+        lap(INTEGRATION);
+        gravitational_acceleration(
+            field, &pos[begin], &acc[begin], end - begin);
+        lap(GRAVITY);
+        for (size_t i = begin; i < end; i++) {
+            plans[i].execute(state, acc[i]);
+        }
+        lap(PLANS);
+        for (size_t i = begin; i < end; i++) {
+            Orbit& o = orbit[i];
+            o.da     = perturbation(o, acc[i]);
+            o.v += 0.5 * o.da * dt;
+            vel[i] = V(o.primary) + o.v;
+
+            // The step has to be finished about the primary it started with.
+            // Otherwise the drift and the kicks either side of it would not
+            // agree on whose pull the drift took care of, and the craft would
+            // be off by half a kick of the two primaries' pull
+            size_t p = primary_of(pos[i], o.primary, bodies);
+            if (p != o.primary) {
+                LOG_S(INFO) << "Craft " << i << " switches primary from "
+                            << code(o.primary) << " to " << code(p) << " at "
+                            << J2000_s(t1).as_ut();
+                o.r       = pos[i] - P(p);
+                o.v       = vel[i] - V(p);
+                o.primary = p;
+                o.da      = perturbation(o, acc[i]);
+            }
+        }
+        lap(INTEGRATION);
+    });
+
+    return plans.size();
+}
+
+}
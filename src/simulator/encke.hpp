@@ -0,0 +1,97 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Encke's method.
+
+A craft parked around a planet feels the planet's gravity thousands of times
+more strongly than anything else, and it is the planet's gravity, turning the
+craft round its orbit, that keeps the fixed step integrator's dt short. Encke's
+method follows the craft relative to a primary body instead, working out the
+two body orbit about the primary exactly and integrating only the perturbation
+on it: the other bodies, less the pull they have on the primary, and the
+thrust. These change slowly, so a much longer dt will do.
+
+Here the orbit is started over from where the craft is (rectified) every step,
+the step being a half kick of the perturbation, a drift along the two body
+orbit and another half kick [Wisdom and Holman 1991]. Integrating the deviation
+from an orbit that is rectified only now and then, as Encke did, turns out to
+be far less accurate with velocity Verlet, since the deviation is itself swung
+round the primary once an orbit.
+
+A craft's primary is the smallest sphere of influence it is in, r (m / M)^2/5
+where r is the distance from the body to the heavier one it goes round, of mass
+M. Each body's heavier one is picked out once at the start: the one with the
+smallest sphere of influence around it. As a craft crosses into or out of a
+sphere of influence it switches primaries. Bodies with no GM don't have a
+sphere of influence.
+
+The primary's velocity and acceleration come from the ephemeris, at the grid
+points, so the method only needs the orrery on the grid, like the fixed step
+integrator.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "integrator.hpp"
+
+namespace groho {
+
+// The position and velocity, relative to a body of GM mu, dt after r0, v0 on
+// a two body orbit. Universal variables, so any conic will do
+void kepler_step(
+    const V3d& r0, const V3d& v0, double mu, double dt, V3d& r, V3d& v);
+
+class Encke : public Integrator {
+public:
+    size_t step(
+        const Orrery&       orrery,
+        const GravityField& field,
+        J2000_s             t0,
+        std::vector<Plan>&  plans,
+        State&              state,
+        ThreadPool&         pool) override;
+
+    std::shared_ptr<const IntegratorMemory> memory() const override;
+    void restore(const IntegratorMemory* memory) override;
+
+    // The body craft i goes round, as an index into the orrery's bodies
+    size_t primary(size_t i) const { return orbit[i].primary; }
+
+private:
+    static constexpr size_t none = size_t(-1);
+
+    // Relative to the primary, at the start of the step
+    struct Orbit {
+        size_t primary;
+        V3d    r, v;
+        V3d    da; // the perturbation
+    };
+
+    void   start(const Orrery& orrery, J2000_s t0, const State& state);
+    size_t primary_of(const V3d& pos, size_t from, const v3d_vec_t& bodies)
+        const;
+    double soi(size_t body, const v3d_vec_t& bodies) const;
+
+    std::vector<Orbit> orbit;
+
+    // Bodies' spheres of influence: (m / M)^2/5, the heavier body each is
+    // measured from and the bodies whose spheres are inside its own
+    std::vector<double>              soi_ratio;
+    std::vector<size_t>              soi_parent;
+    std::vector<std::vector<size_t>> soi_children;
+    size_t                           root = none;
+
+    // The orbits, and the spheres of influence picked out at the start
+    struct Memory : public IntegratorMemory {
+        std::vector<Orbit>               orbit;
+        std::vector<double>              soi_ratio;
+        std::vector<size_t>              soi_parent;
+        std::vector<std::vector<size_t>> soi_children;
+        size_t                           root;
+    };
+};
+
+}
@@ -0,0 +1,299 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#include "gaussradau.hpp"
+#include "profile.hpp"
+
+namespace groho {
+
+// The fit has converged once another pass moves b6 by no more than this,
+// relative to the acceleration, or stops getting any better
+const double converged      = 1e-16;
+const size_t max_iterations = 12;
+
+const size_t n_nodes = GaussRadau::n_nodes;
+using Bs             = std::array<V3d, n_nodes>;
+using Table          = std::array<std::array<double, n_nodes>, n_nodes>;
+
+// The acceleration is fit as a0 + g0 s + g1 s (s - h0) + g2 s (s - h0)
+// (s - h1) + ..., each g following from one node in turn. c[j][k] is the
+// coefficient of s^(j + 1) in s (s - h0) ... (s - h(k - 1)), which takes the g
+// over to the b
+static Table radau_newton_to_power()
+{
+    const auto&                     h = GaussRadau::nodes;
+    Table                           c{};
+    std::array<double, n_nodes + 1> p{ 1 };
+    for (size_t k = 0; k < n_nodes; k++) {
+        if (k > 0) {
+            for (size_t j = k; j > 0; j--) {
+                p[j] = p[j - 1] - h[k - 1] * p[j];
+            }
+            p[0] = -h[k - 1] * p[0];
+        }
+        for (size_t j = 0; j <= k; j++) {
+            c[j][k] = p[j];
+        }
+    }
+    return c;
+}
+
+const Table radau_c = radau_newton_to_power();
+
+static double binomial(size_t n, size_t k)
+{
+    double r = 1;
+    for (size_t i = 1; i <= k; i++) {
+        r = r * (n - k + i) / i;
+    }
+    return r;
+}
+
+// Position and velocity a fraction s of the way through a step of h
+static V3d radau_position(
+    const V3d& x, const V3d& v, const V3d& a, const Bs& b, double h, double s)
+{
+    V3d p = b[6] / 72;
+    for (size_t k = 6; k-- > 0;) {
+        p = b[k] / double((k + 2) * (k + 3)) + s * p;
+    }
+    return x + (s * h) * v + (s * s * h * h) * (0.5 * a + s * p);
+}
+
+static V3d
+radau_velocity(const V3d& v, const V3d& a, const Bs& b, double h, double s)
+{
+    V3d q = b[6] / 8;
+    for (size_t k = 6; k-- > 0;) {
+        q = b[k] / double(k + 2) + s * q;
+    }
+    return v + (s * h) * (a + s * q);
+}
+
+// The b over the next step, of the same length, carried on from these:
+// a(1 + u) = a(1) + sum over j of u^(j + 1) sum over k >= j of C(k + 1, j + 1)
+// b_k
+static void radau_carry_over(Bs& b)
+{
+    Bs e{};
+    for (size_t j = 0; j < n_nodes; j++) {
+        for (size_t k = j; k < n_nodes; k++) {
+            e[j] += binomial(k + 1, j + 1) * b[k];
+        }
+    }
+    b = e;
+}
+
+// The same polynomial over a step of h rather than p.h
+static void radau_rescale(GaussRadau::Predictor& p, double h)
+{
+    if (p.h > 0) {
+        double q  = h / p.h;
+        double qj = q;
+        for (size_t j = 0; j < n_nodes; j++) {
+            p.b[j] = p.b[j] * qj;
+            qj *= q;
+        }
+    }
+    p.h = h;
+}
+
+size_t GaussRadau::step(
+    const Orrery&       orrery,
+    const GravityField& field,
+    J2000_s             t0,
+    std::vector<Plan>&  plans,
+    State&              state,
+    ThreadPool&         pool)
+{
+    predict.resize(plans.size());
+
+    const double t  = t0;
+    const double dt = state.t - t;
+    {
+        ProfileScope timer(ORRERY);
+        for (size_t n = 0; n < n_nodes; n++) {
+            bodies[n].resize(orrery.size());
+            orrery.pos_at(t + nodes[n] * dt, bodies[n]);
+            fields[n].set(state.orrery, bodies[n]);
+        }
+    }
+
+    std::atomic<size_t> taken = 0;
+    pool.parallel_for(plans.size(), craft_grain, [&](size_t begin, size_t end) {
+        taken += step_craft(orrery, field, t0, plans, state, begin, end);
+    });
+    return taken;
+}
+
+// The predictors are the only thing carried from step to step
+std::shared_ptr<const IntegratorMemory> GaussRadau::memory() const
+{
+    auto saved     = std::make_shared<Memory>();
+    saved->predict = predict;
+    return saved;
+}
+
+void GaussRadau::restore(const IntegratorMemory* memory)
+{
+    auto saved = dynamic_cast<const Memory*>(memory);
+    if (saved) {
+        predict = saved->predict;
+    } else {
+        predict.clear();
+    }
+}
+
+size_t GaussRadau::step_craft(
+    const Orrery&       orrery,
+    const GravityField& field,
+    J2000_s             t0,
+    std::vector<Plan>&  plans,
+    State&              state,
+    size_t              begin,
+    size_t              end)
+{
+    const double t1    = state.t;
+    size_t       taken = 0;
+
+    // The bodies for a step that is not the whole grid step
+    std::array<v3d_vec_t, n_nodes>    own_bodies;
+    std::array<GravityField, n_nodes> own_fields;
+    v3d_vec_t                         end_bodies;
+    GravityField                      end_field;
+
+    // As with the adaptive integrator gravity and thrust go in with the
+    // integration and the orrery between grid points is timed on its own
+    ProfileLap lap;
+
+    for (size_t i = begin; i < end; i++) {
+        V3d        x = state.spacecraft.pos[i];
+        V3d        v = state.spacecraft.vel[i];
+        V3d        a = state.spacecraft.acc[i];
+        double     h = state.spacecraft.step[i];
+        Predictor& p = predict[i];
+
+        double t = t0;
+        while (t < t1) {
+            double stop    = std::min<double>(t1, plans[i].next_event(t));
+            bool   clipped = t + h >= stop;
+            double t_next  = clipped ? stop : t + h;
+            double h_try   = t_next - t;
+
+            const v3d_vec_t*    node_bodies = bodies.data();
+            const GravityField* node_fields = fields.data();
+            if ((t != t0) || (t_next != t1)) {
+                lap(INTEGRATION);
+                for (size_t n = 0; n < n_nodes; n++) {
+                    own_bodies[n].resize(orrery.size());
+                    orrery.pos_at(t + nodes[n] * h_try, own_bodies[n]);
+                    own_fields[n].set(state.orrery, own_bodies[n]);
+                }
+                lap(ORRERY);
+                node_bodies = own_bodies.data();
+                node_fields = own_fields.data();
+            }
+
+            // Back out the g of the predicted b, then refine them node by node
+            radau_rescale(p, h_try);
+            Bs& b = p.b;
+            Bs  g;
+            for (size_t k = n_nodes; k-- > 0;) {
+                g[k] = b[k];
+                for (size_t j = k + 1; j < n_nodes; j++) {
+                    g[k] = g[k] - radau_c[k][j] * g[j];
+                }
+            }
+
+            double last = std::numeric_limits<double>::infinity();
+            for (size_t it = 0; it < max_iterations; it++) {
+                V3d b6 = b[6];
+                for (size_t n = 0; n < n_nodes; n++) {
+                    double s  = nodes[n];
+                    V3d    xn = radau_position(x, v, a, b, h_try, s);
+                    V3d    vn = radau_velocity(v, a, b, h_try, s);
+                    V3d    an;
+                    gravitational_acceleration(node_fields[n], &xn, &an, 1);
+                    an += plans[i].thrust(
+                        state, t + s * h_try, xn, vn, node_bodies[n]);
+
+                    V3d r = (an - a) / s;
+                    for (size_t m = 0; m < n; m++) {
+                        r = (r - g[m]) / (s - nodes[m]);
+                    }
+                    V3d dg = r - g[n];
+                    g[n]   = r;
+                    for (size_t j = 0; j <= n; j++) {
+                        b[j] += radau_c[j][n] * dg;
+                    }
+                }
+                double change = (b[6] - b6).norm();
+                if ((change <= converged * a.norm())
+                    || ((it > 1) && (change >= last))) {
+                    break;
+                }
+                last = change;
+            }
+
+            double err   = b[6].norm() * h_try * h_try / 72;
+            double scale = err > 0
+                               ? 0.9 * std::pow(tolerance[i] / err, 1.0 / 9)
+                               : max_scale;
+            scale = std::clamp(scale, min_scale, max_scale);
+
+            if ((err > tolerance[i]) && (h > min_step)) {
+                h = std::max(h_try * scale, min_step);
+                continue;
+            }
+
+            const v3d_vec_t*    bodies_next = &state.orrery.pos();
+            const GravityField* field_next  = &field;
+            if (t_next != t1) {
+                lap(INTEGRATION);
+                end_bodies.resize(orrery.size());
+                orrery.pos_at(t_next, end_bodies);
+                end_field.set(state.orrery, end_bodies);
+                lap(ORRERY);
+                bodies_next = &end_bodies;
+                field_next  = &end_field;
+            }
+
+            V3d x_next = radau_position(x, v, a, b, h_try, 1);
+            V3d v_next = radau_velocity(v, a, b, h_try, 1);
+            V3d a_next;
+            gravitational_acceleration(*field_next, &x_next, &a_next, 1);
+            a_next += plans[i].thrust(
+                state, t_next, x_next, v_next, *bodies_next);
+            radau_carry_over(b);
+
+            // A step cut short says nothing about how long the next can be
+            h = std::max(clipped ? std::max(h, h_try * scale) : h_try * scale,
+                         min_step);
+
+            x = x_next;
+            v = v_next;
+            a = a_next;
+            t = t_next;
+            taken++;
+        }
+
+        x.t                      = t1;
+        state.spacecraft.pos[i]  = x;
+        state.spacecraft.vel[i]  = v;
+        state.spacecraft.acc[i]  = a;
+        state.spacecraft.step[i] = std::min(h, t1 - t0);
+        plans[i].advance(t1);
+    }
+    lap(INTEGRATION);
+
+    return taken;
+}
+
+}
@@ -0,0 +1,95 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Gauss-Radau integrator, after IAS15 [Rein and Spiegel 2015, Everhart 1985].
+
+Over a step of H the acceleration is taken to be a polynomial in s = (t - t0)/H
+
+    a(s) = a0 + b0 s + b1 s^2 + ... + b6 s^7
+
+which integrates to the position and velocity in closed form. The b are fit to
+the acceleration at the seven Gauss-Radau nodes of the step, iterating since
+the position at each node depends on the b. The fit makes the step 15th order.
+The b of one step, carried over to the next, start the iteration off close
+enough that two or three passes usually do.
+
+The last term of the position, |b6| H^2 / 72, is a generous estimate of the
+step's error and is held under the craft's tolerance, the same way as the
+adaptive integrator. Being so high order, a craft takes few steps even close in
+to a planet with a tight tolerance, and one per dt out in cruise.
+
+Steps are cut to end on the grid and on the start and end of commands, like
+the adaptive integrator. The bodies at the nodes of a whole grid step are
+looked up once and shared between the craft; a shorter step looks up its own.
+*/
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "integrator.hpp"
+
+namespace groho {
+
+class GaussRadau : public Integrator {
+public:
+    static constexpr size_t n_nodes = 7;
+
+    // Nodes as fractions of a step
+    static constexpr std::array<double, n_nodes> nodes
+        = { 0.0562625605369221464656521910318,
+            0.180240691736892364987579942780,
+            0.352624717113169637373907769648,
+            0.547153626330555383001448554766,
+            0.734210177215410531523210605558,
+            0.885320946839095768090359771030,
+            0.977520613561287501891174488626 };
+
+    explicit GaussRadau(const std::vector<double>& tolerance)
+        : tolerance(tolerance)
+    {
+    }
+
+    size_t step(
+        const Orrery&       orrery,
+        const GravityField& field,
+        J2000_s             t0,
+        std::vector<Plan>&  plans,
+        State&              state,
+        ThreadPool&         pool) override;
+
+    std::shared_ptr<const IntegratorMemory> memory() const override;
+    void restore(const IntegratorMemory* memory) override;
+
+    // The b of a craft's last step, and the step they were fit over
+    struct Predictor {
+        std::array<V3d, n_nodes> b{};
+        double                   h = 0;
+    };
+
+private:
+    struct Memory : public IntegratorMemory {
+        std::vector<Predictor> predict;
+    };
+
+    // Craft [begin, end), as for adaptive_step
+    size_t step_craft(
+        const Orrery&       orrery,
+        const GravityField& field,
+        J2000_s             t0,
+        std::vector<Plan>&  plans,
+        State&              state,
+        size_t              begin,
+        size_t              end);
+
+    const std::vector<double> tolerance;
+    std::vector<Predictor>    predict;
+
+    // The bodies, and their gravity, at the nodes of the whole grid step
+    std::array<v3d_vec_t, n_nodes>    bodies;
+    std::array<GravityField, n_nodes> fields;
+};
+
+}
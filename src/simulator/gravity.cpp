@@ -0,0 +1,166 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <cmath>
+
+#include "gravity.hpp"
+#include "simd.hpp"
+
+#ifdef GROHO_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace groho {
+
+void GravityField::set(const OrreryState& orrery, const v3d_vec_t& pos)
+{
+    const auto& idx = orrery.grav_body_idx();
+    x.resize(idx.size());
+    y.resize(idx.size());
+    z.resize(idx.size());
+    GM.resize(idx.size());
+    for (size_t j = 0; j < idx.size(); j++) {
+        const auto& b = pos[idx[j]];
+        x[j]          = b.x;
+        y[j]          = b.y;
+        z[j]          = b.z;
+        GM[j]         = orrery.body(idx[j]).GM;
+    }
+}
+
+static void gravitational_acceleration_scalar(
+    const GravityField& field, const V3d* pos, V3d* acc, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        double ax = 0, ay = 0, az = 0;
+        for (size_t j = 0; j < field.size(); j++) {
+            double dx = field.x[j] - pos[i].x;
+            double dy = field.y[j] - pos[i].y;
+            double dz = field.z[j] - pos[i].z;
+            double r2 = dx * dx + dy * dy + dz * dz;
+            double f  = field.GM[j] / (r2 * std::sqrt(r2));
+            ax += dx * f;
+            ay += dy * f;
+            az += dz * f;
+        }
+        acc[i] = { ax, ay, az, 0 };
+    }
+}
+
+#ifdef GROHO_X86_SIMD
+
+static void gravitational_acceleration_sse2(
+    const GravityField& field, const V3d* pos, V3d* acc, size_t n)
+{
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        // (x, y) and (z, t) of each craft
+        __m128d xy0 = _mm_loadu_pd(&pos[i].x), zt0 = _mm_loadu_pd(&pos[i].z);
+        __m128d xy1 = _mm_loadu_pd(&pos[i + 1].x),
+                zt1 = _mm_loadu_pd(&pos[i + 1].z);
+
+        __m128d px = _mm_unpacklo_pd(xy0, xy1);
+        __m128d py = _mm_unpackhi_pd(xy0, xy1);
+        __m128d pz = _mm_unpacklo_pd(zt0, zt1);
+
+        __m128d ax = _mm_setzero_pd(), ay = _mm_setzero_pd(),
+                az = _mm_setzero_pd();
+        for (size_t j = 0; j < field.size(); j++) {
+            __m128d dx = _mm_sub_pd(_mm_set1_pd(field.x[j]), px);
+            __m128d dy = _mm_sub_pd(_mm_set1_pd(field.y[j]), py);
+            __m128d dz = _mm_sub_pd(_mm_set1_pd(field.z[j]), pz);
+            __m128d r2 = _mm_add_pd(
+                _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)),
+                _mm_mul_pd(dz, dz));
+            __m128d f = _mm_div_pd(
+                _mm_set1_pd(field.GM[j]), _mm_mul_pd(r2, _mm_sqrt_pd(r2)));
+            ax = _mm_add_pd(ax, _mm_mul_pd(dx, f));
+            ay = _mm_add_pd(ay, _mm_mul_pd(dy, f));
+            az = _mm_add_pd(az, _mm_mul_pd(dz, f));
+        }
+
+        __m128d zero = _mm_setzero_pd();
+        _mm_storeu_pd(&acc[i].x, _mm_unpacklo_pd(ax, ay));
+        _mm_storeu_pd(&acc[i].z, _mm_unpacklo_pd(az, zero));
+        _mm_storeu_pd(&acc[i + 1].x, _mm_unpackhi_pd(ax, ay));
+        _mm_storeu_pd(&acc[i + 1].z, _mm_unpackhi_pd(az, zero));
+    }
+    gravitational_acceleration_scalar(field, pos + i, acc + i, n - i);
+}
+
+GROHO_TARGET_AVX2
+static void gravitational_acceleration_avx2(
+    const GravityField& field, const V3d* pos, V3d* acc, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // Four (x, y, z, t) rows to x, y and z columns
+        __m256d r0 = _mm256_loadu_pd(&pos[i].x);
+        __m256d r1 = _mm256_loadu_pd(&pos[i + 1].x);
+        __m256d r2 = _mm256_loadu_pd(&pos[i + 2].x);
+        __m256d r3 = _mm256_loadu_pd(&pos[i + 3].x);
+
+        __m256d t0 = _mm256_unpacklo_pd(r0, r1); // x0 x1 z0 z1
+        __m256d t1 = _mm256_unpackhi_pd(r0, r1); // y0 y1 t0 t1
+        __m256d t2 = _mm256_unpacklo_pd(r2, r3); // x2 x3 z2 z3
+        __m256d t3 = _mm256_unpackhi_pd(r2, r3); // y2 y3 t2 t3
+
+        __m256d px = _mm256_permute2f128_pd(t0, t2, 0x20);
+        __m256d py = _mm256_permute2f128_pd(t1, t3, 0x20);
+        __m256d pz = _mm256_permute2f128_pd(t0, t2, 0x31);
+
+        // No FMA here, so that we match the scalar loop exactly
+        __m256d ax = _mm256_setzero_pd(), ay = _mm256_setzero_pd(),
+                az = _mm256_setzero_pd();
+        for (size_t j = 0; j < field.size(); j++) {
+            __m256d dx = _mm256_sub_pd(_mm256_set1_pd(field.x[j]), px);
+            __m256d dy = _mm256_sub_pd(_mm256_set1_pd(field.y[j]), py);
+            __m256d dz = _mm256_sub_pd(_mm256_set1_pd(field.z[j]), pz);
+            __m256d rr = _mm256_add_pd(
+                _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+                _mm256_mul_pd(dz, dz));
+            __m256d f = _mm256_div_pd(
+                _mm256_set1_pd(field.GM[j]),
+                _mm256_mul_pd(rr, _mm256_sqrt_pd(rr)));
+            ax = _mm256_add_pd(ax, _mm256_mul_pd(dx, f));
+            ay = _mm256_add_pd(ay, _mm256_mul_pd(dy, f));
+            az = _mm256_add_pd(az, _mm256_mul_pd(dz, f));
+        }
+
+        // And back to (x, y, z, 0) rows
+        __m256d zero = _mm256_setzero_pd();
+        __m256d u0   = _mm256_unpacklo_pd(ax, ay);   // ax0 ay0 ax2 ay2
+        __m256d u1   = _mm256_unpackhi_pd(ax, ay);   // ax1 ay1 ax3 ay3
+        __m256d u2   = _mm256_unpacklo_pd(az, zero); // az0 0 az2 0
+        __m256d u3   = _mm256_unpackhi_pd(az, zero); // az1 0 az3 0
+
+        _mm256_storeu_pd(&acc[i].x, _mm256_permute2f128_pd(u0, u2, 0x20));
+        _mm256_storeu_pd(&acc[i + 1].x, _mm256_permute2f128_pd(u1, u3, 0x20));
+        _mm256_storeu_pd(&acc[i + 2].x, _mm256_permute2f128_pd(u0, u2, 0x31));
+        _mm256_storeu_pd(&acc[i + 3].x, _mm256_permute2f128_pd(u1, u3, 0x31));
+    }
+    gravitational_acceleration_scalar(field, pos + i, acc + i, n - i);
+}
+
+#endif
+
+void gravitational_acceleration(
+    const GravityField& field, const V3d* pos, V3d* acc, size_t n)
+{
+    switch (simd_level()) {
+#ifdef GROHO_X86_SIMD
+    case SimdLevel::AVX2:
+        gravitational_acceleration_avx2(field, pos, acc, n);
+        return;
+    case SimdLevel::SSE2:
+        gravitational_acceleration_sse2(field, pos, acc, n);
+        return;
+#endif
+    default:
+        gravitational_acceleration_scalar(field, pos, acc, n);
+    }
+}
+
+}
@@ -0,0 +1,39 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Gravitational acceleration of spacecraft due to the orrery bodies.
+
+This is the innermost loop of the simulation: every craft against every
+gravitating body, every step. The bodies are copied once a step into a
+structure of arrays and the craft are taken four at a time (two for SSE2): a
+V3d is four doubles, so four craft positions transpose neatly into x, y and z
+vectors. Each pair then costs one square root and one division, for
+GM / (r^2 * r), and the results are bit for bit the same as the scalar loop.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "orrerystate.hpp"
+#include "v3d.hpp"
+
+namespace groho {
+
+// Positions and GM of the gravitating bodies at the current step
+struct GravityField {
+    std::vector<double> x, y, z, GM;
+
+    size_t size() const { return GM.size(); }
+    void   set(const OrreryState& orrery) { set(orrery, orrery.pos()); }
+
+    // With the bodies at pos rather than where the orrery has them
+    void set(const OrreryState& orrery, const v3d_vec_t& pos);
+};
+
+// acc[i] = sum over bodies of GM (b - pos[i]) / |b - pos[i]|^3 for i < n
+void gravitational_acceleration(
+    const GravityField& field, const V3d* pos, V3d* acc, size_t n);
+
+}
@@ -0,0 +1,97 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include "integrator.hpp"
+#include "adaptive.hpp"
+#include "blocksteps.hpp"
+#include "encke.hpp"
+#include "gaussradau.hpp"
+#include "profile.hpp"
+#include "symplectic.hpp"
+
+namespace groho {
+
+std::unique_ptr<Integrator>
+make_integrator(const SimParams& sim, const std::vector<double>& tolerance)
+{
+    switch (sim.integrator) {
+    case SimParams::ADAPTIVE:
+        return std::make_unique<AdaptiveSteps>(tolerance);
+    case SimParams::BLOCK:
+        return std::make_unique<BlockSteps>(sim.dt, tolerance);
+    case SimParams::FOREST_RUTH:
+        return std::make_unique<Symplectic>(Symplectic::forest_ruth());
+    case SimParams::YOSHIDA6:
+        return std::make_unique<Symplectic>(Symplectic::yoshida6());
+    case SimParams::RADAU:
+        return std::make_unique<GaussRadau>(tolerance);
+    case SimParams::ENCKE:
+        return std::make_unique<Encke>();
+    default:
+        return std::make_unique<VelocityVerlet>(sim.dt);
+    }
+}
+
+// Spacecraft don't affect each other, so the steps below work on a range of
+// them [begin, end) and different ranges can be run on different threads
+static void velocity_vertlet_pt1(
+    const double dt, State& state, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        state.spacecraft.vel[i] += 0.5 * state.spacecraft.acc[i] * dt;
+        state.spacecraft.pos[i] += state.spacecraft.vel[i] * dt;
+        state.spacecraft.pos[i].t = state.t;
+    }
+}
+
+static void compute_gravitational_acceleration(
+    const GravityField& field, State& state, size_t begin, size_t end)
+{
+    gravitational_acceleration(
+        field,
+        state.spacecraft.pos.data() + begin,
+        state.spacecraft.acc.data() + begin,
+        end - begin);
+}
+
+static void add_thrust_to_acceleration(
+    std::vector<Plan>& plans, State& state, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        plans[i].execute(state, state.spacecraft.acc[i]);
+    }
+}
+
+static void velocity_vertlet_pt2(
+    const double dt, State& state, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        state.spacecraft.vel[i] += 0.5 * state.spacecraft.acc[i] * dt;
+    }
+}
+
+size_t VelocityVerlet::step(
+    const Orrery&,
+    const GravityField& field,
+    J2000_s,
+    std::vector<Plan>&  plans,
+    State&              state,
+    ThreadPool&         pool)
+{
+    pool.parallel_for(plans.size(), craft_grain, [&](size_t begin, size_t end) {
+        ProfileLap lap;
+        velocity_vertlet_pt1(dt, state, begin, end);
+        lap(INTEGRATION);
+        compute_gravitational_acceleration(field, state, begin, end);
+        lap(GRAVITY);
+        add_thrust_to_acceleration(plans, state, begin, end);
+        lap(PLANS);
+        velocity_vertlet_pt2(dt, state, begin, end);
+        lap(INTEGRATION);
+    });
+    return plans.size();
+}
+
+}
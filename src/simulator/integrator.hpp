@@ -0,0 +1,103 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Integrators.
+
+An integrator carries every craft from one point of the time grid, on which the
+orrery is evaluated and the output is taken, to the next. The scenario picks one
+
+    fixed         velocity Verlet: 2nd order, one force evaluation per dt
+    forest_ruth   symplectic, 4th order, three (symplectic.hpp)
+    yoshida6      symplectic, 6th order, seven (symplectic.hpp)
+    encke         two body orbit about the nearest planet or moon, kicked by
+                  everything else, 2nd order, one per dt (encke.hpp)
+    adaptive      velocity Verlet, steps to a tolerance (adaptive.hpp)
+    block         the same on power of two steps (blocksteps.hpp)
+    radau         Gauss-Radau, 15th order, steps to a tolerance (gaussradau.hpp)
+
+The higher order fixed step integrators cost more per dt but allow a much
+longer dt for the same accuracy, which is what a long cruise needs. radau is
+for close approaches, where it takes few, long steps with a tight tolerance.
+*/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "checkpoint.hpp"
+#include "commands.hpp"
+#include "gravity.hpp"
+#include "orrery.hpp"
+#include "simparams.hpp"
+#include "state.hpp"
+#include "threadpool.hpp"
+
+namespace groho {
+
+// A step for one craft is quick, so a thread needs a few of them to be worth
+// waking up for
+const size_t craft_grain = 32;
+
+// For the integrators that step to a tolerance: steps don't get shorter than
+// this, even if that means missing the tolerance, and may shrink or grow only
+// so much from one try to the next
+const double min_step  = 1e-3;
+const double min_scale = 0.2;
+const double max_scale = 2.0;
+
+class Integrator {
+public:
+    virtual ~Integrator() = default;
+
+    // The step each craft starts with, in state.spacecraft.step
+    virtual double first_step(double dt) const { return dt; }
+
+    // Carry every craft from t0 to state.t. state.orrery has the bodies, and
+    // field their gravity, at state.t. The integrators that carry a craft's
+    // acceleration from one step to the next keep it in state.spacecraft.acc.
+    // Returns the number of craft steps taken
+    virtual size_t step(
+        const Orrery&       orrery,
+        const GravityField& field,
+        J2000_s             t0,
+        std::vector<Plan>&  plans,
+        State&              state,
+        ThreadPool&         pool)
+        = 0;
+
+    // What the integrator carries over from one step to the next, so that a
+    // run resumed from a checkpoint takes the same steps as one that went
+    // straight through. restore(nullptr) starts afresh
+    virtual std::shared_ptr<const IntegratorMemory> memory() const
+    {
+        return nullptr;
+    }
+    virtual void restore(const IntegratorMemory*) {}
+};
+
+// tolerance is per craft, for the integrators that step to one
+std::unique_ptr<Integrator>
+make_integrator(const SimParams& sim, const std::vector<double>& tolerance);
+
+class VelocityVerlet : public Integrator {
+public:
+    explicit VelocityVerlet(double dt)
+        : dt(dt)
+    {
+    }
+
+    size_t step(
+        const Orrery&       orrery,
+        const GravityField& field,
+        J2000_s             t0,
+        std::vector<Plan>&  plans,
+        State&              state,
+        ThreadPool&         pool) override;
+
+private:
+    const double dt;
+};
+
+}
@@ -4,13 +4,17 @@ Copyright (c) 2017-2020 by Kaushik Ghose. Some rights reserved, see LICENSE
 
 This file defines the simulator code
 */
+#include <algorithm>
 #include <chrono>
 #include <cstring> // gcc needs this for strerror
 #include <filesystem>
 
 #include "commands.hpp"
 #include "filelock.hpp"
+#include "gravity.hpp"
 #include "initialorbit.hpp"
+#include "integrator.hpp"
+#include "profile.hpp"
 #include "simulation.hpp"
 #include "simulator.hpp"
 
@@ -22,10 +26,19 @@ namespace groho {
 namespace fs = std::filesystem;
 
 Simulator::Simulator(
-    std::string scn_file, std::string outdir, bool non_interactive)
+    std::string scn_file,
+    std::string outdir,
+    bool        non_interactive,
+    size_t      threads,
+    std::string stream_path)
     : scn_file(scn_file)
     , outdir(outdir)
+    , pool(threads)
+    , orrery_cache(OrreryCache::default_budget, &pool)
 {
+    if (!stream_path.empty()) {
+        stream.reset(new SampleStream(stream_path));
+    }
     keep_looping     = !non_interactive;
     main_loop_thread = std::thread(&Simulator::main_loop, this);
 }
@@ -37,13 +50,21 @@ void Simulator::main_loop()
         if (lines) {
             auto new_scenario = Scenario(*lines);
             if (new_scenario != current_scenario) {
-                if (sim_thread.joinable()) {
-                    keep_running = false;
-                    sim_thread.join();
+                auto new_changes = new_scenario.changes_from(current_scenario);
+                if (sim_thread.joinable() && !new_changes.any()) {
+                    // Nothing that affects the simulation, e.g. a comment
+                    current_scenario = new_scenario;
+                } else {
+                    if (sim_thread.joinable()) {
+                        keep_running = false;
+                        sim_thread.join();
+                    }
+                    current_scenario = new_scenario;
+                    changes          = new_changes;
+                    keep_running     = true;
+                    sim_thread       = std::thread(
+                        &Simulator::run, this, current_scenario);
                 }
-                current_scenario = new_scenario;
-                keep_running     = true;
-                sim_thread       = std::thread(&Simulator::run, this);
             }
         }
         if (keep_looping) {
@@ -65,42 +86,99 @@ void Simulator::quit()
 }
 
 void initialize_ships(Simulation& simulation);
-void velocity_vertlet_pt1(const double dt, State& state);
-void compute_gravitational_acceleration(State& state);
-void add_thrust_to_acceleration(std::vector<Plan>& plans, State& state);
-void velocity_vertlet_pt2(const double dt, State& state);
 void save_manifest(const State& state, std::string outdir);
+static bool take_checkpoint(
+    size_t                   step,
+    Simulation&              simulation,
+    const std::vector<Plan>& plans,
+    const Integrator&        integrator,
+    const Checkpoints&       previous,
+    const std::vector<bool>& rewrite,
+    Checkpoints&             checkpoints);
 
-void Simulator::run()
+void Simulator::run(const Scenario& scenario)
 {
     if (!fs::exists(outdir)) {
         fs::create_directories(outdir);
     }
 
     FileLock lock(outdir);
+    profile().reset();
+
+    // How much of the last run we can keep. If it was cut short, every craft's
+    // output past its last checkpoint is incomplete
+    const Checkpoint* resume_from = nullptr;
+    std::vector<bool> rewrite     = changes.craft;
+    if (!changes.setup) {
+        J2000_s from = changes.from;
+        if (!last_run_complete) {
+            rewrite.assign(rewrite.size(), true);
+            if (!checkpoints.empty() && (checkpoints.back().t < from)) {
+                from = checkpoints.back().t;
+            }
+        }
+        resume_from = last_checkpoint_before(checkpoints, from);
+    }
 
-    Simulation simulation(current_scenario, outdir);
+    Simulation simulation(
+        scenario,
+        outdir,
+        orrery_cache,
+        resume_from,
+        rewrite,
+        &writer,
+        stream.get());
 
-    const auto& sim = current_scenario.sim;
+    const auto& sim = scenario.sim;
     LOG_S(INFO) << "start: " << sim.begin.as_ut();
     LOG_S(INFO) << "end:   " << sim.end.as_ut();
     LOG_S(INFO) << "step:  " << sim.dt;
+    LOG_S(INFO) << "threads: " << pool.size();
+    if (stream) {
+        stream->begin_run(sim.begin, sim.end);
+    }
 
-    auto& state = simulation.state;
+    const bool tuned = (sim.integrator == SimParams::ADAPTIVE)
+                       || (sim.integrator == SimParams::BLOCK)
+                       || (sim.integrator == SimParams::RADAU);
+    if (tuned) {
+        LOG_S(INFO) << "integrator tolerance: " << sim.tolerance << " km";
+    }
 
-    double t     = sim.begin;
-    size_t steps = 0;
+    auto& state  = simulation.state;
+    auto& orrery = simulation.orrery;
 
-    if (simulation.requires_state_initialization()) {
-        // Warm up
-        for (size_t i = 0; i < 4; i++, steps++) {
-            simulation.orrery.pos_at(t, state.orrery.next_pos());
-            t += sim.dt;
-        }
+    std::vector<double> tolerance;
+    for (const auto& token : simulation.scenario.spacecraft_tokens) {
+        tolerance.push_back(token.tolerance.value_or(sim.tolerance));
+    }
+    auto integrator = make_integrator(sim, tolerance);
+
+    // The gravitating bodies at the current step, laid out for the craft loop
+    GravityField field;
+
+    // Times are counted off the step number so that they line up exactly with
+    // the orrery's grid
+    size_t steps   = 0;
+    size_t n_steps = orrery.steps();
+
+    if (simulation.requires_state_initialization() && (n_steps > 0)) {
+        // The craft start off from the orrery at the first step
+        state.t = orrery.time_at_step(steps);
+        orrery.state_at_step(
+            steps, state.orrery.pos(), state.orrery.vel(), state.orrery.acc());
+        steps++;
 
         // Initialize ships state
         initialize_ships(simulation);
-        compute_gravitational_acceleration(state);
+        state.spacecraft.step.assign(
+            state.spacecraft.pos.size(), integrator->first_step(sim.dt));
+        field.set(state.orrery);
+        gravitational_acceleration(
+            field,
+            state.spacecraft.pos.data(),
+            state.spacecraft.acc.data(),
+            state.spacecraft.pos.size());
     }
 
     std::vector<Plan> plans;
@@ -108,20 +186,105 @@ void Simulator::run()
         plans.emplace_back(simulation.scenario.spacecraft_tokens[i], state, i);
     }
 
+    // Checkpoints up to the one we resume from stay as they are. Later ones
+    // still have the output positions of the craft we are not rewriting
+    Checkpoints previous;
+    if (simulation.resumed_from) {
+        LOG_S(INFO) << "Resuming from " << simulation.resumed_from->t.as_ut();
+
+        steps = simulation.resumed_from->step;
+        for (size_t i = 0; i < plans.size(); i++) {
+            plans[i].resume(simulation.resumed_from->plan_progress[i]);
+        }
+        integrator->restore(simulation.resumed_from->integrator.get());
+
+        size_t kept = simulation.resumed_from - checkpoints.data() + 1;
+        previous    = std::move(checkpoints);
+        checkpoints = Checkpoints(previous.begin(), previous.begin() + kept);
+    } else {
+        checkpoints.clear();
+        rewrite.assign(plans.size(), true);
+    }
+    last_run_complete = false;
+
+    // About a hundred checkpoints over the run
+    const size_t checkpoint_steps = std::max(n_steps / 100, size_t(1000));
+    bool         checkpointing    = true;
+
+    size_t craft_steps = 0;
+
     // Main sim
-    for (; t < sim.end && keep_running; t += sim.dt, steps++) {
-        state.t = t;
-        velocity_vertlet_pt1(sim.dt, state);
-        simulation.orrery.pos_at(t, state.orrery.next_pos());
-        compute_gravitational_acceleration(state);
-        add_thrust_to_acceleration(plans, state);
-        velocity_vertlet_pt2(sim.dt, state);
-
-        simulation.solar_system.append(state.orrery.pos());
+    for (; steps < n_steps && keep_running; steps++) {
+        profile().begin_step(steps);
+
+        if (checkpointing
+            && (checkpoints.empty() || (steps % checkpoint_steps == 0))
+            && (checkpoints.empty() || (checkpoints.back().step < steps))) {
+            checkpointing = take_checkpoint(
+                steps,
+                simulation,
+                plans,
+                *integrator,
+                previous,
+                rewrite,
+                checkpoints);
+        }
+
+        {
+            ProfileScope timer(ORRERY);
+            state.t = orrery.time_at_step(steps);
+            orrery.state_at_step(
+                steps,
+                state.orrery.pos(),
+                state.orrery.vel(),
+                state.orrery.acc());
+            field.set(state.orrery);
+        }
+
+        craft_steps += integrator->step(
+            orrery.orrery(),
+            field,
+            orrery.time_at_step(steps - 1),
+            plans,
+            state,
+            pool);
+
+        // Don't write out a step computed from records we couldn't read. The
+        // run stays incomplete and the next one starts over from a checkpoint
+        if (orrery.orrery().failed()) {
+            LOG_S(ERROR) << "Ephemeris records could not be read. Stopping at "
+                         << orrery.time_at_step(steps).as_ut();
+            break;
+        }
+
+        ProfileScope timer(SERIALIZATION);
+        if (simulation.write_solar_system) {
+            simulation.append_solar_system(steps);
+        }
         simulation.spacecraft.append(state.spacecraft.pos);
+        if (stream) {
+            stream->send();
+        }
     }
+    profile().end_steps();
     LOG_S(INFO) << steps << " steps";
+    if (tuned) {
+        LOG_S(INFO) << craft_steps << " craft steps";
+    }
+
+    if (steps == n_steps) {
+        last_run_complete = true;
+        if (simulation.write_solar_system) {
+            orrery.set_output_current(outdir, sim);
+        }
+    }
 
+    // The manifest tells readers the output is ready, so it goes last
+    {
+        ProfileScope timer(SERIALIZATION);
+        simulation.close_output();
+    }
+    profile().write(fs::path(outdir) / "profile.json");
     save_manifest(state, outdir);
 }
 
@@ -138,40 +301,43 @@ void initialize_ships(Simulation& simulation)
     }
 }
 
-void velocity_vertlet_pt1(const double dt, State& state)
+// Returns false if we can't take a complete checkpoint, in which case we
+// shouldn't take any more this run
+static bool take_checkpoint(
+    size_t                   step,
+    Simulation&              simulation,
+    const std::vector<Plan>& plans,
+    const Integrator&        integrator,
+    const Checkpoints&       previous,
+    const std::vector<bool>& rewrite,
+    Checkpoints&             checkpoints)
 {
-    for (size_t i = 0; i < state.spacecraft.pos.size(); i++) {
-        state.spacecraft.vel[i] += 0.5 * state.spacecraft.acc[i] * dt;
-        state.spacecraft.pos[i] += state.spacecraft.vel[i] * dt;
-        state.spacecraft.pos[i].t = state.t;
-    }
-}
+    Checkpoint checkpoint{ step,
+                           simulation.orrery.time_at_step(step),
+                           simulation.state };
 
-void compute_gravitational_acceleration(State& state)
-{
-    for (size_t i = 0; i < state.spacecraft.pos.size(); i++) {
-        state.spacecraft.acc[i] = { 0, 0, 0 };
-        for (size_t g_idx : state.orrery.grav_body_idx()) {
-            auto   r     = state.orrery.pos(g_idx) - state.spacecraft.pos[i];
-            double r_bar = r.norm();
-            auto   f     = state.orrery.body(g_idx).GM / (r_bar * r_bar);
-            state.spacecraft.acc[i] += r * (f / r_bar);
-        }
+    for (const auto& plan : plans) {
+        checkpoint.plan_progress.push_back(plan.progress());
     }
-}
+    checkpoint.integrator = integrator.memory();
 
-void add_thrust_to_acceleration(std::vector<Plan>& plans, State& state)
-{
-    for (size_t i = 0; i < plans.size(); i++) {
-        plans[i].execute(state, state.spacecraft.acc[i]);
+    // The craft we are not rewriting have the output of the earlier run, which
+    // was checkpointed at the same steps
+    checkpoint.spacecraft.resize(plans.size());
+    if (std::find(rewrite.begin(), rewrite.end(), false) != rewrite.end()) {
+        auto earlier = std::find_if(
+            previous.begin(), previous.end(), [step](const Checkpoint& c) {
+                return c.step == step;
+            });
+        if (earlier == previous.end()) {
+            return false;
+        }
+        checkpoint.spacecraft = earlier->spacecraft;
     }
-}
+    simulation.spacecraft.snapshot(checkpoint.spacecraft);
 
-void velocity_vertlet_pt2(const double dt, State& state)
-{
-    for (size_t i = 0; i < state.spacecraft.pos.size(); i++) {
-        state.spacecraft.vel[i] += 0.5 * state.spacecraft.acc[i] * dt;
-    }
+    checkpoints.push_back(std::move(checkpoint));
+    return true;
 }
 
 void save_manifest(const State& state, std::string outdir)
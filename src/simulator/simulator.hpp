@@ -8,26 +8,49 @@ This file declares the simulator code
 #pragma once
 
 #include <atomic>
+#include <memory>
 #include <thread>
 
+#include "asyncwriter.hpp"
+#include "checkpoint.hpp"
+#include "orrerycache.hpp"
+#include "samplestream.hpp"
 #include "scenario.hpp"
+#include "threadpool.hpp"
 
 namespace groho {
 
 class Simulator {
 public:
-    Simulator(std::string scn_file, std::string outdir, bool non_interactive);
+    // With a stream path the samples are also published on a socket there
+    Simulator(
+        std::string scn_file,
+        std::string outdir,
+        bool        non_interactive,
+        size_t      threads     = 0,
+        std::string stream_path = "");
     bool scenario_has_changed();
     void quit();
     void wait_until_done() { main_loop_thread.join(); }
 
 private:
     void main_loop();
-    void run();
+
+    // The thread running this has its own copy of the scenario, since the
+    // main loop goes on updating current_scenario
+    void run(const Scenario& scenario);
 
     const std::string scn_file;
     const std::string outdir;
     Scenario          current_scenario;
+    ScenarioChanges   changes; // from the scenario of the previous run
+    ThreadPool        pool; // spacecraft are integrated in parallel
+    OrreryCache       orrery_cache; // kept across runs
+    Checkpoints       checkpoints;  // of the previous run
+    AsyncWriter       writer;       // all the output goes through this
+
+    std::unique_ptr<SampleStream> stream; // to live viewers, if asked for
+    bool                          last_run_complete = false;
 
     std::thread       sim_thread;
     std::thread       main_loop_thread;
@@ -0,0 +1,99 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+*/
+
+#include <cmath>
+
+#include "profile.hpp"
+#include "symplectic.hpp"
+
+namespace groho {
+
+Symplectic::Symplectic(const std::vector<double>& weights)
+    : kick(weights)
+{
+    drift.push_back(weights.front() / 2);
+    for (size_t k = 1; k < weights.size(); k++) {
+        drift.push_back((weights[k - 1] + weights[k]) / 2);
+    }
+    drift.push_back(weights.back() / 2);
+}
+
+Symplectic Symplectic::forest_ruth()
+{
+    const double x1 = 1 / (2 - std::cbrt(2.0));
+    const double x0 = 1 - 2 * x1;
+    return Symplectic({ x1, x0, x1 });
+}
+
+Symplectic Symplectic::yoshida6()
+{
+    const double w1 = -1.17767998417887100695;
+    const double w2 = 0.235573213359358133684;
+    const double w3 = 0.784513610477557263819;
+    const double w0 = 1 - 2 * (w1 + w2 + w3);
+    return Symplectic({ w3, w2, w1, w0, w1, w2, w3 });
+}
+
+size_t Symplectic::step(
+    const Orrery&       orrery,
+    const GravityField& field,
+    J2000_s             t0,
+    std::vector<Plan>&  plans,
+    State&              state,
+    ThreadPool&         pool)
+{
+    const double t1 = state.t;
+    const double dt = t1 - t0;
+    const size_t n  = kick.size();
+
+    times.resize(n);
+    bodies.resize(n);
+    fields.resize(n, field);
+    {
+        ProfileScope timer(ORRERY);
+        double       c = 0;
+        for (size_t k = 0; k < n; k++) {
+            c += drift[k];
+            times[k] = t0 + c * dt;
+            bodies[k].resize(orrery.size());
+            orrery.pos_at(times[k], bodies[k]);
+            fields[k].set(state.orrery, bodies[k]);
+        }
+    }
+
+    auto& pos = state.spacecraft.pos;
+    auto& vel = state.spacecraft.vel;
+    auto& acc = state.spacecraft.acc;
+    pool.parallel_for(plans.size(), craft_grain, [&](size_t begin, size_t end) {
+        ProfileLap lap;
+        for (size_t k = 0; k < n; k++) {
+            for (size_t i = begin; i < end; i++) {
+                pos[i] += vel[i] * (drift[k] * dt);
+            }
+            lap(INTEGRATION);
+            gravitational_acceleration(
+                fields[k], &pos[begin], &acc[begin], end - begin);
+            lap(GRAVITY);
+            for (size_t i = begin; i < end; i++) {
+                acc[i] += plans[i].thrust(
+                    state, times[k], pos[i], vel[i], bodies[k]);
+            }
+            lap(PLANS);
+            for (size_t i = begin; i < end; i++) {
+                vel[i] += acc[i] * (kick[k] * dt);
+            }
+        }
+        for (size_t i = begin; i < end; i++) {
+            pos[i] += vel[i] * (drift[n] * dt);
+            pos[i].t = t1;
+            plans[i].advance(t1);
+        }
+        lap(INTEGRATION);
+    });
+
+    return plans.size();
+}
+
+}
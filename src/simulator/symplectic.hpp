@@ -0,0 +1,65 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Higher order symplectic integrators.
+
+A leapfrog step of h (drift h/2, kick h, drift h/2) is second order. Composing
+leapfrogs of suitably chosen lengths w1 h, w2 h, ... (some of them negative)
+cancels the error terms up to a higher order [Yoshida 1990]:
+
+    forest_ruth   w = x1, x0, x1: 4th order. This is also Yoshida's
+                  triple jump [Forest and Ruth 1990]
+    yoshida6      w = w3, w2, w1, w0, w1, w2, w3: 6th order, Yoshida's
+                  solution A
+
+The drifts of neighbouring leapfrogs run together, so a step is drift, kick,
+drift ... drift with one kick per leapfrog. In this form the kicks all fall
+inside the step, so the orrery is only looked up between the grid points it
+covers. The bodies at each kick are the same for every craft and are looked
+up once a step.
+
+The thrust is added in at each kick. A command turning on or off part way
+through a step is not caught: as with the fixed step integrator it shows up
+at the next kick.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "integrator.hpp"
+
+namespace groho {
+
+class Symplectic : public Integrator {
+public:
+    // Leapfrogs of these fractions of a step, adding up to 1
+    explicit Symplectic(const std::vector<double>& weights);
+
+    static Symplectic forest_ruth();
+    static Symplectic yoshida6();
+
+    // Drift for drift[k] dt then kick for kick[k] dt, and a final drift
+    const std::vector<double>& drifts() const { return drift; }
+    const std::vector<double>& kicks() const { return kick; }
+
+    size_t step(
+        const Orrery&       orrery,
+        const GravityField& field,
+        J2000_s             t0,
+        std::vector<Plan>&  plans,
+        State&              state,
+        ThreadPool&         pool) override;
+
+private:
+    std::vector<double> drift; // one more than the kicks
+    std::vector<double> kick;
+
+    // The bodies, and their gravity, at each kick
+    std::vector<J2000_s>      times;
+    std::vector<v3d_vec_t>    bodies;
+    std::vector<GravityField> fields;
+};
+
+}
@@ -0,0 +1,193 @@
+#include <random>
+
+#include "catch.hpp"
+
+#include "chebyshev.hpp"
+#include "simd.hpp"
+
+using namespace groho;
+
+void check_xyz_against_reference(SimdLevel level)
+{
+    set_simd_level(level);
+
+    std::mt19937                           gen(42);
+    std::uniform_real_distribution<double> coeff(-1e8, 1e8), time(-1, 1);
+
+    for (size_t n = 2; n < 20; n++) {
+        std::vector<double> A(3 * n);
+        for (auto& a : A) {
+            a = coeff(gen);
+        }
+        for (size_t i = 0; i < 50; i++) {
+            double x = time(gen);
+            double xyz[3];
+            cheby_eval_xyz(A.data(), n, x, xyz);
+            for (size_t j = 0; j < 3; j++) {
+                double ref = cheby_eval_one(A.data() + j * n, n, x);
+                REQUIRE(xyz[j] == Approx(ref).epsilon(1e-12).margin(1e-4));
+            }
+        }
+    }
+
+    set_simd_level(supported_simd_level());
+}
+
+TEST_CASE("Chebyshev xyz kernels match the recurrence", "[CHEBYSHEV]")
+{
+    SECTION("Scalar") { check_xyz_against_reference(SimdLevel::SCALAR); }
+    SECTION("SSE2") { check_xyz_against_reference(SimdLevel::SSE2); }
+    SECTION("AVX2") { check_xyz_against_reference(SimdLevel::AVX2); }
+}
+
+TEST_CASE("Scalar Chebyshev xyz kernel is exact", "[CHEBYSHEV]")
+{
+    set_simd_level(SimdLevel::SCALAR);
+    double A[] = { 1.5, -2.25, 3.0, 0.5, 4.0, 1.0, -1.0, 2.0, 0.25 };
+    double xyz[3];
+    cheby_eval_xyz(A, 3, 0.3, xyz);
+    REQUIRE(xyz[0] == cheby_eval_one(A, 3, 0.3));
+    REQUIRE(xyz[1] == cheby_eval_one(A + 3, 3, 0.3));
+    REQUIRE(xyz[2] == cheby_eval_one(A + 6, 3, 0.3));
+    set_simd_level(supported_simd_level());
+}
+
+TEST_CASE("Chebyshev record evaluated at many times", "[CHEBYSHEV]")
+{
+    std::mt19937                           gen(7);
+    std::uniform_real_distribution<double> coeff(-1e8, 1e8), time(-1, 1);
+
+    for (auto level : { SimdLevel::SCALAR, SimdLevel::AVX2 }) {
+        set_simd_level(level);
+        for (size_t n = 2; n < 16; n++) {
+            std::vector<double> A(3 * n), x(11), xyz(3 * 11);
+            for (auto& a : A) {
+                a = coeff(gen);
+            }
+            for (auto& _x : x) {
+                _x = time(gen);
+            }
+            cheby_eval_xyz_n(A.data(), n, x.data(), x.size(), xyz.data());
+            for (size_t j = 0; j < x.size(); j++) {
+                for (size_t k = 0; k < 3; k++) {
+                    double ref = cheby_eval_one(A.data() + k * n, n, x[j]);
+                    REQUIRE(
+                        xyz[3 * j + k]
+                        == Approx(ref).epsilon(1e-12).margin(1e-4));
+                }
+            }
+        }
+    }
+    set_simd_level(supported_simd_level());
+}
+
+// Everything the orrery evaluates, at one SIMD level
+std::vector<std::vector<double>> evaluate_all(
+    SimdLevel level, const std::vector<double>& A, const std::vector<double>& x)
+{
+    set_simd_level(level);
+    size_t                           n = A.size() / 3, m = x.size();
+    std::vector<std::vector<double>> out(7, std::vector<double>(3 * m));
+    cheby_eval_xyz_n(A.data(), n, x.data(), m, out[0].data());
+    cheby_eval_xyz_d_n(
+        A.data(), n, x.data(), m, out[1].data(), out[2].data(), out[3].data());
+    for (size_t j = 0; j < m; j++) {
+        cheby_eval_xyz(A.data(), n, x[j], &out[4][3 * j]);
+        cheby_eval_xyz_d(
+            A.data(), n, x[j], &out[5][3 * j], &out[6][3 * j], nullptr);
+    }
+    return out;
+}
+
+TEST_CASE("SIMD Chebyshev kernels match the scalar ones exactly", "[CHEBYSHEV]")
+{
+    std::mt19937                           gen(3);
+    std::uniform_real_distribution<double> coeff(-1e8, 1e8), time(-1, 1);
+
+    for (size_t n : { 2, 3, 7, 14, 33 }) {
+        std::vector<double> A(3 * n), x(11);
+        for (auto& a : A) {
+            a = coeff(gen);
+        }
+        for (auto& _x : x) {
+            _x = time(gen);
+        }
+
+        auto scalar = evaluate_all(SimdLevel::SCALAR, A, x);
+        for (size_t j = 0; j < x.size(); j++) {
+            for (size_t k = 0; k < 3; k++) {
+                double ref = cheby_eval_one(A.data() + k * n, n, x[j]);
+                REQUIRE(scalar[0][3 * j + k] == ref);
+                REQUIRE(scalar[4][3 * j + k] == ref);
+            }
+        }
+        REQUIRE(evaluate_all(SimdLevel::SSE2, A, x) == scalar);
+        REQUIRE(evaluate_all(SimdLevel::AVX2, A, x) == scalar);
+    }
+    set_simd_level(supported_simd_level());
+}
+
+// Coefficients of the derivative of a series, by the usual backward recurrence
+std::vector<double> derivative_series(const double* A, size_t n)
+{
+    std::vector<double> D(n + 1, 0.0);
+    for (size_t k = n - 1; k >= 1; k--) {
+        D[k - 1] = D[k + 1] + 2 * k * A[k];
+    }
+    D[0] /= 2;
+    D.resize(n);
+    return D;
+}
+
+TEST_CASE("Chebyshev derivatives", "[CHEBYSHEV]")
+{
+    std::mt19937                           gen(11);
+    std::uniform_real_distribution<double> coeff(-1, 1), time(-1, 1);
+
+    // Series with n > max_cheby_coeff take the plain path
+    for (auto level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 }) {
+        set_simd_level(level);
+        for (size_t n : { 2, 3, 7, 14, 33 }) {
+            std::vector<double> A(3 * n), x(9), xyz(27), dxyz(27), ddxyz(27);
+            for (auto& a : A) {
+                a = coeff(gen);
+            }
+            for (auto& _x : x) {
+                _x = time(gen);
+            }
+
+            cheby_eval_xyz_d_n(
+                A.data(),
+                n,
+                x.data(),
+                x.size(),
+                xyz.data(),
+                dxyz.data(),
+                ddxyz.data());
+
+            // The derivatives grow as n^2 and n^4
+            double margin = 1e-13 * n * n * n * n;
+            for (size_t j = 0; j < x.size(); j++) {
+                double one[3], d[3], dd[3];
+                cheby_eval_xyz_d(A.data(), n, x[j], one, d, dd);
+                for (size_t k = 0; k < 3; k++) {
+                    const double* Ak = A.data() + k * n;
+                    auto          D  = derivative_series(Ak, n);
+                    auto          DD = derivative_series(D.data(), n);
+
+                    double ref    = cheby_eval_one(Ak, n, x[j]);
+                    double ref_d  = cheby_eval_one(D.data(), n, x[j]);
+                    double ref_dd = cheby_eval_one(DD.data(), n, x[j]);
+                    REQUIRE(one[k] == Approx(ref).margin(margin));
+                    REQUIRE(d[k] == Approx(ref_d).margin(margin));
+                    REQUIRE(dd[k] == Approx(ref_dd).margin(margin));
+
+                    REQUIRE(xyz[3 * j + k] == Approx(ref).margin(margin));
+                    REQUIRE(dxyz[3 * j + k] == Approx(ref_d).margin(margin));
+                    REQUIRE(ddxyz[3 * j + k] == Approx(ref_dd).margin(margin));
+                }
+            }
+        }
+    }
+    set_simd_level(supported_simd_level());
+}
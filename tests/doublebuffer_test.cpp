@@ -1,5 +1,6 @@
 #include "catch.hpp"
 
+#include "asyncwriter.hpp"
 #include "threadedbuffer.hpp"
 
 #define LOGURU_WITH_STREAMS 1
@@ -53,4 +54,47 @@ TEST_CASE("Double buffer long", "[BUFFER]")
     }
 
     REQUIRE(data_ok(path, test_size));
-}
\ No newline at end of file
+}
+
+TEST_CASE("One async writer for many files", "[BUFFER]")
+{
+    const size_t n_files = 50, blocks = 40, block_size = 1000;
+
+    std::vector<fs::path> paths;
+    for (size_t f = 0; f < n_files; f++) {
+        paths.push_back(
+            fs::temp_directory_path()
+            / ("groho-async-" + std::to_string(f) + ".bin"));
+    }
+
+    {
+        // A small queue, so that we have to wait on the writer
+        AsyncWriter writer(4 * block_size * sizeof(size_t));
+        for (size_t b = 0; b < blocks; b++) {
+            for (size_t f = 0; f < n_files; f++) {
+                std::vector<size_t> v(block_size);
+                for (size_t i = 0; i < block_size; i++) {
+                    v[i] = b * block_size + i;
+                }
+                std::vector<char> block;
+                append(block, v.data(), v.size());
+                write_at(
+                    &writer,
+                    paths[f],
+                    b * block_size * sizeof(size_t),
+                    std::move(block),
+                    b == 0);
+            }
+            if (b == blocks / 2) {
+                writer.flush();
+                REQUIRE(data_ok(paths[0], (b + 1) * block_size));
+            }
+        }
+    }
+
+    for (const auto& path : paths) {
+        REQUIRE(fs::file_size(path) == blocks * block_size * sizeof(size_t));
+        REQUIRE(data_ok(path, blocks * block_size));
+        fs::remove(path);
+    }
+}
@@ -0,0 +1,66 @@
+#include <random>
+
+#include "catch.hpp"
+
+#include "gravity.hpp"
+#include "simd.hpp"
+
+using namespace groho;
+
+// A sun and a few planets, in km and km^3/s^2
+GravityField test_field()
+{
+    GravityField field;
+    field.x  = { 0, 5.7e7, -1.08e8, 1.2e8, 7.78e8 };
+    field.y  = { 0, 1.0e6, 3.0e6, -8.5e7, 1.1e7 };
+    field.z  = { 0, -2.0e6, 1.0e5, 3.0e3, -1.7e7 };
+    field.GM = { 1.327e11, 2.2032e4, 3.2486e5, 3.986e5, 1.2669e8 };
+    return field;
+}
+
+TEST_CASE("Gravity kernels match the V3d loop", "[GRAVITY]")
+{
+    auto field = test_field();
+
+    std::mt19937                           gen(42);
+    std::uniform_real_distribution<double> coord(-3e8, 3e8);
+
+    // Odd sizes leave a remainder for the scalar tail of the SIMD loops
+    for (size_t n : { 1, 2, 3, 5, 8, 13 }) {
+        v3d_vec_t pos(n), ref(n);
+        for (auto& p : pos) {
+            p = { coord(gen), coord(gen), coord(gen), 123.0 };
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            ref[i] = { 0, 0, 0 };
+            for (size_t j = 0; j < field.size(); j++) {
+                V3d    r     = V3d{ field.x[j], field.y[j], field.z[j] } - pos[i];
+                double r_bar = r.norm();
+                ref[i] += r * (field.GM[j] / (r_bar * r_bar) / r_bar);
+            }
+        }
+
+        set_simd_level(SimdLevel::SCALAR);
+        v3d_vec_t scalar(n);
+        gravitational_acceleration(field, pos.data(), scalar.data(), n);
+
+        for (auto level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 }) {
+            set_simd_level(level);
+            v3d_vec_t acc(n);
+            gravitational_acceleration(field, pos.data(), acc.data(), n);
+            for (size_t i = 0; i < n; i++) {
+                REQUIRE(acc[i].x == Approx(ref[i].x).epsilon(1e-12));
+                REQUIRE(acc[i].y == Approx(ref[i].y).epsilon(1e-12));
+                REQUIRE(acc[i].z == Approx(ref[i].z).epsilon(1e-12));
+                REQUIRE(acc[i].t == 0);
+
+                // Same operations in the same order, so the same bits
+                REQUIRE(acc[i].x == scalar[i].x);
+                REQUIRE(acc[i].y == scalar[i].y);
+                REQUIRE(acc[i].z == scalar[i].z);
+            }
+        }
+    }
+    set_simd_level(supported_simd_level());
+}
@@ -0,0 +1,417 @@
+#include <cmath>
+#include <filesystem>
+
+#include "catch.hpp"
+
+#include "adaptive.hpp"
+#include "blocksteps.hpp"
+#include "encke.hpp"
+#include "gaussradau.hpp"
+#include "symplectic.hpp"
+#include "syntheticspk.hpp"
+
+using namespace groho;
+
+TEST_CASE("Symplectic compositions are of the right order", "[INTEGRATOR]")
+{
+    // A symmetric composition of leapfrogs is 4th order if the cubes of the
+    // weights cancel, 6th order if the fifth powers do as well
+    auto sum = [](const std::vector<double>& w, int p) {
+        double s = 0;
+        for (auto x : w) {
+            s += std::pow(x, p);
+        }
+        return s;
+    };
+
+    auto forest_ruth = Symplectic::forest_ruth();
+    auto yoshida6    = Symplectic::yoshida6();
+    for (auto* method : { &forest_ruth, &yoshida6 }) {
+        const auto& drift = method->drifts();
+        const auto& kick  = method->kicks();
+        REQUIRE(drift.size() == kick.size() + 1);
+        REQUIRE(sum(drift, 1) == Approx(1.0));
+        REQUIRE(sum(kick, 1) == Approx(1.0));
+        REQUIRE(sum(kick, 3) == Approx(0.0).margin(1e-12));
+        for (size_t k = 0; k < drift.size(); k++) {
+            REQUIRE(drift[k] == Approx(drift[drift.size() - 1 - k]));
+        }
+    }
+    REQUIRE(forest_ruth.kicks().size() == 3);
+    REQUIRE(yoshida6.kicks().size() == 7);
+    REQUIRE(sum(yoshida6.kicks(), 5) == Approx(0.0).margin(1e-12));
+}
+
+TEST_CASE("Gauss-Radau nodes", "[INTEGRATOR]")
+{
+    // With s = 0 the nodes are the roots of P7 + P8 at 2s - 1
+    for (double s : GaussRadau::nodes) {
+        double x = 2 * s - 1, p0 = 1, p1 = x;
+        for (int n = 1; n < 8; n++) {
+            double p2 = ((2 * n + 1) * x * p1 - n * p0) / (n + 1);
+            p0        = p1;
+            p1        = p2;
+        }
+        REQUIRE(s > 0);
+        REQUIRE(s < 1);
+        REQUIRE(p0 + p1 == Approx(0.0).margin(1e-13));
+    }
+}
+
+TEST_CASE("Kepler step", "[INTEGRATOR]")
+{
+    const double mu = 398600.4; // Earth
+    V3d          r, v, r2, v2;
+
+    // A circular orbit comes back round after a period, and in between stays
+    // on the circle at the same speed
+    const V3d    r0 = { 7000, 0, 0 };
+    const V3d    v0 = { 0, std::sqrt(mu / 7000), 0 };
+    const double period
+        = 2 * M_PI * std::sqrt(7000.0 * 7000.0 * 7000.0 / mu);
+    kepler_step(r0, v0, mu, period / 3, r, v);
+    REQUIRE(r.norm() == Approx(7000));
+    REQUIRE(v.norm() == Approx(v0.norm()));
+    REQUIRE(r.y == Approx(7000 * std::sin(2 * M_PI / 3)));
+    kepler_step(r0, v0, mu, period, r, v);
+    REQUIRE((r - r0).norm() == Approx(0.0).margin(1e-6));
+
+    // Two steps make one, forwards or back, on an ellipse and a hyperbola
+    for (double speed : { 8.5, 12.0 }) {
+        const V3d w0 = { 0, speed, 1.0 };
+        kepler_step(r0, w0, mu, 5000, r, v);
+        kepler_step(r0, w0, mu, 2000, r2, v2);
+        kepler_step(r2, v2, mu, 3000, r2, v2);
+        REQUIRE((r2 - r).norm() == Approx(0.0).margin(1e-6));
+        REQUIRE((v2 - v).norm() == Approx(0.0).margin(1e-9));
+        kepler_step(r, v, mu, -5000, r2, v2);
+        REQUIRE((r2 - r0).norm() == Approx(0.0).margin(1e-6));
+
+        // Energy and angular momentum are kept
+        double e0 = w0.norm_sq() / 2 - mu / r0.norm();
+        double e1 = v.norm_sq() / 2 - mu / r.norm();
+        REQUIRE(e1 == Approx(e0));
+        REQUIRE(cross(r, v).norm() == Approx(cross(r0, w0).norm()));
+    }
+}
+
+// Craft flown through the solar system a dt at a time, the way the simulator
+// does it. Each starts off at r, v from a body
+struct Flight {
+    struct Start {
+        NAIFbody from;
+        V3d      r, v;
+    };
+
+    Flight(const Orrery& orrery, J2000_s begin, const std::vector<Start>& craft)
+        : orrery(orrery)
+    {
+        std::vector<NAIFbody> codes;
+        for (size_t i = 0; i < craft.size(); i++) {
+            codes.push_back(NAIFbody(-1000 - int(i)));
+        }
+        state = State(orrery.get_bodies(), orrery.get_grav_body_idx(), codes);
+        set_orrery(begin);
+
+        auto& pos = state.spacecraft.pos;
+        auto& vel = state.spacecraft.vel;
+        for (size_t i = 0; i < craft.size(); i++) {
+            size_t b = state.orrery.idx_of(craft[i].from);
+            pos[i]   = state.orrery.pos(b) + craft[i].r;
+            vel[i]   = state.orrery.vel(b) + craft[i].v;
+            plans.emplace_back(SpacecraftToken{}, state, i);
+        }
+        gravitational_acceleration(
+            field, pos.data(), state.spacecraft.acc.data(), pos.size());
+    }
+
+    // Picked up where another flight got to
+    Flight(const Orrery& orrery, const State& from)
+        : orrery(orrery)
+        , state(from)
+        , started(true)
+    {
+        for (size_t i = 0; i < state.spacecraft.pos.size(); i++) {
+            plans.emplace_back(SpacecraftToken{}, state, i);
+        }
+    }
+
+    static double GM(const Orrery& orrery, NAIFbody body)
+    {
+        for (const auto& b : orrery.get_bodies()) {
+            if (b.code == body) {
+                return b.GM;
+            }
+        }
+        return 0;
+    }
+
+    // A circular orbit of radius r about a body, in the xy plane
+    static Start circular(const Orrery& orrery, NAIFbody body, double r)
+    {
+        double v = std::sqrt(GM(orrery, body) / r);
+        return { body, { r, 0, 0 }, { 0, v, 0 } };
+    }
+
+    // n steps of dt. Returns the number of craft steps taken
+    size_t fly(Integrator& integrator, double dt, size_t n, ThreadPool& pool)
+    {
+        if (!started) {
+            state.spacecraft.step.assign(
+                plans.size(), integrator.first_step(dt));
+            started = true;
+        }
+        size_t taken = 0;
+        for (size_t k = 0; k < n; k++) {
+            J2000_s t0 = state.t;
+            set_orrery(t0 + dt);
+            taken += integrator.step(orrery, field, t0, plans, state, pool);
+        }
+        return taken;
+    }
+
+    void set_orrery(J2000_s t)
+    {
+        state.t = t;
+        orrery.state_at(
+            t, state.orrery.pos(), state.orrery.vel(), state.orrery.acc());
+        field.set(state.orrery);
+    }
+
+    const Orrery&     orrery;
+    State             state;
+    std::vector<Plan> plans;
+    GravityField      field;
+    bool              started = false;
+};
+
+// Largest distance between the craft of two flights
+static double largest_difference(const Flight& a, const Flight& b)
+{
+    double d = 0;
+    for (size_t i = 0; i < a.state.spacecraft.pos.size(); i++) {
+        auto diff = a.state.spacecraft.pos[i] - b.state.spacecraft.pos[i];
+        d         = std::max(d, diff.norm());
+    }
+    return d;
+}
+
+TEST_CASE("Block steps", "[INTEGRATOR]")
+{
+    SyntheticKernel kernel;
+    kernel.begin = GregorianDate{ 2020, 1, 1, 0 };
+    kernel.end   = GregorianDate{ 2020, 2, 1, 0 };
+    auto path    = fs::temp_directory_path() / "groho-integrator.bsp";
+    REQUIRE(write_synthetic_spk(path, kernel));
+    Orrery orrery(kernel.begin, kernel.end, { { {}, path } });
+    REQUIRE(orrery.status() == Orrery::StatusCode::OK);
+
+    const J2000_s begin = kernel.begin;
+
+    // Craft in low Earth orbit, which need many steps per dt, and craft in
+    // cruise between the Earth and Mars, which need one
+    std::vector<Flight::Start> craft;
+    for (size_t i = 0; i < 32; i++) {
+        craft.push_back(Flight::circular(orrery, 399, 6800 + 10 * i));
+        craft.push_back(Flight::circular(orrery, 10, 1.8e8 + 1e6 * i));
+    }
+
+    const double        dt = 600, tolerance = 1e-3;
+    const size_t        steps = 36;
+    std::vector<double> tol(craft.size(), tolerance);
+    ThreadPool          one(1), four(4);
+    BlockSteps          block1(dt, tol), block4(dt, tol);
+    Flight              f1(orrery, begin, craft);
+    Flight              f4(orrery, begin, craft);
+
+    size_t taken = 0;
+    for (size_t k = 0; k < steps; k++) {
+        taken += f1.fly(block1, dt, 1, one);
+        f4.fly(block4, dt, 1, four);
+
+        // Every craft ends each dt on the grid, whatever level it is on, and
+        // the threads make no difference
+        for (size_t i = 0; i < craft.size(); i++) {
+            REQUIRE(f1.state.spacecraft.pos[i].t == f1.state.t);
+            REQUIRE(f1.state.spacecraft.pos[i] == f4.state.spacecraft.pos[i]);
+            REQUIRE(f1.state.spacecraft.vel[i] == f4.state.spacecraft.vel[i]);
+        }
+    }
+
+    // The cruising craft have made their way up to one step per dt, while the
+    // ones in orbit are still on fine steps
+    for (size_t i = 0; i < craft.size(); i++) {
+        if (i % 2) {
+            REQUIRE(f1.state.spacecraft.step[i] == dt);
+        } else {
+            REQUIRE(f1.state.spacecraft.step[i] < dt / 16);
+        }
+    }
+
+    // Against the adaptive integrator with a much tighter tolerance. The error
+    // of each step is held under the tolerance, so the craft can be off by
+    // that much for every step they took
+    std::vector<double> tight(craft.size(), 1e-7);
+    AdaptiveSteps       adaptive(tight);
+    Flight              ref(orrery, begin, craft);
+    ref.fly(adaptive, dt, steps, one);
+    REQUIRE(largest_difference(f1, ref) < tolerance * taken / craft.size());
+
+    fs::remove(path);
+}
+
+TEST_CASE("Gauss-Radau through a close approach", "[INTEGRATOR]")
+{
+    SyntheticKernel kernel;
+    kernel.begin = GregorianDate{ 2020, 1, 1, 0 };
+    kernel.end   = GregorianDate{ 2020, 2, 1, 0 };
+    auto path    = fs::temp_directory_path() / "groho-integrator.bsp";
+    REQUIRE(write_synthetic_spk(path, kernel));
+    Orrery orrery(kernel.begin, kernel.end, { { {}, path } });
+
+    // A flyby at 5 km/s, starting at its closest, 6700 km from the Earth
+    const double  mu = Flight::GM(orrery, 399), rp = 6700;
+    const double  vp = std::sqrt(5.0 * 5.0 + 2 * mu / rp);
+    Flight::Start start{ 399, { rp, 0, 0 }, { 0, vp, 0 } };
+
+    ThreadPool pool(1);
+    auto       yoshida6 = Symplectic::yoshida6();
+    Flight     ref(orrery, kernel.begin, { start });
+    ref.fly(yoshida6, 2, 3 * 3600 / 2, pool);
+
+    // A few dozen steps over the three hours, and within the tolerance
+    std::vector<double> tolerance = { 1e-4 };
+    GaussRadau          radau(tolerance);
+    Flight              flyby(orrery, kernel.begin, { start });
+    REQUIRE(flyby.fly(radau, 600, 18, pool) < 100);
+    REQUIRE(largest_difference(flyby, ref) < tolerance[0]);
+
+    fs::remove(path);
+}
+
+TEST_CASE("Resuming from a checkpoint", "[INTEGRATOR]")
+{
+    SyntheticKernel kernel;
+    kernel.begin = GregorianDate{ 2020, 1, 1, 0 };
+    kernel.end   = GregorianDate{ 2020, 2, 1, 0 };
+    auto path    = fs::temp_directory_path() / "groho-integrator.bsp";
+    REQUIRE(write_synthetic_spk(path, kernel));
+    Orrery orrery(kernel.begin, kernel.end, { { {}, path } });
+
+    const std::vector<Flight::Start> craft
+        = { Flight::circular(orrery, 399, 7000),
+            Flight::circular(orrery, 301, 3000) };
+    const double        dt = 600;
+    ThreadPool          pool(1);
+    std::vector<double> tolerance(craft.size(), 1e-6);
+
+    // Straight through, and stopped half way at a checkpoint and picked up by
+    // a new integrator, as a rerun of the scenario would be
+    auto resumes = [&](auto make) {
+        auto   straight = make();
+        Flight through(orrery, kernel.begin, craft);
+        through.fly(straight, dt, 36, pool);
+
+        auto   first = make();
+        Flight half(orrery, kernel.begin, craft);
+        half.fly(first, dt, 18, pool);
+
+        auto second = make();
+        second.restore(first.memory().get());
+        Flight rest(orrery, half.state);
+        rest.fly(second, dt, 18, pool);
+
+        for (size_t i = 0; i < craft.size(); i++) {
+            const auto& a = rest.state.spacecraft;
+            const auto& b = through.state.spacecraft;
+            REQUIRE(a.pos[i] == b.pos[i]);
+            REQUIRE(a.vel[i] == b.vel[i]);
+        }
+    };
+    resumes([&] { return GaussRadau(tolerance); });
+    resumes([] { return Encke(); });
+
+    fs::remove(path);
+}
+
+TEST_CASE("Symplectic integrators converge at their order", "[INTEGRATOR]")
+{
+    SyntheticKernel kernel;
+    kernel.begin = GregorianDate{ 2020, 1, 1, 0 };
+    kernel.end   = GregorianDate{ 2020, 2, 1, 0 };
+    auto path    = fs::temp_directory_path() / "groho-integrator.bsp";
+    REQUIRE(write_synthetic_spk(path, kernel));
+    Orrery orrery(kernel.begin, kernel.end, { { {}, path } });
+
+    // Six hours, about four times round, in low Earth orbit
+    const std::vector<Flight::Start> craft
+        = { Flight::circular(orrery, 399, 7000) };
+    const double        span = 6 * 3600;
+    ThreadPool          pool(1);
+    std::vector<double> tight = { 1e-10 };
+    GaussRadau          radau(tight);
+    Flight              ref(orrery, kernel.begin, craft);
+    ref.fly(radau, 600, span / 600, pool);
+
+    auto error = [&](Symplectic method, double dt) {
+        Flight f(orrery, kernel.begin, craft);
+        f.fly(method, dt, span / dt, pool);
+        return largest_difference(f, ref);
+    };
+
+    // Halving dt cuts the error by 2^4 and 2^6. The steps are long enough for
+    // the error to stand well clear of the reference's
+    double forest_ruth = error(Symplectic::forest_ruth(), 120)
+                         / error(Symplectic::forest_ruth(), 60);
+    double yoshida6    = error(Symplectic::yoshida6(), 240)
+                         / error(Symplectic::yoshida6(), 120);
+    REQUIRE(forest_ruth == Approx(16).epsilon(0.15));
+    REQUIRE(yoshida6 == Approx(64).epsilon(0.15));
+
+    fs::remove(path);
+}
+
+TEST_CASE("Encke switches primaries", "[INTEGRATOR]")
+{
+    SyntheticKernel kernel;
+    kernel.begin = GregorianDate{ 2020, 1, 1, 0 };
+    kernel.end   = GregorianDate{ 2020, 2, 1, 0 };
+    auto path    = fs::temp_directory_path() / "groho-integrator.bsp";
+    REQUIRE(write_synthetic_spk(path, kernel));
+    Orrery orrery(kernel.begin, kernel.end, { { {}, path } });
+
+    // A craft 20000 km from the Moon heading for the Earth at 1 km/s leaves
+    // the Moon's sphere of influence, of about 66000 km, after half a day
+    Flight sky(orrery, kernel.begin, {});
+    size_t earth = sky.state.orrery.idx_of(399);
+    size_t moon  = sky.state.orrery.idx_of(301);
+    V3d    to    = sky.state.orrery.pos(earth) - sky.state.orrery.pos(moon);
+
+    Flight::Start start{ 301, 20000 * to / to.norm(), to / to.norm() };
+
+    const double        dt = 600;
+    ThreadPool          pool(1);
+    Encke               encke;
+    Flight              craft(orrery, kernel.begin, { start });
+    std::vector<size_t> primaries;
+    for (size_t k = 0; k < 144; k++) {
+        craft.fly(encke, dt, 1, pool);
+        if (primaries.empty() || (primaries.back() != encke.primary(0))) {
+            primaries.push_back(encke.primary(0));
+        }
+    }
+    REQUIRE(primaries == std::vector<size_t>{ moon, earth });
+
+    // Close to velocity Verlet on a short step, and far closer than velocity
+    // Verlet on the same step
+    VelocityVerlet fine(5), coarse(dt);
+    Flight         ref(orrery, kernel.begin, { start });
+    Flight         fixed(orrery, kernel.begin, { start });
+    ref.fly(fine, 5, 144 * dt / 5, pool);
+    fixed.fly(coarse, dt, 144, pool);
+    double error = largest_difference(craft, ref);
+    REQUIRE(error < 0.2);
+    REQUIRE(error < largest_difference(fixed, ref) / 10);
+
+    fs::remove(path);
+}
@@ -1,9 +1,40 @@
 #include "catch.hpp"
 
+#include <fstream>
+#include <functional>
+
 #include "orrery.hpp"
+#include "orrerycache.hpp"
+#include "orrerypack.hpp"
+#include "syntheticspk.hpp"
 
 using namespace groho;
 
+// A synthetic solar system, and a kernel to pick two asteroids out of, in place
+// of the JPL kernels. Written for the length of a test
+struct SyntheticKernels {
+    SyntheticKernels()
+    {
+        kernel.end = GregorianDate{ 2011, 1, 1, 0 };
+        auto dir   = fs::temp_directory_path();
+        tokens     = { { {}, dir / "groho-orrery.bsp" },
+                   { { 2000001, 2000002 }, dir / "groho-asteroids.bsp" } };
+        REQUIRE(write_synthetic_spk(tokens[0].path, kernel));
+        SyntheticKernel asteroids = kernel;
+        asteroids.bodies          = 24;
+        REQUIRE(write_synthetic_spk(tokens[1].path, asteroids));
+    }
+    ~SyntheticKernels()
+    {
+        for (const auto& token : tokens) {
+            fs::remove(token.path);
+        }
+    }
+
+    SyntheticKernel kernel;
+    KernelTokens    tokens;
+};
+
 TEST_CASE("Load orrery", "[ORRERY]")
 {
     KernelTokens kernels = { { {}, "groho-test-data/de432s.bsp" },
@@ -36,6 +67,41 @@ TEST_CASE("Load orrery", "[ORRERY]")
     REQUIRE(orrery.get_grav_body_idx().size() == 12);
 }
 
+TEST_CASE("Load orrery on a thread pool", "[ORRERY]")
+{
+    SyntheticKernels synthetic;
+    KernelTokens     kernels = synthetic.tokens;
+    J2000_s          begin   = GregorianDate{ 2000, 1, 1, 0 };
+    J2000_s          end     = GregorianDate{ 2010, 1, 1, 0 };
+
+    Orrery::StatusCode status;
+    auto serial = load_orrery_objects(begin, end, kernels, status);
+    REQUIRE(status == Orrery::StatusCode::OK);
+
+    // Whatever order the loads finish in, we get the same orrery
+    ThreadPool pool(4);
+    for (size_t run = 0; run < 5; run++) {
+        auto parallel = load_orrery_objects(begin, end, kernels, status, &pool);
+        REQUIRE(status == Orrery::StatusCode::OK);
+        REQUIRE(parallel.size() == serial.size());
+        for (size_t i = 1; i < serial.size(); i++) {
+            const auto& a = *serial[i].ephemeris;
+            const auto& b = *parallel[i].ephemeris;
+            REQUIRE(a.target_code == b.target_code);
+            REQUIRE(a.center_code == b.center_code);
+            REQUIRE(a.size() == b.size());
+            REQUIRE(serial[i].parent_idx == parallel[i].parent_idx);
+            REQUIRE(
+                serial[i].gravitational_body == parallel[i].gravitational_body);
+
+            V3d pa, pb;
+            a.eval(begin + 1e6, pa);
+            b.eval(begin + 1e6, pb);
+            REQUIRE(pa == pb);
+        }
+    }
+}
+
 TEST_CASE("Missing kernel file", "[ORRERY]")
 {
     KernelTokens kernels
@@ -77,3 +143,225 @@ TEST_CASE("Load orrery with missing bodies", "[ORRERY]")
     auto orrery = Orrery(begin, end, kernels);
     REQUIRE(orrery.status() == Orrery::StatusCode::WARNING);
 }
+
+TEST_CASE("Orrery states over a time grid", "[ORRERY]")
+{
+    SyntheticKernels synthetic;
+    KernelTokens     kernels = synthetic.tokens;
+    J2000_s          begin   = GregorianDate{ 2000, 1, 1, 0 };
+    J2000_s          end     = GregorianDate{ 2010, 1, 1, 0 };
+
+    auto orrery = Orrery(begin, end, kernels);
+    REQUIRE(orrery.status() == Orrery::StatusCode::OK);
+
+    const double dt = 3600 * 7.5;
+    const size_t n  = 500;
+    const size_t m  = orrery.size();
+    v3d_vec_t    block, pos(m), vel(m), acc(m);
+    orrery.state_over(begin, dt, n, block);
+    REQUIRE(block.size() == 3 * n * m);
+
+    auto near = [](const V3d& a, const V3d& b, double margin) {
+        return (a.x == Approx(b.x).epsilon(1e-12).margin(margin))
+            && (a.y == Approx(b.y).epsilon(1e-12).margin(margin))
+            && (a.z == Approx(b.z).epsilon(1e-12).margin(margin));
+    };
+
+    for (size_t k = 0; k < n; k++) {
+        orrery.state_at(begin + k * dt, pos, vel, acc);
+        for (size_t i = 0; i < m; i++) {
+            const auto& p = block[3 * k * m + i];
+            const auto& v = block[(3 * k + 1) * m + i];
+            const auto& a = block[(3 * k + 2) * m + i];
+            REQUIRE(p.t == pos[i].t);
+            REQUIRE(v.t == pos[i].t);
+            REQUIRE(a.t == pos[i].t);
+            REQUIRE(near(p, pos[i], 1e-6));
+            REQUIRE(near(v, vel[i], 1e-12));
+            REQUIRE(near(a, acc[i], 1e-18));
+        }
+    }
+}
+
+TEST_CASE("Orrery velocities and accelerations", "[ORRERY]")
+{
+    SyntheticKernels synthetic;
+    KernelTokens     kernels = synthetic.tokens;
+    J2000_s          begin   = GregorianDate{ 2000, 1, 1, 0 };
+    J2000_s          end     = GregorianDate{ 2010, 1, 1, 0 };
+
+    auto         orrery = Orrery(begin, end, kernels);
+    const size_t m      = orrery.size();
+    v3d_vec_t    pos(m), vel(m), acc(m), before(m), after(m);
+
+    // Against central differences of the positions, in the middle of a record
+    // so they don't straddle two fits. The second difference takes a longer
+    // step, since the rounding in the positions is divided by h^2
+    const double record = synthetic.kernel.record_s;
+    const double h      = 10, h_acc = 1e4;
+    for (double t = begin + record / 2; t < end; t += record * 11) {
+        orrery.state_at(t, pos, vel, acc);
+        orrery.pos_at(t - h, before);
+        orrery.pos_at(t + h, after);
+        for (size_t i = 0; i < m; i++) {
+            V3d fd_vel = (after[i] - before[i]) / (2 * h);
+            REQUIRE((fd_vel - vel[i]).norm() < 1e-6 * vel[i].norm());
+        }
+        orrery.pos_at(t - h_acc, before);
+        orrery.pos_at(t + h_acc, after);
+        for (size_t i = 0; i < m; i++) {
+            V3d fd_acc = (after[i] - pos[i] * 2 + before[i]) / (h_acc * h_acc);
+            REQUIRE((fd_acc - acc[i]).norm() < 1e-3 * acc[i].norm());
+        }
+    }
+}
+
+TEST_CASE("Orrery pack", "[ORRERY]")
+{
+    SyntheticKernels synthetic;
+    KernelTokens     kernels = synthetic.tokens;
+    J2000_s          begin   = GregorianDate{ 2000, 1, 1, 0 };
+    J2000_s          end     = GregorianDate{ 2010, 1, 1, 0 };
+
+    auto pack_path = fs::temp_directory_path() / "groho-test.pack";
+    REQUIRE(write_orrery_pack(pack_path, begin, end, kernels));
+    REQUIRE(is_orrery_pack(pack_path));
+    REQUIRE(!is_orrery_pack(kernels[0].path));
+
+    Orrery::StatusCode status;
+    auto from_kernels = load_orrery_objects(begin, end, kernels, status);
+    REQUIRE(status == Orrery::StatusCode::OK);
+
+    // Any part of the packed range, in the same order as from the kernels
+    J2000_s      sub_begin = GregorianDate{ 2003, 5, 1, 0 };
+    J2000_s      sub_end   = GregorianDate{ 2004, 1, 1, 0 };
+    KernelTokens packed    = { { {}, pack_path } };
+    auto from_pack = load_orrery_objects(sub_begin, sub_end, packed, status);
+    REQUIRE(status == Orrery::StatusCode::OK);
+    REQUIRE(from_pack.size() == from_kernels.size());
+    for (size_t i = 1; i < from_pack.size(); i++) {
+        REQUIRE(
+            from_pack[i].ephemeris->target_code
+            == from_kernels[i].ephemeris->target_code);
+        REQUIRE(from_pack[i].parent_idx == from_kernels[i].parent_idx);
+        REQUIRE(
+            from_pack[i].gravitational_body
+            == from_kernels[i].gravitational_body);
+    }
+
+    auto         orrery = Orrery(begin, end, kernels);
+    auto         pack   = Orrery(sub_begin, sub_end, packed);
+    const size_t m      = orrery.size();
+    v3d_vec_t    pos(m), vel(m), acc(m), p_pos(m), p_vel(m), p_acc(m);
+    for (double t = sub_begin; t <= sub_end; t += 86400 * 3.7) {
+        orrery.state_at(t, pos, vel, acc);
+        pack.state_at(t, p_pos, p_vel, p_acc);
+        for (size_t i = 0; i < m; i++) {
+            REQUIRE(p_pos[i].x == pos[i].x);
+            REQUIRE(p_pos[i].y == pos[i].y);
+            REQUIRE(p_pos[i].z == pos[i].z);
+            REQUIRE(p_vel[i].x == vel[i].x);
+            REQUIRE(p_acc[i].z == acc[i].z);
+        }
+    }
+
+    // Outside the packed range
+    auto outside = Orrery(begin, GregorianDate{ 2011, 1, 1, 0 }, packed);
+    REQUIRE(outside.status() == Orrery::StatusCode::ERROR);
+
+    // A pack does not mix with other kernels
+    KernelTokens mixed = { { {}, pack_path }, kernels[1] };
+    REQUIRE(
+        Orrery(begin, end, mixed).status() == Orrery::StatusCode::ERROR);
+
+    fs::remove(pack_path);
+}
+
+TEST_CASE("Corrupt pack entries", "[ORRERY]")
+{
+    SyntheticKernels synthetic;
+    J2000_s          begin = GregorianDate{ 2000, 1, 1, 0 };
+    J2000_s          end   = GregorianDate{ 2010, 1, 1, 0 };
+
+    auto pack_path = fs::temp_directory_path() / "groho-corrupt.pack";
+
+    // Each of these would have us read past a record or compute the records
+    // to load from nonsense
+    std::vector<std::function<void(PackObject&)>> damage
+        = { [](PackObject& obj) { obj.stride = 3 * obj.n_coeff - 1; },
+            [](PackObject& obj) { obj.interval_s = 0; },
+            [](PackObject& obj) { obj.interval_s = -obj.interval_s; },
+            [](PackObject& obj) { obj.begin_s += 1e10; } };
+
+    KernelTokens packed = { { {}, pack_path } };
+    for (auto& f : damage) {
+        REQUIRE(write_orrery_pack(pack_path, begin, end, synthetic.tokens));
+        {
+            std::fstream file(
+                pack_path, std::ios::in | std::ios::out | std::ios::binary);
+            PackObject   obj;
+            file.seekg(sizeof(PackHeader) + 3 * sizeof(PackObject));
+            file.read((char*)&obj, sizeof(obj));
+            f(obj);
+            file.seekp(sizeof(PackHeader) + 3 * sizeof(PackObject));
+            file.write((const char*)&obj, sizeof(obj));
+            REQUIRE(file.good());
+        }
+        Orrery::StatusCode status;
+        load_orrery_objects(begin, end, packed, status);
+        REQUIRE(status == Orrery::StatusCode::ERROR);
+    }
+
+    fs::remove(pack_path);
+}
+
+TEST_CASE("Orrery cache", "[ORRERY]")
+{
+    SyntheticKernels synthetic;
+    KernelTokens     kernels = synthetic.tokens;
+    SimParams        sim;
+    sim.begin = GregorianDate{ 2000, 1, 1, 0 };
+    sim.end   = GregorianDate{ 2000, 3, 1, 0 };
+    sim.dt    = 600;
+
+    // Small budget, so that some blocks are retained and some are not
+    OrreryCache cache(2 * OrreryCache::block_steps * 3 * 22 * sizeof(V3d));
+    REQUIRE(!cache.prepare(sim, kernels));
+    REQUIRE(cache.prepare(sim, kernels));
+    REQUIRE(cache.steps() == size_t(std::ceil((sim.end - sim.begin) / sim.dt)));
+
+    auto      orrery = Orrery(sim.begin, sim.end, kernels);
+    size_t    m      = orrery.size();
+    v3d_vec_t ref(m), ref_vel(m), ref_acc(m), pos(m), vel(m), acc(m);
+
+    auto near = [](double a, double b) {
+        return a == Approx(b).epsilon(1e-12).margin(1e-6);
+    };
+
+    // Twice, the second time from the retained blocks
+    for (size_t pass = 0; pass < 2; pass++) {
+        for (size_t k = 0; k < cache.steps(); k += 37) {
+            double t = cache.time_at_step(k);
+            REQUIRE(t == Approx(sim.begin + k * sim.dt));
+            orrery.state_at(t, ref, ref_vel, ref_acc);
+            cache.state_at_step(k, pos, vel, acc);
+            for (size_t i = 0; i < m; i++) {
+                REQUIRE(pos[i].t == t);
+                REQUIRE(near(pos[i].x, ref[i].x));
+                REQUIRE(near(pos[i].y, ref[i].y));
+                REQUIRE(near(pos[i].z, ref[i].z));
+                REQUIRE(vel[i].x == Approx(ref_vel[i].x).epsilon(1e-12));
+                REQUIRE(acc[i].x == Approx(ref_acc[i].x).epsilon(1e-12));
+            }
+        }
+    }
+    REQUIRE(cache.retained_bytes() > 0);
+
+    SimParams longer = sim;
+    longer.end       = GregorianDate{ 2000, 4, 1, 0 };
+    REQUIRE(!cache.prepare(longer, kernels));
+
+    kernels[1].codes = { 2000001 };
+    REQUIRE(!cache.prepare(longer, kernels));
+    REQUIRE(cache.prepare(longer, kernels));
+}
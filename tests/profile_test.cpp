@@ -0,0 +1,62 @@
+#include <fstream>
+#include <sstream>
+
+#include "catch.hpp"
+
+#include "profile.hpp"
+
+using namespace groho;
+
+TEST_CASE("Step latencies fall in their bins", "[PROFILE]")
+{
+    for (uint64_t v = 0; v < (uint64_t(1) << 40); v = v * 1.3 + 1) {
+        size_t   b  = Profile::bin_of(v);
+        uint64_t lo = Profile::bin_lower(b);
+        uint64_t hi = Profile::bin_lower(b + 1);
+        REQUIRE(b < Profile::n_bins);
+        REQUIRE(lo <= v);
+        REQUIRE(v < hi);
+        if (lo >= 4) {
+            REQUIRE(4 * (hi - lo) <= lo);
+        }
+    }
+}
+
+TEST_CASE("Phases are timed on a sample of steps", "[PROFILE]")
+{
+    fs::path path = fs::temp_directory_path() / "groho_profile_test.json";
+
+    profile().reset();
+    {
+        ProfileScope timer(KERNEL_LOAD);
+    }
+    const size_t steps = 2 * Profile::sample_every + 1;
+    for (size_t k = 0; k < steps; k++) {
+        profile().begin_step(k);
+        ProfileLap lap;
+        lap(ORRERY);
+        lap(GRAVITY);
+        lap(GRAVITY);
+    }
+    profile().end_steps();
+    REQUIRE(profile().write(path));
+
+    std::ifstream     file(path);
+    std::stringstream json;
+    json << file.rdbuf();
+    auto line = [&json](const std::string& key) {
+        std::string s = json.str();
+        size_t      i = s.find("\"" + key + "\"");
+        REQUIRE(i != std::string::npos);
+        return s.substr(i, s.find('\n', i) - i);
+    };
+
+    // Steps 0, 17 and 34 are timed, and stand for 17 steps each
+    CHECK(line("steps") == "\"steps\": 35,");
+    CHECK(line("kernel_load").find("\"calls\": 1,") != std::string::npos);
+    CHECK(line("orrery").find("\"calls\": 51,") != std::string::npos);
+    CHECK(line("gravity").find("\"calls\": 102,") != std::string::npos);
+    CHECK(line("plans").find("\"calls\": 0,") != std::string::npos);
+
+    fs::remove(path);
+}
@@ -1,6 +1,12 @@
 #include "catch.hpp"
 
+#include <cmath>
+#include <fstream>
+#include <random>
+
+#include "batchdownsampler.hpp"
 #include "serialize.hpp"
+#include "simd.hpp"
 
 using namespace groho;
 
@@ -36,10 +42,335 @@ TEST_CASE("Serializer sampling check", "[SAMPLING]")
         sampler.append({ { 1e8, 1e8, 1e8 } });
     }
 
-    std::ifstream file(path / "pos0.bin", std::ios::binary | std::ios::in);
-    V3d           pos_back[3];
-    file.read((char*)pos_back, sizeof(V3d) * 3);
-    REQUIRE(pos_back[0] == V3d{ 0, 0, 0 });
-    REQUIRE(pos_back[1] == V3d{ 1e8, 1e8, 0 });
-    REQUIRE(pos_back[2] == V3d{ 1e8, 1e8, 1e8 });
-}
\ No newline at end of file
+    auto pos_back = read_trajectory(path / "pos0.bin");
+    REQUIRE(pos_back);
+    REQUIRE(pos_back->size() == 3);
+    REQUIRE((*pos_back)[0] == V3d{ 0, 0, 0 });
+    REQUIRE((*pos_back)[1] == V3d{ 1e8, 1e8, 0 });
+    REQUIRE((*pos_back)[2] == V3d{ 1e8, 1e8, 1e8 });
+}
+
+TEST_CASE("Serializer can keep every sample", "[SAMPLING]")
+{
+    std::vector<NAIFbody> objects = { 0 };
+
+    auto path = fs::temp_directory_path();
+    {
+        auto sampler = Serialize(sim_par, objects, path, nullptr, false);
+        for (size_t i = 0; i < 100; i++) {
+            sampler.append({ { 1e3 * i, 0, 0, double(i) } });
+        }
+    }
+
+    auto pos_back = read_trajectory(path / "pos0.bin");
+    REQUIRE(pos_back);
+    REQUIRE(pos_back->size() == 100);
+    REQUIRE((*pos_back)[99] == V3d{ 99e3, 0, 0 });
+}
+
+TEST_CASE("Trajectory files can be read by time", "[SAMPLING]")
+{
+    auto path  = fs::temp_directory_path() / "groho-trajectory-test.bin";
+    auto track = [](size_t i) {
+        return V3d{ double(i), 2.0 * i, 3.0 * i, 10.0 * i };
+    };
+
+    const size_t n = 3 * TrajectoryWriter::chunk_samples + 17;
+    {
+        TrajectoryWriter writer(path, NAIFbody(-1000));
+        for (size_t i = 0; i < n; i++) {
+            writer.write(track(i));
+        }
+
+        // Before the file is closed there is no index, and the chunk still
+        // being filled is not in the file yet
+        auto index = read_trajectory_index(path);
+        REQUIRE(index);
+        REQUIRE(index->size() <= 3);
+    }
+
+    auto index = read_trajectory_index(path);
+    REQUIRE(index);
+    REQUIRE(index->size() == 4);
+    REQUIRE((*index)[0].t_begin == 0);
+    REQUIRE((*index)[3].n == 17);
+    REQUIRE((*index)[3].t_end == 10.0 * (n - 1));
+    REQUIRE(*trajectory_samples(path) == n);
+
+    auto all = read_trajectory(path);
+    REQUIRE(all->size() == n);
+    for (size_t i = 0; i < n; i++) {
+        REQUIRE((*all)[i] == track(i));
+    }
+
+    // Only the chunks that overlap the window
+    double t0     = 10.0 * (TrajectoryWriter::chunk_samples + 10);
+    auto   window = read_trajectory(path, t0, t0 + 100);
+    REQUIRE(window->size() == TrajectoryWriter::chunk_samples);
+    REQUIRE(window->front() == track(TrajectoryWriter::chunk_samples));
+
+    // Carrying on from part way through a chunk gives the same file
+    auto bytes = [&path]() {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(
+            std::istreambuf_iterator<char>(file),
+            std::istreambuf_iterator<char>());
+    };
+    auto whole = bytes();
+    {
+        size_t           from = 2 * TrajectoryWriter::chunk_samples + 100;
+        TrajectoryWriter writer(path, NAIFbody(-1000), from);
+        for (size_t i = from; i < n; i++) {
+            writer.write(track(i));
+        }
+    }
+    REQUIRE(bytes() == whole);
+
+    // Not a trajectory file
+    {
+        std::ofstream junk(path);
+        junk << "Not a trajectory";
+    }
+    REQUIRE(!read_trajectory(path));
+    fs::remove(path);
+}
+
+TEST_CASE("Chebyshev output fits the trajectory", "[SAMPLING]")
+{
+    auto path = fs::temp_directory_path() / "groho-chebyshev-test.bin";
+
+    // An orbit that starts to spiral out part way, as from a burn
+    auto track = [](double t) {
+        double a  = 2 * M_PI * t / 86400.0;
+        double dt = std::max(t - 3e5, 0.0);
+        double r  = 7000 + 0.5e-8 * dt * dt;
+        return V3d{ r * cos(a), r * sin(a), 0.1 * r * sin(2 * a), t };
+    };
+    const double tolerance = 1e-3;
+    const double dt        = 60;
+    const size_t n         = 20000;
+    const size_t split     = 12345;
+
+    size_t    records = 0;
+    v3d_vec_t pending;
+    {
+        ChebyshevWriter writer(path, NAIFbody(-1000), tolerance);
+        for (size_t i = 0; i < n; i++) {
+            if (i == split) {
+                writer.close_segment();
+                records = writer.records();
+                pending = writer.pending();
+            }
+            writer.write(track(i * dt));
+        }
+    }
+    REQUIRE(pending.size() == 1);
+    REQUIRE(is_chebyshev_trajectory(path));
+
+    auto trajectory = read_chebyshev_trajectory(path);
+    REQUIRE(trajectory);
+    REQUIRE(trajectory->n_coeff == ChebyshevWriter::n_coeff);
+    REQUIRE(trajectory->t_begin() == 0);
+    REQUIRE(trajectory->t_end() == (n - 1) * dt);
+    REQUIRE(*chebyshev_records(path) == trajectory->size());
+
+    // Much smaller than the samples, and within tolerance at every one
+    REQUIRE(trajectory->size() * trajectory->record_size() < n);
+    for (size_t i = 0; i < n; i++) {
+        REQUIRE((trajectory->at(i * dt) - track(i * dt)).norm() <= tolerance);
+    }
+    // and good between them too
+    for (size_t i = 0; i + 1 < n; i++) {
+        double t = (i + 0.5) * dt;
+        REQUIRE((trajectory->at(t) - track(t)).norm() <= 2 * tolerance);
+    }
+
+    // Carrying on from a snapshot gives the same file
+    auto bytes = [&path]() {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(
+            std::istreambuf_iterator<char>(file),
+            std::istreambuf_iterator<char>());
+    };
+    auto whole = bytes();
+    {
+        ChebyshevWriter writer(
+            path, NAIFbody(-1000), tolerance, records, pending);
+        for (size_t i = split; i < n; i++) {
+            writer.write(track(i * dt));
+        }
+    }
+    REQUIRE(bytes() == whole);
+
+    REQUIRE(!read_chebyshev_trajectory(
+        fs::temp_directory_path() / "groho-no-such-file.bin"));
+    fs::remove(path);
+}
+
+void check_batch_downsampler(SimdLevel level)
+{
+    set_simd_level(level);
+
+    // An odd number of bodies, so the SIMD kernels have a scalar tail
+    const size_t                           n = 37;
+    std::mt19937                           gen(42);
+    std::uniform_real_distribution<double> step(-1e4, 1e4), turn(-0.2, 0.2);
+    std::uniform_int_distribution<int>     event(0, 99);
+
+    std::vector<FractalDownsampler> reference;
+    BatchDownsampler                batch;
+    v3d_vec_t                       pos(n + 1), vel(n + 1);
+    std::vector<size_t>             index(n), accepted, expected;
+    for (size_t i = 0; i < n; i++) {
+        // Tight and loose thresholds, so that both tests take samples
+        FractalDownsampler sampler(1.0 + 1e-4 * (i % 5), 1e2 * (1 + i % 7));
+        reference.push_back(sampler);
+        REQUIRE(batch.add(sampler) == i);
+        index[i] = n - i; // pos[0] is never sampled
+        vel[i]   = { step(gen), step(gen), step(gen) };
+    }
+
+    for (size_t k = 0; k < 2000; k++) {
+        for (size_t i = 0; i <= n; i++) {
+            // Some stand still for a while, some jump about and some glide,
+            // turning so little that the linear threshold takes their samples
+            bool still = (i % 9 == 0) && (k % 200 < 100);
+            bool glide = (i % 4 == 1);
+            if (still) {
+                pos[i].t = double(k);
+                continue;
+            }
+            if (!glide && event(gen) < 3) {
+                vel[i] = { step(gen), step(gen), step(gen) };
+            } else {
+                double a = turn(gen) * (glide ? 1e-2 : 1);
+                vel[i]   = { vel[i].x * cos(a) - vel[i].y * sin(a),
+                           vel[i].x * sin(a) + vel[i].y * cos(a),
+                           vel[i].z };
+                pos[i]   = pos[i] + vel[i];
+            }
+            pos[i].t = double(k);
+        }
+
+        expected.clear();
+        for (size_t i = 0; i < n; i++) {
+            if (reference[i](pos[index[i]])) {
+                expected.push_back(i);
+            }
+        }
+        batch(pos, index, accepted);
+        REQUIRE(accepted == expected);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        V3d  a, b;
+        bool fa = reference[i].flush(a);
+        REQUIRE(batch.flush(i, b) == fa);
+        if (fa) {
+            REQUIRE(a == b);
+            REQUIRE(a.t == b.t);
+        }
+
+        // A downsampler taken back out carries on as before
+        FractalDownsampler copy = batch.get(i);
+        for (size_t k = 0; k < 10; k++) {
+            V3d v = { 1e3 * k * k, 0, 1e3 * k, 2000.0 + k };
+            REQUIRE(copy(v) == reference[i](v));
+        }
+    }
+
+    set_simd_level(supported_simd_level());
+}
+
+TEST_CASE("Batched downsampler takes the same samples", "[SAMPLING]")
+{
+    SECTION("Scalar") { check_batch_downsampler(SimdLevel::SCALAR); }
+    SECTION("SSE2") { check_batch_downsampler(SimdLevel::SSE2); }
+    SECTION("AVX2") { check_batch_downsampler(SimdLevel::AVX2); }
+}
+
+TEST_CASE("Serializer output through an async writer", "[SAMPLING]")
+{
+    std::vector<NAIFbody> objects = { 0, 1, 2 };
+
+    auto track = [](size_t i) {
+        double a = i * 0.01;
+        return V3d{ 1e8 * cos(a), 1e8 * sin(a), 1e5 * i, double(i) };
+    };
+    auto contents = [](const fs::path& path) {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(
+            std::istreambuf_iterator<char>(file),
+            std::istreambuf_iterator<char>());
+    };
+
+    auto direct = fs::temp_directory_path() / "groho-direct-test";
+    auto async  = fs::temp_directory_path() / "groho-async-test";
+    for (auto output : { SimParams::POINTS, SimParams::CHEBYSHEV }) {
+        auto sim   = sim_par;
+        sim.output = output;
+        sim.rt     = 1.0001;
+        {
+            AsyncWriter writer;
+            auto        a = Serialize(sim, objects, direct);
+            auto        b = Serialize(sim, objects, async, &writer);
+            for (size_t i = 0; i < 30000; i++) {
+                v3d_vec_t pos(objects.size(), track(i));
+                a.append(pos);
+                b.append(pos);
+            }
+        }
+        for (auto code : objects) {
+            REQUIRE(
+                contents(history_file(direct, code))
+                == contents(history_file(async, code)));
+        }
+    }
+    fs::remove_all(direct);
+    fs::remove_all(async);
+}
+
+TEST_CASE("Serializer resumes from a snapshot", "[SAMPLING]")
+{
+    std::vector<NAIFbody> objects = { 0, 1 };
+
+    auto path  = fs::temp_directory_path() / "groho-resume-test";
+    auto track = [](size_t i) {
+        double a = i * 0.01;
+        return V3d{ 1e8 * cos(a), 1e8 * sin(a), 1e5 * i, double(i) };
+    };
+    auto contents = [&path](NAIFbody code) {
+        std::ifstream file(history_file(path, code), std::ios::binary);
+        return std::string(
+            std::istreambuf_iterator<char>(file),
+            std::istreambuf_iterator<char>());
+    };
+
+    std::vector<History::Snapshot> snapshots(objects.size());
+    {
+        auto sampler = Serialize(sim_par, objects, path);
+        for (size_t i = 0; i < 1000; i++) {
+            if (i == 600) {
+                sampler.snapshot(snapshots);
+            }
+            sampler.append({ track(i), track(i) });
+        }
+    }
+    auto full0 = contents(0);
+    auto full1 = contents(1);
+    REQUIRE(snapshots[0].samples > 0);
+    REQUIRE(
+        *trajectory_samples(history_file(path, 0)) > snapshots[0].samples);
+
+    // Only the first object is written to, the second is left as it was
+    {
+        std::vector<std::optional<History::Snapshot>> from
+            = { snapshots[0], {} };
+        auto sampler = Serialize(sim_par, objects, path, from);
+        for (size_t i = 600; i < 1000; i++) {
+            sampler.append({ track(i), V3d{ 0, 0, 0 } });
+        }
+    }
+    REQUIRE(contents(0) == full0);
+    REQUIRE(contents(1) == full1);
+}
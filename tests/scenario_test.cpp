@@ -45,3 +45,129 @@ TEST_CASE("Scenario integrative test", "[SCENARIO]")
     auto     lines = load_input_file("../examples/001.basics/scn.groho.txt");
     Scenario scenario(*lines);
 }
+
+TEST_CASE("Scenario changes", "[SCENARIO]")
+{
+    auto     lines = load_input_file("../examples/001.basics/scn.groho.txt");
+    Scenario scenario(*lines);
+
+    REQUIRE(!Scenario(*lines).changes_from(scenario).any());
+
+    // Durga's second command
+    auto edited = *lines;
+    for (auto& line : edited) {
+        if (line.key == "2050.01.01:0.51") {
+            line.value = "3600 orbit 301 600x200";
+        }
+    }
+    auto changes = Scenario(edited).changes_from(scenario);
+    REQUIRE(changes.any());
+    REQUIRE(!changes.setup);
+    REQUIRE(changes.craft == std::vector<bool>{ true, false });
+    REQUIRE(
+        changes.from == scenario.spacecraft_tokens[0].command_tokens[1].start);
+
+    // Changing the time grid means starting over
+    for (auto& line : edited) {
+        if (line.key == "end") {
+            line.value = "2021.02.01:0.5";
+        }
+    }
+    changes = Scenario(edited).changes_from(scenario);
+    REQUIRE(changes.setup);
+    REQUIRE(changes.from == scenario.sim.begin);
+}
+
+TEST_CASE("Scenario integrator", "[SCENARIO]")
+{
+    auto     lines = load_input_file("../examples/001.basics/scn.groho.txt");
+    Scenario scenario(*lines);
+    REQUIRE(scenario.sim.integrator == SimParams::FIXED);
+    REQUIRE(!scenario.spacecraft_tokens[0].tolerance);
+
+    // A tolerance before the plans is the default, one inside a plan is just
+    // for that craft
+    auto edited = *lines;
+    auto durga  = std::find_if(edited.begin(), edited.end(), [](auto& line) {
+        return line.key == "plan";
+    });
+    edited.insert(durga + 1, { {}, 0, "tolerance", "1e-5" });
+    edited.insert(edited.begin(), { {}, 0, "tolerance", "0.01" });
+    edited.insert(edited.begin(), { {}, 0, "integrator", "adaptive" });
+
+    Scenario adaptive(edited);
+    REQUIRE(adaptive.sim.integrator == SimParams::ADAPTIVE);
+    REQUIRE(adaptive.sim.tolerance == 0.01);
+    REQUIRE(adaptive.spacecraft_tokens[0].tolerance == 1e-5);
+    REQUIRE(!adaptive.spacecraft_tokens[1].tolerance);
+
+    // Changing the integrator means starting over, changing a craft's
+    // tolerance means rerunning that craft
+    REQUIRE(adaptive.changes_from(scenario).setup);
+
+    auto retuned = edited;
+    for (auto& line : retuned) {
+        if ((line.key == "tolerance") && (line.value == "1e-5")) {
+            line.value = "1e-6";
+        }
+    }
+    auto changes = Scenario(retuned).changes_from(adaptive);
+    REQUIRE(!changes.setup);
+    REQUIRE(changes.craft == std::vector<bool>{ true, false });
+    REQUIRE(changes.from == adaptive.sim.begin);
+
+    for (auto& line : retuned) {
+        if (line.key == "integrator") {
+            line.value = "leapfrog";
+        }
+    }
+    Scenario misspelt(retuned);
+    auto     bad = std::find_if(
+        misspelt.lines.begin(), misspelt.lines.end(), [](auto& line) {
+            return line.key == "integrator";
+        });
+    REQUIRE(bad->status.code == ParseStatus::ERROR);
+
+    for (auto& line : retuned) {
+        if (line.key == "integrator") {
+            line.value = "block";
+        }
+    }
+    Scenario block(retuned);
+    REQUIRE(block.sim.integrator == SimParams::BLOCK);
+    REQUIRE(block.spacecraft_tokens[0].tolerance == 1e-6);
+    REQUIRE(block.changes_from(adaptive).setup);
+
+    for (auto [name, integrator] :
+         { std::pair{ "forest_ruth", SimParams::FOREST_RUTH },
+           std::pair{ "yoshida6", SimParams::YOSHIDA6 },
+           std::pair{ "encke", SimParams::ENCKE },
+           std::pair{ "radau", SimParams::RADAU } }) {
+        for (auto& line : retuned) {
+            if (line.key == "integrator") {
+                line.value = name;
+            }
+        }
+        REQUIRE(Scenario(retuned).sim.integrator == integrator);
+    }
+}
+
+TEST_CASE("Scenario orrery cadence", "[SCENARIO]")
+{
+    auto     lines = load_input_file("../examples/001.basics/scn.groho.txt");
+    Scenario scenario(*lines);
+    REQUIRE(scenario.sim.orrery_dt == 0);
+
+    auto edited = *lines;
+    edited.insert(edited.begin(), { {}, 0, "orrery_dt", "86400" });
+    Scenario daily(edited);
+    REQUIRE(daily.sim.orrery_dt == 86400);
+
+    // The orrery output is rewritten, so we start over
+    REQUIRE(daily.changes_from(scenario).setup);
+
+    edited.front().value = "-1";
+    Scenario negative(edited);
+    REQUIRE(negative.sim.orrery_dt == 0);
+    REQUIRE(negative.lines.front().status.code == ParseStatus::ERROR);
+}
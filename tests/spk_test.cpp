@@ -1,6 +1,7 @@
 #include "catch.hpp"
 
 #include "spk.hpp"
+#include "syntheticspk.hpp"
 
 using namespace groho;
 
@@ -12,21 +13,32 @@ TEST_CASE("A bad file should not load", "[SPK]")
 
 TEST_CASE("Load a regular BSP file", "[SPK]")
 {
-    auto _spk = SpkFile::load("groho-test-data/de432s.bsp");
+    SyntheticKernel kernel;
+    auto            path = fs::temp_directory_path() / "groho-spk.bsp";
+    REQUIRE(write_synthetic_spk(path, kernel));
+
+    auto _spk = SpkFile::load(path);
     REQUIRE(_spk);
 
     auto spk = *_spk;
-    REQUIRE(spk.summaries.size() == 14);
+    REQUIRE(spk.summaries.size() == 20);
 
     const auto& earth = spk.summaries[NAIFbody(399)];
-    REQUIRE(earth.begin_second == J2000_s(GregorianDate{ 1949, 12, 14, 0 }));
+    REQUIRE(earth.begin_second == kernel.begin);
     REQUIRE(earth.center_id == 3);
+
+    fs::remove(path);
 }
 
 TEST_CASE("Load an ephemeris from BSP file", "[SPK]")
 {
-    auto _spk = SpkFile::load("groho-test-data/de432s.bsp");
-    auto spk  = *_spk;
+    SyntheticKernel kernel;
+    auto            path = fs::temp_directory_path() / "groho-spk.bsp";
+    REQUIRE(write_synthetic_spk(path, kernel));
+
+    auto _spk = SpkFile::load(path);
+    REQUIRE(_spk);
+    auto spk = *_spk;
 
     auto eph1 = spk.load_ephemeris(
         NAIFbody(301),
@@ -47,4 +59,120 @@ TEST_CASE("Load an ephemeris from BSP file", "[SPK]")
         J2000_s(GregorianDate{ 2100, 01, 01 }),
         J2000_s(GregorianDate{ 2110, 01, 01 }));
     REQUIRE(!eph3);
+
+    fs::remove(path);
+}
+
+TEST_CASE("Mapped and streamed kernels agree", "[SPK]")
+{
+    SyntheticKernel kernel;
+    auto            path = fs::temp_directory_path() / "groho-spk.bsp";
+    REQUIRE(write_synthetic_spk(path, kernel));
+
+    auto _mapped = SpkFile::load(path);
+    REQUIRE(_mapped);
+    REQUIRE(_mapped->mapped);
+
+    auto _streamed = SpkFile::load(path, SpkFile::Access::STREAM);
+    REQUIRE(_streamed);
+    REQUIRE(!_streamed->mapped);
+
+    J2000_s begin = GregorianDate{ 2000, 01, 01 };
+    J2000_s end   = GregorianDate{ 2010, 01, 01 };
+    auto    eph1  = _mapped->load_ephemeris(NAIFbody(301), begin, end);
+    auto    eph2  = _streamed->load_ephemeris(NAIFbody(301), begin, end);
+    REQUIRE(eph1);
+    REQUIRE(eph2);
+    REQUIRE(eph1->size() == eph2->size());
+
+    V3d pos1, pos2;
+    for (double t = begin; t < end; t += 86400 * 7.3) {
+        eph1->eval(t, pos1);
+        eph2->eval(t, pos2);
+        REQUIRE(pos1 == pos2);
+    }
+
+    fs::remove(path);
+}
+
+TEST_CASE("Ephemeris records are loaded as needed", "[SPK]")
+{
+    SyntheticKernel kernel;
+    auto            path = fs::temp_directory_path() / "groho-spk.bsp";
+    REQUIRE(write_synthetic_spk(path, kernel));
+
+    auto _spk = SpkFile::load(path);
+    REQUIRE(_spk);
+
+    J2000_s begin = GregorianDate{ 2000, 01, 01 };
+    J2000_s end   = GregorianDate{ 2010, 01, 01 };
+    auto    eph   = _spk->load_ephemeris(NAIFbody(301), begin, end);
+    REQUIRE(eph);
+    REQUIRE(eph->records->resident() == 0);
+
+    V3d pos1, pos2;
+    eph->eval(begin, pos1);
+    REQUIRE(eph->records->resident() == 1);
+
+    // Walking through time we only hold on to a window of records
+    J2000_s later = GregorianDate{ 2005, 01, 01 };
+    for (double t = begin; t < later; t += 86400) {
+        eph->eval(t, pos2);
+        eph->release_before(t);
+        REQUIRE(eph->records->resident() <= 2);
+    }
+
+    // and records we have let go of come back when asked for
+    eph->eval(begin, pos2);
+    REQUIRE(pos1 == pos2);
+
+    fs::remove(path);
+}
+
+TEST_CASE("Synthetic kernels follow their orbits", "[SPK]")
+{
+    // Two blocks of summaries, and the asteroids
+    SyntheticKernel kernel;
+    kernel.bodies = 40;
+    kernel.begin  = GregorianDate{ 2020, 01, 01 };
+    kernel.end    = GregorianDate{ 2021, 01, 01 };
+    auto bodies   = synthetic_bodies(kernel.bodies);
+    REQUIRE(bodies.size() == 40);
+
+    for (uint32_t data_type : { 2, 3 }) {
+        kernel.data_type = data_type;
+
+        auto path = fs::temp_directory_path() / "groho-synthetic.bsp";
+        REQUIRE(write_synthetic_spk(path, kernel));
+
+        auto spk = SpkFile::load(path);
+        REQUIRE(spk);
+        REQUIRE(spk->summaries.size() == 40);
+
+        for (const auto& body : bodies) {
+            const auto& s = spk->summaries[body.code];
+            REQUIRE(s.center_id == uint32_t(int(body.center)));
+            REQUIRE(s.data_type == data_type);
+
+            auto eph = spk->load_ephemeris(body.code, kernel.begin, kernel.end);
+            REQUIRE(eph);
+            REQUIRE(eph->has_vel == (data_type == 3));
+
+            // As good as doubles get, but for the velocity of a Type II
+            // kernel, which comes from differentiating the position series
+            double speed = 2 * M_PI * body.radius / body.period;
+            double dv    = (data_type == 3) ? 1e-12 : 1e-9;
+
+            V3d pos, vel, acc;
+            for (double t = kernel.begin; t < kernel.end; t += 86400 * 3.7) {
+                eph->eval(t, pos, vel, acc);
+                REQUIRE((pos - body.pos(t)).norm() < 1e-12 * body.radius);
+                REQUIRE((vel - body.vel(t)).norm() < dv * speed);
+            }
+        }
+        fs::remove(path);
+    }
+
+    kernel.n_coeff = 1;
+    REQUIRE(!write_synthetic_spk("unused.bsp", kernel));
 }
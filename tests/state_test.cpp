@@ -1,25 +1,26 @@
-#include <iostream>
-
 #include "catch.hpp"
 
 #include "state.hpp"
 
 using namespace groho;
 
-TEST_CASE("State vel acc check", "[SAMPLING]")
+TEST_CASE("Orrery state", "[STATE]")
 {
-    auto state = DiffableState({ {}, {} }, { 0, 1 }, 1);
-
-    state.next_pos() = { { 0, 0, 0 }, { 0, 0, 0 } };
-    state.next_pos() = { { 0, 1, 0 }, { 0, 2, 0 } };
-    state.next_pos() = { { 0, 4, 0 }, { 0, 4, 0 } };
-
-    REQUIRE(state.pos()[0] == V3d{ 0, 4, 0 });
-    REQUIRE(state.pos()[1] == V3d{ 0, 4, 0 });
-
-    REQUIRE(state.vel(0) == V3d{ 0, 3, 0 });
-    REQUIRE(state.vel(1) == V3d{ 0, 2, 0 });
-
-    REQUIRE(state.acc(0) == V3d{ 0, 2, 0 });
-    REQUIRE(state.acc(1) == V3d{ 0, 0, 0 });
+    std::vector<BodyConstant> bodies = { { NAIFbody(10), "Sun", 1.3e11, 7e5 },
+                                         { NAIFbody(399), "Earth", 4e5, 6e3 } };
+    auto state = State(bodies, { 0, 1 }, { NAIFbody(-1000) });
+
+    REQUIRE(state.orrery.size() == 2);
+    REQUIRE(state.orrery.idx_of(NAIFbody(399)) == 1);
+    REQUIRE(state.orrery.body(NAIFbody(399)).name == "Earth");
+
+    // Set by the orrery all together, and read back body by body
+    state.orrery.pos() = { { 0, 0, 0 }, { 1.5e8, 0, 0 } };
+    state.orrery.vel() = { { 0, 0, 0 }, { 0, 30, 0 } };
+    state.orrery.acc() = { { 0, 0, 0 }, { -6e-6, 0, 0 } };
+
+    REQUIRE(state.orrery.pos(1) == V3d{ 1.5e8, 0, 0 });
+    REQUIRE(state.orrery.vel(1) == V3d{ 0, 30, 0 });
+    REQUIRE(state.orrery.acc(1) == V3d{ -6e-6, 0, 0 });
+    REQUIRE(state.orrery.vel(0) == V3d{ 0, 0, 0 });
 }
@@ -0,0 +1,149 @@
+#include <chrono>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include "catch.hpp"
+
+#include "samplestream.hpp"
+
+using namespace groho;
+
+int connect_viewer(const fs::path& path)
+{
+    sockaddr_un addr = {};
+    addr.sun_family  = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+void wait_for_subscribers(SampleStream& stream, size_t n)
+{
+    for (size_t i = 0; (i < 200) && (stream.subscribers() != n); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    REQUIRE(stream.subscribers() == n);
+}
+
+// False if the viewer's socket timed out or closed first
+template <typename T> bool try_read(int fd, T& v)
+{
+    char*  dst  = (char*)&v;
+    size_t done = 0;
+    while (done < sizeof(T)) {
+        ssize_t n = ::read(fd, dst + done, sizeof(T) - done);
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+template <typename T> T read_from(int fd)
+{
+    T v;
+    REQUIRE(try_read(fd, v));
+    return v;
+}
+
+TEST_CASE("Samples are streamed to viewers", "[STREAM]")
+{
+    auto path = fs::temp_directory_path() / "groho-stream-test.sock";
+
+    SampleStream stream(path);
+    REQUIRE(stream.is_open());
+
+    // Nobody is listening, so nothing is kept
+    stream.add(NAIFbody(399), { 1, 2, 3, 0 });
+    stream.send();
+
+    int a = connect_viewer(path), b = connect_viewer(path);
+    wait_for_subscribers(stream, 2);
+
+    stream.begin_run(10, 20);
+    stream.add(NAIFbody(399), { 1, 2, 3, 10 });
+    stream.add(NAIFbody(-1000), { 4, 5, 6, 11 });
+    stream.send();
+
+    for (int fd : { a, b }) {
+        auto run = read_from<StreamHeader>(fd);
+        REQUIRE(std::string(run.magic) == "GRS");
+        REQUIRE(run.type == StreamHeader::RUN);
+        REQUIRE(run.n == 0);
+        REQUIRE(run.begin == 10);
+        REQUIRE(run.end == 20);
+
+        auto samples = read_from<StreamHeader>(fd);
+        REQUIRE(samples.type == StreamHeader::SAMPLES);
+        REQUIRE(samples.seq == run.seq + 1);
+        REQUIRE(samples.n == 2);
+        REQUIRE(samples.begin == 10);
+        REQUIRE(samples.end == 11);
+
+        auto s0 = read_from<StreamSample>(fd);
+        auto s1 = read_from<StreamSample>(fd);
+        REQUIRE(s0.code == 399);
+        REQUIRE(s0.x == 1);
+        REQUIRE(s1.code == -1000);
+        REQUIRE(s1.t == 11);
+        REQUIRE(s1.z == 6);
+    }
+
+    // A viewer leaving doesn't bother the others
+    ::close(a);
+    wait_for_subscribers(stream, 1);
+    stream.add(NAIFbody(399), { 7, 8, 9, 12 });
+    stream.send();
+    REQUIRE(read_from<StreamHeader>(b).n == 1);
+    REQUIRE(read_from<StreamSample>(b).t == 12);
+    ::close(b);
+}
+
+TEST_CASE("A slow viewer misses messages", "[STREAM]")
+{
+    auto path = fs::temp_directory_path() / "groho-stream-slow.sock";
+
+    // Room for a few messages, beyond what the socket itself buffers
+    SampleStream stream(path, 1 << 12);
+    int          fd = connect_viewer(path);
+    wait_for_subscribers(stream, 1);
+
+    // We never wait on the viewer
+    const size_t messages = 20000;
+    for (size_t i = 0; i < messages; i++) {
+        stream.add(NAIFbody(399), { 0, 0, 0, double(i) });
+        stream.send();
+    }
+
+    // The last messages may be the ones missed, so read till the stream
+    // goes quiet
+    timeval timeout = { 0, 200000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // What does arrive is whole messages, in order, with gaps in seq
+    size_t       received = 0;
+    uint64_t     last_seq = 0;
+    bool         gap      = false;
+    StreamHeader header;
+    while (try_read(fd, header)) {
+        auto sample = read_from<StreamSample>(fd);
+        REQUIRE(header.n == 1);
+        REQUIRE(sample.t == double(header.seq));
+        if (received > 0) {
+            REQUIRE(header.seq > last_seq);
+            gap |= (header.seq != last_seq + 1);
+        }
+        last_seq = header.seq;
+        received++;
+    }
+    REQUIRE(received > 0);
+    REQUIRE(gap);
+    REQUIRE(received < messages);
+    ::close(fd);
+}
@@ -0,0 +1,42 @@
+#include <atomic>
+#include <vector>
+
+#include "catch.hpp"
+
+#include "threadpool.hpp"
+
+using namespace groho;
+
+TEST_CASE("Thread pool covers the range once", "[THREADPOOL]")
+{
+    ThreadPool pool(4);
+    REQUIRE(pool.size() == 4);
+
+    for (size_t n : { 0, 1, 7, 100, 1000, 12345 }) {
+        std::vector<std::atomic<int>> visits(n);
+        pool.parallel_for(n, 8, [&visits](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                visits[i]++;
+            }
+        });
+        for (size_t i = 0; i < n; i++) {
+            REQUIRE(visits[i] == 1);
+        }
+    }
+}
+
+TEST_CASE("Thread pool run many times", "[THREADPOOL]")
+{
+    ThreadPool          pool(3);
+    std::vector<double> x(512, 0);
+    for (size_t step = 0; step < 2000; step++) {
+        pool.parallel_for(x.size(), 16, [&x](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                x[i] += i;
+            }
+        });
+    }
+    for (size_t i = 0; i < x.size(); i++) {
+        REQUIRE(x[i] == 2000.0 * i);
+    }
+}
@@ -0,0 +1,93 @@
+/*
+This file is part of Groho, a simulator for inter-planetary travel and warfare.
+Copyright (c) 2020 by Kaushik Ghose. Some rights reserved, see LICENSE
+
+Write a synthetic SPK kernel (see syntheticspk.hpp) of as many bodies, over as
+long a time, as we like, to try the orrery out on without the JPL files
+
+    build/groho_synthspk asteroids.bsp --bodies 10020 --type 3
+*/
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <optional>
+
+#include "CLI11.hpp"
+
+#include "syntheticspk.hpp"
+
+#define LOGURU_WITH_STREAMS 1
+#include "loguru.hpp"
+
+using namespace groho;
+
+std::optional<J2000_s> parse_date(const std::string& s)
+{
+    if (s.size() < 12) {
+        LOG_S(ERROR) << s << ": Dates look like YYYY.MM.DD:H";
+        return {};
+    }
+    auto [date, err] = as_gregorian_date(s);
+    if (err.size() > 0) {
+        LOG_S(ERROR) << s << ": " << err << ". Dates look like YYYY.MM.DD:H";
+        return {};
+    }
+    return J2000_s(date);
+}
+
+int main(int argc, char* argv[])
+{
+    CLI::App app{ "Write a synthetic SPK kernel" };
+
+    SyntheticKernel kernel;
+    std::string     out_file;
+    std::string     begin_date  = "2000.01.01:0";
+    std::string     end_date    = "2050.01.01:0";
+    size_t          degree      = kernel.n_coeff - 1;
+    double          record_days = kernel.record_s / 86400;
+    app.add_option("spk", out_file, "Kernel file to write")->required();
+    app.add_option(
+        "--bodies",
+        kernel.bodies,
+        "Number of bodies. The first 20 are the Sun, planets and Moon, the "
+        "rest asteroids");
+    app.add_option(
+        "--type",
+        kernel.data_type,
+        "SPK data type: 2 (position) or 3 (position and velocity)");
+    app.add_option(
+        "--degree", degree, "Degree of the Chebyshev polynomials");
+    app.add_option(
+        "--record-days", record_days, "Time span of each record, in days");
+    app.add_option("--begin", begin_date, "Start of the kernel, YYYY.MM.DD:H");
+    app.add_option("--end", end_date, "End of the kernel, YYYY.MM.DD:H");
+    CLI11_PARSE(app, argc, argv);
+
+    auto begin = parse_date(begin_date);
+    auto end   = parse_date(end_date);
+    if (!begin || !end) {
+        return 1;
+    }
+    kernel.begin    = *begin;
+    kernel.end      = *end;
+    kernel.n_coeff  = degree + 1;
+    kernel.record_s = record_days * 86400;
+
+    auto t0 = std::chrono::steady_clock::now();
+    if (!write_synthetic_spk(out_file, kernel)) {
+        return 1;
+    }
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - t0)
+                         .count();
+
+    size_t n_records
+        = std::ceil((kernel.end - kernel.begin) / kernel.record_s);
+    LOG_S(INFO) << out_file << ": " << kernel.bodies << " bodies, Type "
+                << kernel.data_type << ", " << n_records << " records of "
+                << kernel.n_coeff << " coefficients each, "
+                << fs::file_size(out_file) / 1e6 << " MB in " << elapsed
+                << " s";
+    return 0;
+}